@@ -0,0 +1,331 @@
+/*
+Rendering benchmark over the bundled scenes: the OBJ models in src/resources, the chess pieces
+placed as instances and the random sphere field the raytracer renders. For each scene it times
+the BVH build, a batch of primary camera rays and a batch of diffuse secondary rays leaving
+the primary hits, and counts what traversal did per ray. Results go to stdout as one JSON
+object so runs can be kept and compared commit to commit.
+
+Rays are traced on one thread and each batch is timed as the best of several repetitions,
+the ray counts per batch don't change between runs. Peak memory is the process's, so a
+scene's value includes every scene before it.
+
+--render N also path traces each scene's image at N samples per pixel with a fixed seed.
+--save-images DIR writes those renders as DIR/<scene>.pfm, and --reference DIR reports each
+render's RMSE against DIR/<scene>.pfm. Saving from the double precision build and comparing
+from the float one measures the image error single precision costs, the same seed giving
+both builds the same samples.
+
+    bench [--width 2|4|8] [--image W H] [--reps N] [--resources DIR]
+          [--render N] [--save-images DIR] [--reference DIR] [scene ...]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../include/utils.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/primitive_shapes/instance.h"
+#include "../include/primitive_shapes/sphere.h"
+#include "../include/acceleration/bvh_aggregate.h"
+#include "../include/camera.h"
+#define TINYOBJLOADER_IMPLEMENTATION  // This target's one translation unit compiles the loader
+#include "../include/obj_loader.h"
+#include "../samples/spheres/spheres.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+double peak_rss_mb() {
+#if defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / (1024.0 * 1024.0);  // Bytes on macOS
+#elif defined(__unix__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;  // Kilobytes on Linux
+#else
+    return -1;
+#endif
+}
+
+struct bench_scene {
+    hittable_list world;
+    std::vector<std::unique_ptr<triangleMesh>> meshes;
+    std::vector<std::pair<triangleMesh*, std::vector<transform>>> instanced;  // Given a BLAS, placed once per transform
+    bool frame_bounds = true;  // Aim the camera at the scene's bounds, else use lookfrom and lookat
+    vec3h lookfrom, lookat;
+    double fov = 40;
+};
+
+struct batch_result {
+    long rays = 0;
+    long hits = 0;
+    double seconds = 0;
+    traversal_stats stats;
+};
+
+bool file_exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+triangleMesh* load_mesh(bench_scene& scene, const std::string& path) {
+    // The mesh stays owned by the scene, primitive_store and instances only point at it
+    scene.meshes.push_back(std::make_unique<triangleMesh>(scene.world.materials->add(make_shared<lambertian>(color(0.7, 0.7, 0.7, 0)))));
+    obj_loader loader;
+    if (loader.load_into_triangleMesh(path, *scene.meshes.back()) <= 0) {
+        scene.meshes.pop_back();
+        return nullptr;
+    }
+    return scene.meshes.back().get();
+}
+
+bool load_scene(const std::string& name, const std::string& resources, bench_scene& scene, std::vector<std::string>& missing) {
+    if (name == "spheres") {
+        add_sphere_scene(scene.world);
+        scene.frame_bounds = false;
+        scene.lookfrom = vec3h(13, 2, 3, 1);
+        scene.lookat = vec3h(0, 0, 0, 1);
+        scene.fov = 20;
+        return true;
+    }
+    if (name == "chess") {
+        // Pieces stand in a row on a ground sphere, pawns three times over, as instances of one BLAS each
+        struct piece { const char* file; bool upright; int copies; };
+        const piece pieces[] = {{"pawn", false, 3}, {"knight", false, 1}, {"rook", false, 1}, {"king", true, 1}, {"queen", true, 1}};
+        double x = -12;
+        for (const piece& p : pieces) {
+            std::string path = resources + "/chess/" + p.file + ".obj";
+            triangleMesh* mesh = file_exists(path) ? load_mesh(scene, path) : nullptr;
+            if (mesh == nullptr) {
+                missing.push_back(path);
+                continue;
+            }
+            std::vector<transform> places;
+            for (int c = 0; c < p.copies; c++, x += 4) {
+                transform stand = p.upright ? scale(1, 1, 1) : rotateX(-pi / 2);
+                transform shift = translate(vec3h(x, 0, 0, 0));
+                places.push_back(combine_transform(shift, stand));
+            }
+            scene.instanced.emplace_back(mesh, places);
+        }
+        if (scene.instanced.empty()) return false;
+        scene.frame_bounds = false;  // The ground sphere's bounds would put the row out of sight
+        scene.lookfrom = vec3h(0, 6, 32, 1);
+        scene.lookat = vec3h(0, 0, 0, 1);
+        scene.fov = 45;
+        scene.world.add(sphere(vec3h(0, -1005, 0, 1), 1000, scene.world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)))));
+        return true;
+    }
+    std::string path = resources + "/" + name + ".obj";
+    triangleMesh* mesh = file_exists(path) ? load_mesh(scene, path) : nullptr;
+    if (mesh == nullptr) {
+        missing.push_back(path);
+        return false;
+    }
+    scene.world.add(mesh);
+    return true;
+}
+
+void scene_view(const bench_scene& scene, const Bounds3f& bounds, vec3h& lookfrom, vec3h& lookat) {
+    lookfrom = scene.lookfrom;
+    lookat = scene.lookat;
+    if (scene.frame_bounds) {
+        lookat = 0.5 * (bounds.pmin + bounds.pmax);
+        lookat.w = 1;
+        double radius = 0.5 * (bounds.pmax - bounds.pmin).magnitude();
+        lookfrom = lookat + (0.7 * radius / std::tan(degrees_to_radians(scene.fov / 2))) * vec3h(0.3, 0.4, 1, 0).normal_of();
+        lookfrom.w = 1;
+    }
+}
+
+std::vector<ray> camera_rays(const bench_scene& scene, const Bounds3f& bounds, int width, int height) {
+    // One pinhole ray through each pixel center
+    vec3h lookfrom, lookat;
+    scene_view(scene, bounds, lookfrom, lookat);
+    double h = std::tan(degrees_to_radians(scene.fov / 2));
+    vec3h forward = (lookat - lookfrom).normal_of();
+    vec3h right = cross_product(forward, vec3h(0, 1, 0, 0)).normal_of();
+    vec3h up = cross_product(right, forward);
+    std::vector<ray> rays;
+    rays.reserve(size_t(width) * height);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            double u = ((i + 0.5) / width * 2 - 1) * h * width / height;
+            double v = (1 - (j + 0.5) / height * 2) * h;
+            rays.push_back(ray(lookfrom, forward + u * right + v * up));
+        }
+    }
+    return rays;
+}
+
+batch_result trace(const BVHAggregate& bvh, const std::vector<ray>& rays, int repetitions, std::vector<hit_record>* hits_out = nullptr) {
+    // Closest hits for every ray, counts from the first run and time from the fastest
+    batch_result result;
+    result.rays = static_cast<long>(rays.size());
+    result.seconds = infinity;
+    for (int rep = 0; rep < repetitions; rep++) {
+        traversal_stats stats;
+        long hits = 0;
+        hit_record rec;
+        auto start = std::chrono::steady_clock::now();
+        for (const ray& r : rays) {
+            if (bvh.intersect(r, interval(0.001, infinity), rec, stats)) {
+                hits++;
+                if (hits_out && rep == 0) hits_out->push_back(rec);
+            }
+        }
+        result.seconds = std::min(result.seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        if (rep == 0) {
+            result.stats = stats;
+            result.hits = hits;
+        }
+    }
+    return result;
+}
+
+film render_scene(bench_scene& scene, const BVHAggregate& bvh, int width, int height, int samples) {
+    // Path traced image from the same view as the primary rays, on one thread like the batches
+    camera cam;
+    scene_view(scene, bvh.bounds(), cam.center, cam.lookat);
+    cam.image_width = width;
+    cam.aspect_ratio = double(width) / height;
+    cam.fov = scene.fov;
+    cam.aa_samples_per_px = samples;
+    cam.ray_bounces = 4;
+    cam.background = color(0.7, 0.8, 1.0, 0);
+    cam.num_threads = 1;
+    cam.seed = 1;
+    return cam.render_image(scene.world, bvh);
+}
+
+void print_batch(const char* name, const batch_result& b) {
+    double rays = std::max<long>(b.rays, 1);
+    std::cout << "      \"" << name << "\": {\"rays\": " << b.rays
+              << ", \"hit_rate\": " << b.hits / rays
+              << ", \"seconds\": " << b.seconds
+              << ", \"rays_per_second\": " << (b.seconds > 0 ? b.rays / b.seconds : 0)
+              << ", \"nodes_per_ray\": " << b.stats.nodes / rays
+              << ", \"box_tests_per_ray\": " << b.stats.box_tests / rays
+              << ", \"box_hits_per_ray\": " << b.stats.box_hits / rays
+              << ", \"primitives_per_ray\": " << b.stats.primitives / rays
+              << ", \"primitive_hits_per_ray\": " << b.stats.hits / rays << "}";
+}
+
+int main(int argc, char** argv) {
+    BVHWidth width = BVH2;
+    int image_width = 320, image_height = 180;
+    int repetitions = 3;
+    std::string resources = "src/resources";
+    int render_samples = 0;
+    std::string save_dir, reference_dir;
+    std::vector<std::string> names;
+    for (int a = 1; a < argc; a++) {
+        if (!std::strcmp(argv[a], "--width") && a + 1 < argc) {
+            int w = std::atoi(argv[++a]);
+            width = w == 8 ? BVH8 : w == 4 ? BVH4 : BVH2;
+        } else if (!std::strcmp(argv[a], "--image") && a + 2 < argc) {
+            image_width = std::max(1, std::atoi(argv[++a]));
+            image_height = std::max(1, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--reps") && a + 1 < argc) {
+            repetitions = std::max(1, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--resources") && a + 1 < argc) {
+            resources = argv[++a];
+        } else if (!std::strcmp(argv[a], "--render") && a + 1 < argc) {
+            render_samples = std::max(0, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--save-images") && a + 1 < argc) {
+            save_dir = argv[++a];
+        } else if (!std::strcmp(argv[a], "--reference") && a + 1 < argc) {
+            reference_dir = argv[++a];
+        } else {
+            names.push_back(argv[a]);
+        }
+    }
+    if (names.empty()) names = {"teapot", "cow", "lamp", "diamond", "chess", "spheres"};
+    if (render_samples == 0 && (!save_dir.empty() || !reference_dir.empty())) render_samples = 16;
+
+#if defined(RT_SIMD_AVX)
+    const char* simd = "AVX";
+#elif defined(RT_SIMD_SSE)
+    const char* simd = "SSE2";
+#else
+    const char* simd = "scalar";
+#endif
+
+    std::vector<std::string> missing;
+    std::cout.precision(6);
+    std::cout << "{\n  \"precision\": \"" << (sizeof(Float) == sizeof(float) ? "float" : "double") << "\""
+              << ",\n  \"simd\": \"" << simd << "\""
+              << ",\n  \"bvh_width\": " << (width == BVH8 ? 8 : width == BVH4 ? 4 : 2)
+              << ",\n  \"image\": [" << image_width << ", " << image_height << "]"
+              << ",\n  \"repetitions\": " << repetitions
+              << ",\n  \"scenes\": [";
+    bool first = true;
+    for (const std::string& name : names) {
+        bench_scene scene;
+        if (!load_scene(name, resources, scene, missing)) continue;
+
+        // Build time covers every BVH the scene needs, the instances' BLASes too
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<BVHAggregate>> blases;
+        for (auto& placed : scene.instanced) {
+            blases.push_back(make_mesh_bvh(placed.first, scene.world.materials, 4, width));
+            for (const transform& t : placed.second) scene.world.add(make_shared<instance>(blases.back(), t));
+        }
+        BVHAggregate bvh(scene.world, 4, 0, width);
+        double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<ray> primary_rays = camera_rays(scene, bvh.bounds(), image_width, image_height);
+        std::vector<hit_record> primary_hits;
+        batch_result primary = trace(bvh, primary_rays, repetitions, &primary_hits);
+
+        // One cosine weighted bounce off every primary hit
+        seed_random(7);
+        std::vector<ray> secondary_rays;
+        secondary_rays.reserve(primary_hits.size());
+        for (const hit_record& rec : primary_hits) {
+            vec3h direction = rec.normal + random_unit_vector();
+            if (direction.near_zero()) direction = rec.normal;
+            direction.w = 0;
+            secondary_rays.push_back(ray(rec.p, direction));
+        }
+        batch_result secondary = trace(bvh, secondary_rays, repetitions);
+
+        size_t primitives = scene.world.triangles.size() + scene.world.spheres.size() + scene.world.objects.size();
+        std::cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "\""
+                  << ", \"primitives\": " << primitives
+                  << ", \"build_seconds\": " << build_seconds
+                  << ", \"bvh_mb\": " << bvh.memory_bytes() / (1024.0 * 1024.0)
+                  << ", \"peak_rss_mb\": " << peak_rss_mb() << ",\n";
+        print_batch("primary", primary);
+        std::cout << ",\n";
+        print_batch("secondary", secondary);
+        if (render_samples > 0) {
+            start = std::chrono::steady_clock::now();
+            film image = render_scene(scene, bvh, image_width, image_height, render_samples);
+            double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (!save_dir.empty()) image.write(save_dir + "/" + name + ".pfm");
+            film reference;
+            bool compared = !reference_dir.empty() && reference.read(reference_dir + "/" + name + ".pfm") &&
+                            reference.width == image.width && reference.height == image.height;
+            std::cout << ",\n      \"render\": {\"samples_per_pixel\": " << render_samples
+                      << ", \"seconds\": " << render_seconds << ", \"rmse_vs_reference\": ";
+            if (compared) std::cout << rmse(image, reference);
+            else std::cout << "null";
+            std::cout << "}";
+        }
+        std::cout << "}";
+        first = false;
+    }
+    std::cout << "\n  ],\n  \"missing\": [";
+    for (size_t i = 0; i < missing.size(); i++) std::cout << (i ? ", " : "") << "\"" << missing[i] << "\"";
+    std::cout << "],\n  \"peak_rss_mb\": " << peak_rss_mb() << "\n}\n";
+    return 0;
+}
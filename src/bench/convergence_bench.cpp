@@ -0,0 +1,206 @@
+/*
+Image error against sample count. A small scene with a diffuse ground and sphere, a glass
+sphere and a spherical light is rendered once at a high sample count as the reference, then
+at increasing budgets with uniform sampling and with adaptive sampling, and each render's
+RMSE against the reference is printed. Every row is averaged over a few seeds, a single
+render's error is noisy itself.
+
+For each adaptive budget the uniform sample count reaching the same RMSE is interpolated
+from the uniform rows (RMSE falls as a power of spp, so on log-log axes) and reported with
+the fraction of samples adaptive sampling saved at equal RMSE.
+
+--diffuse swaps how the diffuse surfaces pick directions in the measured renders, the
+reference always uses cosine sampling with light sampling. uniform samples the hemisphere
+evenly and weights by cos / pdf, unbiased but noisier. legacy is the direction the renderer
+used before BSDFs reported PDFs, the normal plus a random hemisphere vector weighted as if it
+were cosine distributed, so its error stops falling at its bias. --no-light-sampling leaves
+BSDF sampling to find the light alone, which is where the diffuse strategy matters most.
+
+    convergence_bench [--image W H] [--reference-spp N] [--seeds N] [--threshold T]
+                      [--sampler independent|stratified|sobol|rank1] [--threads N]
+                      [--diffuse cosine|uniform|legacy] [--no-light-sampling]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/utils.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/primitive_shapes/sphere.h"
+#include "../include/acceleration/bvh_aggregate.h"
+#include "../include/camera.h"
+#include "../include/materials/scattering.h"
+
+enum diffuse_strategy { DIFFUSE_COSINE, DIFFUSE_UNIFORM, DIFFUSE_LEGACY };
+
+class compared_diffuse : public bxdf {
+    // Lambertian that samples directions with one of the strategies above
+public:
+    compared_diffuse(const color& albedo, diffuse_strategy strategy) : albedo(albedo), strategy(strategy) {}
+
+    bool sample(const ray& r_in, const hit_record& rec, double u_lobe, double u1, double u2, bxdf_sample& s) const override {
+        double z = u1, r = std::sqrt(std::max(0.0, 1 - z * z)), phi = 2 * pi * u2;
+        vec3h even = local_to_world(rec.normal, vec3h(r * std::cos(phi), r * std::sin(phi), z, 0));
+        s.f = albedo / pi;
+        s.specular = false;
+        if (strategy == DIFFUSE_UNIFORM) {
+            s.direction = even;
+            s.pdf = 1 / (2 * pi);
+        } else {
+            s.direction = strategy == DIFFUSE_LEGACY ? (rec.normal + even).normal_of() : local_to_world(rec.normal, sample_cosine_hemisphere(u1, u2));
+            s.pdf = std::max<double>(dot(s.direction, rec.normal), 0.0) / pi;
+        }
+        return s.pdf > 0;
+    }
+
+    color f(const ray& r_in, const hit_record& rec, const vec3h& direction) const override {
+        return dot(direction, rec.normal) <= 0 ? color(0, 0, 0) : albedo / pi;
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3h& direction) const override {
+        // The legacy strategy has no closed form density, it claims the cosine one as it always did
+        double cos_theta = std::max<double>(dot(direction.normal_of(), rec.normal), 0.0);
+        return strategy == DIFFUSE_UNIFORM ? (cos_theta > 0 ? 1 / (2 * pi) : 0) : cos_theta / pi;
+    }
+
+private:
+    color albedo;
+    diffuse_strategy strategy;
+};
+
+struct convergence_row {
+    int spp;
+    double rmse;
+    double samples_per_pixel;  // Actually taken, adaptive can stop below its budget
+    double seconds;
+};
+
+double uniform_spp_at(const std::vector<convergence_row>& uniform, double target) {
+    // Interpolates log spp against log RMSE between the uniform rows around target, 0 outside them
+    for (size_t k = 1; k < uniform.size(); k++) {
+        double e0 = uniform[k - 1].rmse, e1 = uniform[k].rmse;
+        if ((e0 - target) * (e1 - target) > 0) continue;
+        if (e0 == e1) return uniform[k - 1].spp;
+        double f = (std::log(target) - std::log(e0)) / (std::log(e1) - std::log(e0));
+        return std::exp(std::log(double(uniform[k - 1].spp)) + f * (std::log(double(uniform[k].spp)) - std::log(double(uniform[k - 1].spp))));
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int image_width = 64, image_height = 64;
+    int reference_spp = 4096;
+    int seeds = 4;
+    double threshold = 0.02;
+    int threads = 0;
+    sampler_type pattern = SAMPLER_SOBOL;
+    diffuse_strategy diffuse = DIFFUSE_COSINE;
+    bool light_sampling = true;
+    for (int a = 1; a < argc; a++) {
+        if (!std::strcmp(argv[a], "--image") && a + 2 < argc) {
+            image_width = std::max(1, std::atoi(argv[++a]));
+            image_height = std::max(1, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--reference-spp") && a + 1 < argc) {
+            reference_spp = std::max(1, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--seeds") && a + 1 < argc) {
+            seeds = std::max(1, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--threshold") && a + 1 < argc) {
+            threshold = std::atof(argv[++a]);
+        } else if (!std::strcmp(argv[a], "--threads") && a + 1 < argc) {
+            threads = std::max(0, std::atoi(argv[++a]));
+        } else if (!std::strcmp(argv[a], "--sampler") && a + 1 < argc) {
+            std::string name = argv[++a];
+            pattern = name == "independent" ? SAMPLER_INDEPENDENT : name == "stratified" ? SAMPLER_STRATIFIED
+                    : name == "rank1" ? SAMPLER_RANK1 : SAMPLER_SOBOL;
+        } else if (!std::strcmp(argv[a], "--diffuse") && a + 1 < argc) {
+            std::string name = argv[++a];
+            diffuse = name == "uniform" ? DIFFUSE_UNIFORM : name == "legacy" ? DIFFUSE_LEGACY : DIFFUSE_COSINE;
+        } else if (!std::strcmp(argv[a], "--no-light-sampling")) {
+            light_sampling = false;
+        }
+    }
+
+    auto make_scene = [](hittable_list& world, diffuse_strategy strategy) {
+        world.add(sphere(vec3h(0, -1000, 0, 1), 1000, world.materials->add(make_shared<compared_diffuse>(color(0.5, 0.5, 0.5, 0), strategy))));
+        world.add(sphere(vec3h(-0.6, 0.4, -2, 1), 0.4, world.materials->add(make_shared<compared_diffuse>(color(0.7, 0.3, 0.2, 0), strategy))));
+        world.add(sphere(vec3h(0.5, 0.4, -2, 1), 0.4, world.materials->add(make_shared<refractive>(color(1, 1, 1, 0), 1.5))));
+        world.add(sphere(vec3h(0, 3, -1.5, 1), 1, world.materials->add(make_shared<diffuse_light>(color(3, 3, 3, 0)))));
+    };
+    hittable_list reference_world, world;
+    make_scene(reference_world, DIFFUSE_COSINE);
+    make_scene(world, diffuse);
+    BVHAggregate reference_bvh(reference_world, 1), bvh(world, 1);
+
+    auto render = [&](int spp, double adaptive_threshold, uint64_t seed, double& samples_per_pixel, bool reference) {
+        camera cam;
+        cam.image_width = image_width;
+        cam.aspect_ratio = double(image_width) / image_height;
+        cam.aa_samples_per_px = spp;
+        cam.ray_bounces = 5;
+        cam.center = vec3h(0, 0.8, 0, 1);
+        cam.lookat = vec3h(0, 0.4, -2, 1);
+        cam.fov = 60;
+        cam.background = color(0.1, 0.1, 0.15, 0);
+        cam.num_threads = threads;
+        cam.seed = seed;
+        cam.sample_pattern = pattern;
+        cam.adaptive_threshold = adaptive_threshold;
+        cam.adaptive_min_samples = std::min(8, spp);
+        cam.sample_lights = reference || light_sampling;
+        film image = reference ? cam.render_image(reference_world, reference_bvh) : cam.render_image(world, bvh);
+        samples_per_pixel = double(cam.total_samples) / (image_width * image_height);
+        return image;
+    };
+    auto measure = [&](int spp, double adaptive_threshold, const film& reference) {
+        convergence_row row{spp, 0, 0, 0};
+        for (int s = 1; s <= seeds; s++) {
+            double taken;
+            auto start = std::chrono::steady_clock::now();
+            film image = render(spp, adaptive_threshold, s, taken, false);
+            row.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / seeds;
+            row.rmse += rmse(image, reference) / seeds;
+            row.samples_per_pixel += taken / seeds;
+        }
+        return row;
+    };
+
+    double unused;
+    film reference = render(reference_spp, 0, 1000, unused, true);
+    const int budgets[] = {8, 16, 32, 64, 128, 256};
+    std::vector<convergence_row> uniform, adaptive;
+    for (int spp : budgets) uniform.push_back(measure(spp, 0, reference));
+    for (int spp : budgets) adaptive.push_back(measure(spp, threshold, reference));
+
+    const char* diffuse_names[] = {"cosine", "uniform", "legacy"};
+    std::cout << "image: " << image_width << "x" << image_height << ", reference: " << reference_spp
+              << " spp, seeds per row: " << seeds << ", adaptive threshold: " << threshold
+              << ", diffuse: " << diffuse_names[diffuse] << ", light sampling: " << (light_sampling ? "on" : "off") << "\n\n";
+    std::cout << std::left << std::setw(10) << "mode" << std::right << std::setw(8) << "spp" << std::setw(12) << "taken"
+              << std::setw(12) << "rmse" << std::setw(10) << "seconds" << std::setw(16) << "uniform equal" << std::setw(8) << "saved" << "\n";
+    std::cout << std::fixed;
+    for (const convergence_row& row : uniform) {
+        std::cout << std::left << std::setw(10) << "uniform" << std::right << std::setw(8) << row.spp << std::setprecision(1)
+                  << std::setw(12) << row.samples_per_pixel << std::setprecision(5)
+                  << std::setw(12) << row.rmse << std::setprecision(3) << std::setw(10) << row.seconds << "\n";
+    }
+    for (const convergence_row& row : adaptive) {
+        double equal = uniform_spp_at(uniform, row.rmse);
+        double taken = row.samples_per_pixel;
+        std::cout << std::left << std::setw(10) << "adaptive" << std::right << std::setw(8) << row.spp << std::setprecision(1)
+                  << std::setw(12) << taken << std::setprecision(5) << std::setw(12) << row.rmse << std::setprecision(3)
+                  << std::setw(10) << row.seconds;
+        if (equal > 0) {
+            std::cout << std::setprecision(1) << std::setw(16) << equal << std::setw(7) << 100 * (1 - taken / equal) << "%";
+        } else {
+            std::cout << std::setw(16) << "-" << std::setw(8) << "-";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
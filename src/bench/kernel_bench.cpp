@@ -0,0 +1,230 @@
+/*
+Microbenchmark of the inner loop kernels on their own: Bounds3f::intersect, the single
+precision CompactBounds test traversal uses, sphere::distance and sphere::intersect, and
+triangle::distance (the scalar watertight test). Each kernel runs over the same pre generated
+batches of rays against a small pool of primitives that stays in cache, so the time is the
+kernel's and not the memory system's.
+
+Two ray batches are used. Random rays start anywhere on a sphere around the primitives and
+point at a random spot among them, each ray testing its own random window of primitives.
+Coherent rays leave one point through a grid of neighbouring directions, like primary camera
+rays, and runs of neighbouring rays test the same window.
+
+Every kernel and batch gets warmup runs, then timed repetitions reported as the median,
+standard deviation and minimum ns per test. The process is pinned to one CPU where the
+platform allows it.
+
+    kernel_bench [--rays N] [--reps N] [--warmup N] [--cpu N]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../include/utils.h"
+#include "../include/primitive_shapes/primitive_store.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+bool pin_to_cpu(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+struct ray_batch {
+    const char* name;
+    std::vector<ray> rays;
+    std::vector<int> windows;  // First primitive each ray tests
+};
+
+struct kernel_result {
+    double median, stddev, min;  // ns per test
+    double hit_rate;
+};
+
+constexpr int pool_size = 1024;   // Primitives of each kind, small enough to stay in L1/L2
+constexpr int window_size = 16;   // Primitives each ray is tested against
+
+vec3h random_point(pcg32& r, double extent) {
+    return vec3h((r.uniform() * 2 - 1) * extent, (r.uniform() * 2 - 1) * extent, (r.uniform() * 2 - 1) * extent, 1);
+}
+
+ray_batch random_rays(pcg32& r, int count) {
+    ray_batch batch{"random", {}, {}};
+    for (int i = 0; i < count; i++) {
+        vec3h on_sphere = random_point(r, 1);
+        while (on_sphere.x * on_sphere.x + on_sphere.y * on_sphere.y + on_sphere.z * on_sphere.z > 1) on_sphere = random_point(r, 1);
+        vec3h origin = 3 * vec3h(on_sphere.x, on_sphere.y, on_sphere.z, 0).normal_of();
+        origin.w = 1;
+        batch.rays.push_back(ray(origin, random_point(r, 1) - origin));
+        batch.windows.push_back(static_cast<int>(r.next_uint() % (pool_size - window_size)));
+    }
+    return batch;
+}
+
+ray_batch coherent_rays(pcg32& r, int count) {
+    // Row major over a square grid of directions, a window shared by each run of 64 rays
+    ray_batch batch{"coherent", {}, {}};
+    int side = std::max(1, static_cast<int>(std::sqrt(double(count))));
+    vec3h origin(0, 0, -4, 1);
+    int window = 0;
+    for (int i = 0; i < count; i++) {
+        if (i % 64 == 0) window = static_cast<int>(r.next_uint() % (pool_size - window_size));
+        double u = ((i % side) + 0.5) / side * 2 - 1;
+        double v = ((i / side) % side + 0.5) / side * 2 - 1;
+        batch.rays.push_back(ray(origin, vec3h(u, v, 0, 1) - origin));
+        batch.windows.push_back(window);
+    }
+    return batch;
+}
+
+kernel_result run_kernel(const ray_batch& batch, int warmup, int repetitions, const std::function<long(const ray&, int)>& test) {
+    /*
+    test runs one ray against its window and returns how many primitives it hit. The call
+    through std::function costs the same for every kernel, so it shifts all of them alike.
+    */
+    double tests = double(batch.rays.size()) * window_size;
+    long hits = 0;
+    std::vector<double> samples;
+    for (int rep = 0; rep < warmup + repetitions; rep++) {
+        long run_hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch.rays.size(); i++) run_hits += test(batch.rays[i], batch.windows[i]);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (rep >= warmup) samples.push_back(seconds * 1e9 / tests);
+        hits = run_hits;
+    }
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    double median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    double mean = 0;
+    for (double s : samples) mean += s / n;
+    double variance = 0;
+    for (double s : samples) variance += (s - mean) * (s - mean);
+    double stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+    return kernel_result{median, stddev, sorted.front(), hits / tests};
+}
+
+int main(int argc, char** argv) {
+    int num_rays = 1 << 16;
+    int repetitions = 15;
+    int warmup = 3;
+    int cpu = 0;
+    for (int a = 1; a < argc; a++) {
+        if (!std::strcmp(argv[a], "--rays") && a + 1 < argc) num_rays = std::max(1, std::atoi(argv[++a]));
+        else if (!std::strcmp(argv[a], "--reps") && a + 1 < argc) repetitions = std::max(1, std::atoi(argv[++a]));
+        else if (!std::strcmp(argv[a], "--warmup") && a + 1 < argc) warmup = std::max(0, std::atoi(argv[++a]));
+        else if (!std::strcmp(argv[a], "--cpu") && a + 1 < argc) cpu = std::atoi(argv[++a]);
+    }
+    bool pinned = pin_to_cpu(cpu);
+
+    pcg32 r(1);
+    std::vector<Bounds3f> boxes;
+    std::vector<CompactBounds> compact_boxes;
+    std::vector<sphere> spheres;
+    std::vector<vec3h> vertices;
+    std::vector<int> indices;
+    for (int i = 0; i < pool_size; i++) {
+        vec3h center = random_point(r, 1);
+        vec3h half(0.05 + 0.2 * r.uniform(), 0.05 + 0.2 * r.uniform(), 0.05 + 0.2 * r.uniform(), 0);
+        boxes.push_back(Bounds3f(center - half, center + half));
+        compact_boxes.push_back(CompactBounds(boxes.back()));
+        spheres.push_back(sphere(center, 0.05 + 0.2 * r.uniform()));
+        for (int k = 0; k < 3; k++) {
+            indices.push_back(static_cast<int>(vertices.size()));
+            vertices.push_back(center + 0.3 * vec3h(r.uniform() - 0.5, r.uniform() - 0.5, r.uniform() - 0.5, 0));
+        }
+    }
+    triangleMesh mesh(vertices, indices, pool_size);
+
+    std::vector<ray_batch> batches = {random_rays(r, num_rays), coherent_rays(r, num_rays)};
+
+    const interval range(0.001, infinity);
+    struct kernel {
+        const char* name;
+        std::function<long(const ray&, int)> test;
+    };
+    // Hit distances are summed into sink so the compiler can't drop the distance work
+    double sink = 0;
+    std::vector<kernel> kernels = {
+        {"box", [&](const ray& ray_in, int first) {
+            long hits = 0;
+            for (int k = first; k < first + window_size; k++) hits += boxes[k].intersect(ray_in, range);
+            return hits;
+        }},
+        {"box_compact", [&](const ray& ray_in, int first) {
+            // ray_float is set up once per ray and reused for every box, as in traversal
+            const ray_float rf(ray_in);
+            long hits = 0;
+            for (int k = first; k < first + window_size; k++) hits += compact_boxes[k].intersect(rf, 0.001f, infinity);
+            return hits;
+        }},
+        {"sphere_distance", [&](const ray& ray_in, int first) {
+            long hits = 0;
+            double t;
+            for (int k = first; k < first + window_size; k++) {
+                if (spheres[k].distance(ray_in, range, t)) {
+                    hits++;
+                    sink += t;
+                }
+            }
+            return hits;
+        }},
+        {"sphere_intersect", [&](const ray& ray_in, int first) {
+            long hits = 0;
+            hit_record rec;
+            for (int k = first; k < first + window_size; k++) {
+                if (spheres[k].intersect(ray_in, range, rec)) {
+                    hits++;
+                    sink += rec.t;
+                }
+            }
+            return hits;
+        }},
+        {"triangle_distance", [&](const ray& ray_in, int first) {
+            long hits = 0;
+            double t;
+            for (int k = first; k < first + window_size; k++) {
+                if (triangle::distance(mesh, k, ray_in, range, t)) {
+                    hits++;
+                    sink += t;
+                }
+            }
+            return hits;
+        }},
+    };
+
+    std::cout << "rays per batch: " << num_rays << ", primitives per ray: " << window_size
+              << ", warmup: " << warmup << ", repetitions: " << repetitions
+              << ", pinned to cpu " << cpu << ": " << (pinned ? "yes" : "no")
+              << ", precision: " << (sizeof(Float) == sizeof(float) ? "float" : "double") << "\n\n";
+    std::cout << std::left << std::setw(20) << "kernel" << std::setw(10) << "rays"
+              << std::right << std::setw(12) << "median ns" << std::setw(10) << "stddev"
+              << std::setw(10) << "min ns" << std::setw(10) << "hit rate" << "\n";
+    std::cout << std::fixed;
+    for (const kernel& k : kernels) {
+        for (const ray_batch& batch : batches) {
+            kernel_result result = run_kernel(batch, warmup, repetitions, k.test);
+            std::cout << std::left << std::setw(20) << k.name << std::setw(10) << batch.name << std::right
+                      << std::setprecision(3) << std::setw(12) << result.median << std::setw(10) << result.stddev
+                      << std::setw(10) << result.min << std::setw(10) << result.hit_rate << "\n";
+        }
+    }
+    return sink < 0 ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+Microbenchmark of the leaf triangle test. The same rays are run against the same leaves of
+four triangles, once through primitive_store::intersect per triangle (scalar watertight test
+with index lookups, what leaves did before triangle blocks) and once through
+intersect_triangle_block.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../include/utils.h"
+#include "../include/primitive_shapes/primitive_store.h"
+#include "../include/primitive_shapes/triangle_block.h"
+
+int main() {
+    const int num_triangles = 4096;
+    const int num_rays = 4096;
+    const int leaves_per_ray = 64;
+    const int repetitions = 5;
+
+    pcg32 r(1);
+    std::vector<vec3h> vertices;
+    std::vector<int> indices;
+    for (int i = 0; i < num_triangles; i++) {
+        vec3h corner(r.uniform() * 2 - 1, r.uniform() * 2 - 1, r.uniform() * 2 - 1, 1);
+        for (int k = 0; k < 3; k++) {
+            indices.push_back(static_cast<int>(vertices.size()));
+            vertices.push_back(corner + vec3h(r.uniform() - 0.5, r.uniform() - 0.5, r.uniform() - 0.5, 0));
+        }
+    }
+    triangleMesh mesh(vertices, indices, num_triangles);
+    primitive_store store;
+    store.add(&mesh);
+
+    int num_leaves = num_triangles / triangle_block_width;
+    std::vector<triangle_block> blocks(num_leaves);
+    for (int i = 0; i < num_triangles; i++) {
+        blocks[i / triangle_block_width].add(mesh, i, store.ref(i));
+    }
+
+    std::vector<ray> rays;
+    std::vector<int> visits;
+    for (int i = 0; i < num_rays; i++) {
+        vec3h origin(r.uniform() * 4 - 2, r.uniform() * 4 - 2, -3, 1);
+        vec3h target(r.uniform() * 2 - 1, r.uniform() * 2 - 1, r.uniform() * 2 - 1, 1);
+        rays.push_back(ray(origin, target - origin));
+        for (int k = 0; k < leaves_per_ray; k++) visits.push_back(static_cast<int>(r.next_uint() % num_leaves));
+    }
+
+    auto time_it = [&](auto&& run) {
+        double best = infinity;
+        long hits = 0;
+        for (int rep = 0; rep < repetitions; rep++) {
+            auto start = std::chrono::steady_clock::now();
+            hits = run();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return std::make_pair(best, hits);
+    };
+
+    auto scalar = time_it([&] {
+        long hits = 0;
+        hit_record rec;
+        for (int i = 0; i < num_rays; i++) {
+            double closest = infinity;
+            for (int k = 0; k < leaves_per_ray; k++) {
+                int first = visits[i * leaves_per_ray + k] * triangle_block_width;
+                for (int j = first; j < first + triangle_block_width; j++) {
+                    if (store.intersect(store.ref(j), rays[i], interval(0.001, closest), rec)) {
+                        closest = rec.t;
+                        hits++;
+                    }
+                }
+            }
+        }
+        return hits;
+    });
+
+    auto blocked = time_it([&] {
+        long hits = 0;
+        hit_record rec;
+        for (int i = 0; i < num_rays; i++) {
+            double closest = infinity;
+            triangle_ray tr(rays[i]);
+            for (int k = 0; k < leaves_per_ray; k++) {
+                const triangle_block& block = blocks[visits[i * leaves_per_ray + k]];
+                double t_hit[triangle_block_width];
+                int mask = intersect_triangle_block(block, tr, 0.001, closest, t_hit);
+                // Take hits in lane order so the count matches the scalar loop
+                for (int lane = 0; lane < triangle_block_width; lane++) {
+                    if ((mask & (1 << lane)) && t_hit[lane] <= closest) {
+                        closest = t_hit[lane];
+                        store.fill_hit(block.refs[lane], rays[i], closest, rec);
+                        hits++;
+                    }
+                }
+            }
+        }
+        return hits;
+    });
+
+    double tests = double(num_rays) * leaves_per_ray * triangle_block_width;
+#if defined(RT_SIMD_AVX)
+    const char* path = "AVX";
+#elif defined(RT_SIMD_SSE)
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    std::cout << "ray-triangle tests per run: " << tests << " (block kernel: " << path << ")\n";
+    std::cout << "scalar leaves:   " << scalar.first * 1e9 / tests << " ns/test, " << scalar.second << " hits\n";
+    std::cout << "triangle blocks: " << blocked.first * 1e9 / tests << " ns/test, " << blocked.second << " hits\n";
+    std::cout << "speedup: " << scalar.first / blocked.first << "x\n";
+    return scalar.second == blocked.second ? 0 : 1;
+}
@@ -1,68 +1,623 @@
 #ifndef BVH_AGGREGATE_H
 #define BVH_AGGREGATE_H
 
+#include <cassert>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <memory>  // For std::shared_ptr
 #include "../utils.h"
+#include "../parallel/thread_pool.h"
+#include "../primitive_shapes/primitive_store.h"
+#include "../primitive_shapes/triangle_block.h"
 #include "bvh_util.h"
+#include "bvh_wide.h"
 
 class BVHAggregate {
 private:
     int max_prims_in_node;
-    std::unique_ptr<BVHTreeNode> head;
+    std::vector<LinearBVHNode> nodes;                  // Depth first flattening of the build tree
+    std::shared_ptr<const primitive_store> owned_store; // Set when built from a plain object list
+    const primitive_store* store = nullptr;            // Where primitive_refs point
+    std::vector<primitive_ref> primitives;             // Leaf primitives in node order
+
+    std::vector<BVHLeaf> leaves;                       // One per leaf node, in node order
+    std::vector<triangle_block> triangle_blocks;
+    BVHWidth width;
+    std::vector<WideBVHNode<4>> bvh4_nodes;            // Filled when built with BVH4
+    std::vector<WideBVHNode<8>> bvh8_nodes;            // Filled when built with BVH8
+    double build_seconds = 0;
+
+    // Ranges above these sizes are binned in parallel chunks / built as separate tasks
+    static constexpr int parallel_bin_threshold = 16384;
+    static constexpr int parallel_task_threshold = 4096;
+    static constexpr int num_buckets = 12;
+    static constexpr double shadow_epsilon = 0.001;  // Same offset the camera uses against self hits
+    // Deepest tree the fixed traversal stacks hold. From sah_depth_limit down the builder only
+    // makes median splits, which halve the range, so no build can go deeper than this
+    static constexpr int max_depth = 64;
+    static constexpr int sah_depth_limit = max_depth - 32;
+    int depth = 0;  // Levels in the built tree, a leaf root is 1
+    using BVHBucketSet = std::array<BVHBucket, num_buckets>;
+
+    struct BVHBuildState {
+        const primitive_store& store;
+        std::vector<primitive_ref> refs;
+        std::vector<Bounds3f> bounds;    // Per primitive, computed once up front
+        std::vector<vec3h> centroids;
+        std::vector<int> order;          // Primitive indices, partitioned in place
+        thread_pool& pool;
+    };
+
+    int flatten(const BVHTreeNode* node, int level = 1) {
+        /* Appends node and its subtree to nodes depth first, returns node's index */
+        depth = std::max(depth, level);
+        assert(depth <= max_depth);
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        nodes[index].bounds = CompactBounds(node->bounds);
+        if (node->isLeaf()) {
+            nodes[index].leaf = static_cast<int>(leaves.size());
+            nodes[index].n_prims = static_cast<uint16_t>(node->prims.size());
+            BVHLeaf leaf;
+            leaf.primitives_offset = static_cast<int>(primitives.size());
+            for (const BVHPrimitive& prim : node->prims) {
+                primitives.push_back(prim.ref);
+            }
+            pack_leaf_triangles(leaf, nodes[index].n_prims);
+            leaves.push_back(leaf);
+        } else {
+            nodes[index].axis = static_cast<uint8_t>(node->split_axis);
+            flatten(node->left.get(), level + 1);
+            nodes[index].second_child_offset = flatten(node->right.get(), level + 1);
+        }
+        return index;
+    }
+
+    void pack_leaf_triangles(BVHLeaf& leaf, int count) {
+        /* Moves the leaf's triangles to the front of its range and copies them into blocks */
+        auto first = primitives.begin() + leaf.primitives_offset;
+        auto tris_end = std::stable_partition(first, first + count, [](primitive_ref ref) {
+            return ref_kind(ref) == PRIM_TRIANGLE;
+        });
+        leaf.first_block = static_cast<int>(triangle_blocks.size());
+        leaf.triangle_count = static_cast<int>(tris_end - first);
+        for (int i = 0; i < leaf.triangle_count; ++i) {
+            if (i % triangle_block_width == 0) triangle_blocks.emplace_back();
+            primitive_ref ref = primitives[leaf.primitives_offset + i];
+            triangle_blocks.back().add(store->mesh_of(ref), store->triangles[ref_index(ref)].index, ref);
+        }
+    }
+
+    bool intersect_leaf(int leaf_index, int count, const ray& r, const triangle_ray& tr, double t_min, double& closest_so_far,
+                        primitive_ref& closest, hit_record& rec, traversal_stats& stats) const {
+        /*
+        Closest hit among a leaf's primitives, shrinking closest_so_far to it and setting
+        closest to its ref. Triangles and spheres only find their distance here, finish_hit
+        fills in the record once traversal is done. Other objects fill rec as they're hit.
+        */
+        bool hit_anything = false;
+        const BVHLeaf& leaf = leaves[leaf_index];
+        int end_block = leaf.first_block + (leaf.triangle_count + triangle_block_width - 1) / triangle_block_width;
+        for (int b = leaf.first_block; b < end_block; ++b) {
+            const triangle_block& block = triangle_blocks[b];
+            stats.primitives += block.count;
+            double t_hit[triangle_block_width];
+            int mask = intersect_triangle_block(block, tr, t_min, closest_so_far, t_hit);
+            if (mask == 0) continue;
+            for (int m = mask; m != 0; m &= m - 1) stats.hits += 1;
+            int lane = -1;
+            for (int k = 0; k < triangle_block_width; ++k) {
+                if ((mask & (1 << k)) && (lane == -1 || t_hit[k] < t_hit[lane])) lane = k;
+            }
+            closest_so_far = t_hit[lane];
+            closest = block.refs[lane];
+            hit_anything = true;
+        }
+
+        hit_record temp_rec;
+        int offset = leaf.primitives_offset;
+        for (int i = offset + leaf.triangle_count; i < offset + count; ++i) {
+            primitive_ref ref = primitives[i];
+            const bool counted = store->counts_own_traversal(ref);
+            if (!counted) stats.primitives += 1;
+            if (ref_kind(ref) != PRIM_OBJECT) {
+                double t;
+                if (store->distance(ref, r, interval(t_min, closest_so_far), t)) {
+                    stats.hits += 1;
+                    hit_anything = true;
+                    closest_so_far = t;
+                    closest = ref;
+                }
+            } else if (store->intersect(ref, r, interval(t_min, closest_so_far), temp_rec, stats)) {
+                if (!counted) stats.hits += 1;
+                hit_anything = true;
+                closest_so_far = temp_rec.t;
+                closest = ref;
+                rec = temp_rec;
+            }
+        }
+        return hit_anything;
+    }
+
+    void finish_hit(primitive_ref closest, const ray& r, double t, hit_record& rec) const {
+        // Surface attributes of the closest hit, objects already filled theirs in
+        if (ref_kind(closest) != PRIM_OBJECT) store->fill_hit(closest, r, t, rec);
+        // This store's ref, replacing whatever an instance's own BVH recorded
+        rec.primitive = closest;
+    }
+
+    bool occluded_leaf(int leaf_index, int count, const ray& r, const triangle_ray& tr, interval ray_t, traversal_stats& stats) const {
+        const BVHLeaf& leaf = leaves[leaf_index];
+        int end_block = leaf.first_block + (leaf.triangle_count + triangle_block_width - 1) / triangle_block_width;
+        double t_hit[triangle_block_width];
+        for (int b = leaf.first_block; b < end_block; ++b) {
+            stats.primitives += triangle_blocks[b].count;
+            if (intersect_triangle_block(triangle_blocks[b], tr, ray_t.min, ray_t.max, t_hit)) {
+                stats.hits += 1;
+                return true;
+            }
+        }
+        int offset = leaf.primitives_offset;
+        for (int i = offset + leaf.triangle_count; i < offset + count; ++i) {
+            const bool counted = store->counts_own_traversal(primitives[i]);
+            if (!counted) stats.primitives += 1;
+            if (store->occluded(primitives[i], r, ray_t, stats)) {
+                if (!counted) stats.hits += 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int count_nodes(const BVHTreeNode* node) {
+        if (node == nullptr) return 0;
+        return 1 + count_nodes(node->left.get()) + count_nodes(node->right.get());
+    }
+
+    void build(int build_threads) {
+        /*
+        build_threads of 0 uses every core. Small scenes are always built on the calling
+        thread since spinning up workers would cost more than the build.
+        BVH4 and BVH8 collapse the binary tree into wide nodes that traversal then uses,
+        the flattened binary nodes are kept either way so both can be compared.
+        */
+        auto start_time = std::chrono::steady_clock::now();
+        if (!store->addressable()) {
+            // Indices past max_primitives_per_kind would alias other primitives, so nothing is built
+            std::cerr << "Scene has more primitives of one kind than a BVH can refer to (" << max_primitives_per_kind << "), BVH left empty\n";
+        } else if (store->size() != 0) {
+            int n = static_cast<int>(store->size());
+            thread_pool pool(n < parallel_task_threshold ? 1 : build_threads);
+            BVHBuildState state{*store, std::vector<primitive_ref>(n), std::vector<Bounds3f>(n), std::vector<vec3h>(n), std::vector<int>(n), pool};
+
+            // Meshes build their triangle caches here, once, rather than in whichever worker reads them first
+            for (const triangleMesh* mesh : store->meshes) {
+                if (mesh->num_triangles > 0) mesh->data(0);
+            }
+            int chunk = 1024;
+            pool.parallel_for((n + chunk - 1) / chunk, [&](int c) {
+                for (int i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) {
+                    state.refs[i] = store->ref(i);
+                    state.bounds[i] = store->bounds(state.refs[i]);
+                    state.centroids[i] = .5f * state.bounds[i].pmin + .5f * state.bounds[i].pmax;
+                }
+            });
+
+            // Degenerate triangles can never be hit, so they are left out of the tree
+            int kept = 0;
+            for (int i = 0; i < n; ++i) {
+                if (store->degenerate(state.refs[i])) continue;
+                state.refs[kept] = state.refs[i];
+                state.bounds[kept] = state.bounds[i];
+                state.centroids[kept] = state.centroids[i];
+                state.order[kept] = kept;
+                ++kept;
+            }
+            if (kept > 0) {
+                // The pointer tree is only needed to flatten, it is freed at the end of this scope
+                std::unique_ptr<BVHTreeNode> head = build_recursive(state, 0, kept);
+                nodes.reserve(count_nodes(head.get()));
+                flatten(head.get());
+                if (width == BVH4) collapse_bvh<4>(nodes, 0, bvh4_nodes);
+                if (width == BVH8) collapse_bvh<8>(nodes, 0, bvh8_nodes);
+            }
+        }
+        build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+
 public:
     BVHAggregate(); // Default constructor declaration
-    BVHAggregate(std::vector<std::shared_ptr<hittable>> objs, int max_prims) 
-    : max_prims_in_node(max_prims) {
-        //  collect prims and add them to list of BVH Primitives
-        std::vector<BVHPrimitive> bvhPrimitives(objs.size());
-        for (size_t i = 0; i < objs.size(); ++i) {
-            bvhPrimitives[i] = BVHPrimitive(i, (*objs[i]).bounds(), objs[i]); // pointer !!!!!!!!!
+    BVHAggregate(const std::vector<std::shared_ptr<hittable>>& objs, int max_prims, int build_threads = 0, BVHWidth width = BVH2)
+        : BVHAggregate(primitive_store(objs), max_prims, build_threads, width) {}
+
+    BVHAggregate(primitive_store&& prims, int max_prims, int build_threads = 0, BVHWidth width = BVH2)
+        : max_prims_in_node(max_prims), owned_store(std::make_shared<const primitive_store>(std::move(prims))), width(width) {
+        // Keeps the primitives alive for as long as the BVH, for BVHs that are passed around like instance BLASes
+        store = owned_store.get();
+        build(build_threads);
+    }
+
+    BVHAggregate(const primitive_store& prims, int max_prims, int build_threads = 0, BVHWidth width = BVH2)
+        : max_prims_in_node(max_prims), store(&prims), width(width) {
+        // prims (usually the scene's hittable_list) has to outlive the BVH
+        build(build_threads);
+    }
+
+    int get_depth() const {
+        return depth;
+    }
+
+    double get_build_seconds() const {
+        return build_seconds;
+    }
+
+    const std::vector<LinearBVHNode>& get_nodes() const {
+        return nodes;
+    }
+
+    const std::vector<primitive_ref>& get_primitives() const {
+        return primitives;
+    }
+
+    const std::vector<BVHLeaf>& get_leaves() const {
+        return leaves;
+    }
+
+    const primitive_store& get_store() const {
+        return *store;
+    }
+
+    size_t memory_bytes() const {
+        // Flattened nodes, wide nodes, leaf references and triangle blocks, not counting the primitives themselves
+        return nodes.capacity() * sizeof(LinearBVHNode)
+             + bvh4_nodes.capacity() * sizeof(WideBVHNode<4>)
+             + bvh8_nodes.capacity() * sizeof(WideBVHNode<8>)
+             + primitives.capacity() * sizeof(primitive_ref)
+             + leaves.capacity() * sizeof(BVHLeaf)
+             + triangle_blocks.capacity() * sizeof(triangle_block);
+    }
+
+    void print_memory_report(std::ostream& out) const {
+        const double mb = 1.0 / (1024 * 1024);
+        out << "BVH memory: " << primitives.size() << " primitives, "
+            << memory_bytes() * mb << " MB nodes and leaf refs, "
+            << store->memory_bytes() * mb << " MB primitive arrays (a shared_ptr per primitive would be "
+            << store->shared_ptr_memory_bytes() * mb << " MB)\n";
+    }
+
+    Bounds3f bounds() const {
+        // Bounds of everything in the BVH, empty if it holds nothing
+        return nodes.empty() ? Bounds3f() : nodes[0].bounds.to_bounds();
+    }
+
+    BVHWidth get_width() const {
+        return width;
+    }
+
+    const std::vector<WideBVHNode<4>>& get_bvh4_nodes() const {
+        return bvh4_nodes;
+    }
+
+    const std::vector<WideBVHNode<8>>& get_bvh8_nodes() const {
+        return bvh8_nodes;
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        if (width == BVH4) return intersect_wide(bvh4_nodes, r, ray_t, rec, stats);
+        if (width == BVH8) return intersect_wide(bvh8_nodes, r, ray_t, rec, stats);
+        return intersect_binary(r, ray_t, rec, stats);
+    }
+
+    bool occluded(const ray& r, double t_max, traversal_stats& stats) const {
+        /*
+        Any hit query for shadow and visibility rays. Stops at the first primitive found
+        in (shadow_epsilon, t_max) and never builds a hit record.
+        */
+        return occluded(r, interval(shadow_epsilon, t_max), stats);
+    }
+
+    bool occluded(const ray& r, interval ray_t, traversal_stats& stats) const {
+        if (width == BVH4) return occluded_wide(bvh4_nodes, r, ray_t, stats);
+        if (width == BVH8) return occluded_wide(bvh8_nodes, r, ray_t, stats);
+        return occluded_binary(r, ray_t, stats);
+    }
+
+    bool occluded(const ray& r, double t_max) const {
+        traversal_stats stats;
+        return occluded(r, t_max, stats);
+    }
+
+    bool occluded_binary(const ray& r, interval ray_t, traversal_stats& stats) const {
+        if (nodes.empty()) return false;
+        const triangle_ray tr(r);
+        const ray_float rf(r);
+        const float t_min = round_down(ray_t.min), t_max = round_up(ray_t.max);
+        int to_visit[max_depth];
+        int to_visit_size = 0;
+        int current = 0;
+        while (true) {
+            const LinearBVHNode& node = nodes[current];
+            stats.nodes += 1;
+            stats.box_tests += 1;
+            if (node.bounds.intersect(rf, t_min, t_max)) {
+                stats.box_hits += 1;
+                if (node.isLeaf()) {
+                    if (occluded_leaf(node.leaf, node.n_prims, r, tr, ray_t, stats)) return true;
+                } else {
+                    to_visit[to_visit_size++] = node.second_child_offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+            if (to_visit_size == 0) break;
+            current = to_visit[--to_visit_size];
         }
-        
-        // Move ownership of the result from sah_recursive to 'head'
-        if (objs.size() != 0) {
-            head = sah_recursive(bvhPrimitives);
+        return false;
+    }
+
+    template <int W>
+    bool occluded_wide(const std::vector<WideBVHNode<W>>& wide_nodes, const ray& r, interval ray_t, traversal_stats& stats) const {
+        if (wide_nodes.empty()) return false;
+        const triangle_ray tr(r);
+        const ray_float rf(r);
+        const float t_min = round_down(ray_t.min), t_max = round_up(ray_t.max);
+        int to_visit[8 * max_depth];
+        int to_visit_size = 0;
+        to_visit[to_visit_size++] = 0;
+        while (to_visit_size > 0) {
+            const WideBVHNode<W>& node = wide_nodes[to_visit[--to_visit_size]];
+            stats.nodes += 1;
+            stats.box_tests += W;
+            float t_near[W];
+            int mask = intersect_wide_bounds<W>(node, rf, t_min, t_max, t_near);
+            for (int k = 0; k < W; ++k) {
+                if (!(mask & (1 << k))) continue;
+                stats.box_hits += 1;
+                if (node.count[k] == 0) {
+                    to_visit[to_visit_size++] = node.child[k];
+                    continue;
+                }
+                // Leaves are tested right away, any hit ends the query
+                if (occluded_leaf(node.child[k], node.count[k], r, tr, ray_t, stats)) return true;
+            }
         }
+        return false;
     }
 
-    BVHTreeNode* get_head() const {
-        return head.get();
+    template <int W>
+    bool intersect_wide(const std::vector<WideBVHNode<W>>& wide_nodes, const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        /*
+        Closest hit traversal of a wide BVH. All children of a node are box tested together,
+        the ones hit are pushed far to near so the nearest is popped next, and entries whose
+        entry distance is already behind the closest hit are dropped when popped.
+        */
+        if (wide_nodes.empty()) return false;
+        struct entry {
+            int child;
+            int count;     // > 0 for a leaf, then child is its index into leaves
+            float t_near;
+        };
+        const triangle_ray tr(r);
+        const ray_float rf(r);
+        const float t_min = round_down(ray_t.min);
+        bool hit_anything = false;
+        double closest_so_far = ray_t.max;
+        primitive_ref closest = 0;
+
+        entry to_visit[8 * max_depth];
+        int to_visit_size = 0;
+        to_visit[to_visit_size++] = entry{0, 0, t_min};
+        while (to_visit_size > 0) {
+            entry current = to_visit[--to_visit_size];
+            if (current.t_near > closest_so_far * box_far_scale) continue;
+
+            if (current.count > 0) {
+                if (intersect_leaf(current.child, current.count, r, tr, ray_t.min, closest_so_far, closest, rec, stats)) hit_anything = true;
+                continue;
+            }
+
+            const WideBVHNode<W>& node = wide_nodes[current.child];
+            stats.nodes += 1;
+            stats.box_tests += W;
+            float t_near[W];
+            int mask = intersect_wide_bounds<W>(node, rf, t_min, round_up(closest_so_far), t_near);
+
+            // Insertion sort the children hit by decreasing distance, then push in that order
+            entry hits[W];
+            int num_hits = 0;
+            for (int k = 0; k < W; ++k) {
+                if (!(mask & (1 << k))) continue;
+                stats.box_hits += 1;
+                entry e{node.child[k], node.count[k], t_near[k]};
+                int j = num_hits++;
+                while (j > 0 && hits[j - 1].t_near < e.t_near) {
+                    hits[j] = hits[j - 1];
+                    --j;
+                }
+                hits[j] = e;
+            }
+            for (int k = 0; k < num_hits; ++k) {
+                to_visit[to_visit_size++] = hits[k];
+            }
+        }
+        if (hit_anything) finish_hit(closest, r, closest_so_far, rec);
+        return hit_anything;
     }
 
-    std::unique_ptr<BVHTreeNode> sah_recursive(std::vector<BVHPrimitive>& bvhPrimitives) {
+    bool intersect_binary(const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        /*
+        Closest hit traversal over the flattened nodes with an explicit stack,
+        stats counts the nodes, boxes and primitives tested and what they hit.
+        Children are visited front to back along the node's split axis and boxes are tested
+        against the closest hit so far, so subtrees behind a known hit get skipped.
+        */
+        if (nodes.empty()) return false;
+        const triangle_ray tr(r);
+        bool hit_anything = false;
+        double closest_so_far = ray_t.max;
+        primitive_ref closest = 0;
+        const bool dir_is_neg[3] = {!r.sign_x(), !r.sign_y(), !r.sign_z()};
+        const ray_float rf(r);
+        const float t_min = round_down(ray_t.min);
+
+        int to_visit[max_depth];
+        int to_visit_size = 0;
+        int current = 0;
+        while (true) {
+            const LinearBVHNode& node = nodes[current];
+            stats.nodes += 1;
+            stats.box_tests += 1;
+            if (node.bounds.intersect(rf, t_min, round_up(closest_so_far))) {
+                stats.box_hits += 1;
+                if (node.isLeaf()) {
+                    if (intersect_leaf(node.leaf, node.n_prims, r, tr, ray_t.min, closest_so_far, closest, rec, stats)) hit_anything = true;
+                } else if (dir_is_neg[node.axis]) {
+                    // Ray travels towards -axis, so the second child is the nearer one
+                    to_visit[to_visit_size++] = current + 1;
+                    current = node.second_child_offset;
+                    continue;
+                } else {
+                    to_visit[to_visit_size++] = node.second_child_offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+            if (to_visit_size == 0) break;
+            current = to_visit[--to_visit_size];
+        }
+        if (hit_anything) finish_hit(closest, r, closest_so_far, rec);
+        return hit_anything;
+    }
+
+    std::unique_ptr<BVHTreeNode> build_recursive(BVHBuildState& state, int start, int end, const Bounds3f* known_bounds = nullptr,
+                                                 int level = 1) {
+        /*
+        SAH build over state.order[start, end). Partitions the shared index array in place
+        rather than copying primitives into new vectors for every child. Large ranges bin in parallel chunks, and the left subtree of a
+        large range is built as its own task while this thread builds the right one.
+        Lopsided SAH splits can make a tree as deep as it has primitives, so from
+        sah_depth_limit on ranges are split at the median to keep within max_depth.
+        */
         std::unique_ptr<BVHTreeNode> root = std::make_unique<BVHTreeNode>();
+        int n = end - start;
+        int num_chunks = (n > parallel_bin_threshold) ? std::min(state.pool.size() * 4, n / (parallel_bin_threshold / 4)) : 1;
+        int chunk = (n + num_chunks - 1) / num_chunks;
 
-        // Compute root bounding box (bounding box containing all primitives)
+        // Compute root bounding box (bounding box containing all primitives), unless the parent
+        // already knows it from its buckets
         Bounds3f rootBoundingBox;
-        int i = 0;
-        for (const BVHPrimitive& prim : bvhPrimitives) {
-            rootBoundingBox = Union(rootBoundingBox, prim.bounds);
-        }
+        if (known_bounds) {
+            rootBoundingBox = *known_bounds;
+        } else {
+            std::vector<Bounds3f> chunk_bounds(num_chunks);
+            auto bound_chunk = [&](int c) {
+                Bounds3f b;
+                for (int i = start + c * chunk; i < std::min(end, start + (c + 1) * chunk); ++i) {
+                    b = Union(b, state.bounds[state.order[i]]);
+                }
+                chunk_bounds[c] = b;
+            };
+            if (num_chunks > 1) state.pool.parallel_for(num_chunks, bound_chunk);
+            else bound_chunk(0);
 
+            rootBoundingBox = chunk_bounds[0];
+            for (int c = 1; c < num_chunks; ++c) {
+                rootBoundingBox = Union(rootBoundingBox, chunk_bounds[c]);
+            }
+        }
         root->bounds = rootBoundingBox;
-        // Find largest axis to monitor
         int largest_axis = rootBoundingBox.max_dimen();
-
-        // Generate buckets
-        const int num_buckets = 12;
+        root->split_axis = largest_axis;
+        double axis_min = rootBoundingBox.pmin[largest_axis];
         double bucket_width = rootBoundingBox.axis_length(largest_axis) / num_buckets;
-        std::vector<BVHBucket> buckets(num_buckets);
 
-        // For each primitive, find which bucket it is in by it's centroid position
-        for (const BVHPrimitive& bvh_prim : bvhPrimitives) {
-            int bucket_number = static_cast<int>(std::floor((bvh_prim.Centroid()[largest_axis] - rootBoundingBox.pmin[largest_axis]) / bucket_width));
-            bucket_number = std::min(std::max(bucket_number, 0), num_buckets - 1);
-            buckets[bucket_number].num_prims += 1;
-            // Expand the bound's of the grouping in the bucket
-            buckets[bucket_number].bounds = Union(buckets[bucket_number].bounds, bvh_prim.bounds);
+        // Bin centroids into buckets, each chunk fills its own set which are merged after
+        std::vector<BVHBucketSet> chunk_buckets(num_chunks);
+        auto bin_chunk = [&](int c) {
+            BVHBucketSet& buckets = chunk_buckets[c];
+            for (int i = start + c * chunk; i < std::min(end, start + (c + 1) * chunk); ++i) {
+                int prim = state.order[i];
+                int bucket_number = static_cast<int>(std::floor((state.centroids[prim][largest_axis] - axis_min) / bucket_width));
+                bucket_number = std::min(std::max(bucket_number, 0), num_buckets - 1);
+                buckets[bucket_number].num_prims += 1;
+                buckets[bucket_number].bounds = Union(buckets[bucket_number].bounds, state.bounds[prim]);
+            }
+        };
+        if (num_chunks > 1) state.pool.parallel_for(num_chunks, bin_chunk);
+        else bin_chunk(0);
+
+        BVHBucketSet& buckets = chunk_buckets[0];
+        for (int c = 1; c < num_chunks; ++c) {
+            for (int b = 0; b < num_buckets; ++b) {
+                // Union of two empty bounds is infinite rather than empty, skip empty buckets
+                if (chunk_buckets[c][b].num_prims == 0) continue;
+                buckets[b].num_prims += chunk_buckets[c][b].num_prims;
+                buckets[b].bounds = Union(buckets[b].bounds, chunk_buckets[c][b].bounds);
+            }
+        }
+
+        int lowest_cost_split = -1;
+        double lowest_cost = lowest_split_cost(buckets, lowest_cost_split);
+
+        // Compare to leaf costs (just the num of primitives)
+        int leaf_cost = n;
+        lowest_cost = 1.f / 2.f + lowest_cost / rootBoundingBox.surface_area();
+        bool median_only = level >= sah_depth_limit;
+        if (leaf_cost <= max_prims_in_node && (leaf_cost <= lowest_cost || median_only)) {
+            for (int i = start; i < end; ++i) {
+                int prim = state.order[i];
+                root->prims.emplace_back(prim, state.bounds[prim], state.refs[prim]);
+            }
+            return root;
         }
 
+        // Partition the index range on the centroid's bucket along the largest axis
+        int* first = state.order.data() + start;
+        int* last = state.order.data() + end;
+        int* mid = std::partition(first, last, [&](int prim) {
+            int bucket = static_cast<int>(std::floor((state.centroids[prim][largest_axis] - axis_min) / bucket_width));
+            return bucket <= lowest_cost_split;
+        });
+
+        // A bucket split hands each child its bounds, the union of the buckets on its side
+        Bounds3f left_bounds, right_bounds;
+        const Bounds3f* left_known = &left_bounds;
+        const Bounds3f* right_known = &right_bounds;
+        if (median_only || lowest_cost_split == -1 || mid == first || mid == last) {
+            mid = first + n / 2;
+            std::nth_element(first, mid, last, [&](int a, int b) {
+                return state.centroids[a][largest_axis] < state.centroids[b][largest_axis];
+            });
+            left_known = right_known = nullptr;
+        } else {
+            for (int b = 0; b < num_buckets; ++b) {
+                if (buckets[b].num_prims == 0) continue;
+                Bounds3f& side = (b <= lowest_cost_split) ? left_bounds : right_bounds;
+                side = Union(side, buckets[b].bounds);
+            }
+        }
+        int split = static_cast<int>(mid - state.order.data());
+
+        if (n > parallel_task_threshold) {
+            task_group left_task;
+            state.pool.submit([&] { root->left = build_recursive(state, start, split, left_known, level + 1); }, left_task);
+            root->right = build_recursive(state, split, end, right_known, level + 1);
+            state.pool.wait(left_task);
+        } else {
+            root->left = build_recursive(state, start, split, left_known, level + 1);
+            root->right = build_recursive(state, split, end, right_known, level + 1);
+        }
+        return root;
+    }
+
+    static double lowest_split_cost(const BVHBucketSet& buckets, int& lowest_cost_split) {
+        /* SAH cost (unnormalized) of the cheapest split between buckets, -1 split if none is finite */
         double num_prims_left = 0;
         int num_splits = num_buckets - 1;
-        std::vector<double> costs(num_splits); // Initialize costs
+        std::array<double, num_buckets - 1> costs{};
 
         // Accumulate costs at each split from the left side
         Bounds3f boundBelow;
@@ -82,60 +637,15 @@ public:
         }
 
         // Find bucket with least cost
-        int lowest_cost_split = -1;
+        lowest_cost_split = -1;
         double lowest_cost = infinity;
-
         for (int i = 0; i < num_splits; ++i) {
             if (costs[i] < lowest_cost) {
                 lowest_cost = costs[i];
                 lowest_cost_split = i;
             }
-        }        
-
-        // Compare to leaf costs (just the num of primitives)
-        int leaf_cost = static_cast<int>(bvhPrimitives.size());
-        lowest_cost = 1.f / 2.f + lowest_cost / rootBoundingBox.surface_area();
-        if (leaf_cost <= lowest_cost && leaf_cost <= max_prims_in_node) {
-            // Turn into a leaf node
-            root->prims = bvhPrimitives;
-            return root;  // Return the unique_ptr directly
-        } else {
-            // Split primitives at the selected bucket
-            double bucket_width = (rootBoundingBox.pmax[largest_axis] - rootBoundingBox.pmin[largest_axis]) / num_buckets;
-
-            // Partition the primitives based on their centroid in the largest axis
-            auto midIter = std::partition(
-                bvhPrimitives.begin(), bvhPrimitives.end(),
-                [=](const BVHPrimitive& prim) {
-                    // Determine the bucket index based on the centroid's position
-                    int bucket = static_cast<int>(std::floor((prim.Centroid()[largest_axis] - rootBoundingBox.pmin[largest_axis]) / bucket_width));
-                    return bucket <= lowest_cost_split;  // Partition based on the split
-                })
-                ;
-            
-            std::vector<BVHPrimitive> leftPrims(bvhPrimitives.begin(), midIter);
-            std::vector<BVHPrimitive> rightPrims(midIter, bvhPrimitives.end());
-
-            if (lowest_cost_split == -1 || leftPrims.empty() || rightPrims.empty()) {
-                auto mid = bvhPrimitives.begin() + bvhPrimitives.size() / 2;
-                std::nth_element(bvhPrimitives.begin(), mid, bvhPrimitives.end(), 
-                    [largest_axis](const BVHPrimitive& a, const BVHPrimitive& b) {
-                        return a.Centroid()[largest_axis] < b.Centroid()[largest_axis];
-                    });
-                leftPrims.assign(bvhPrimitives.begin(), mid);
-                rightPrims.assign(mid, bvhPrimitives.end());
-            }
-            
-            // Allocate child nodes on right and left
-            if (leftPrims.size() > 0) {
-                root->left = sah_recursive(leftPrims);
-            }
-            if (rightPrims.size() > 0) {
-                root->right = sah_recursive(rightPrims);
-            }
         }
-
-        return root;
+        return lowest_cost;
     }
 };
 
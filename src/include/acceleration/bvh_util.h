@@ -1,17 +1,50 @@
 #ifndef BVH_UTIL_H
 #define BVH_UTIL_H
 
+#include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include "../geometry/bounds.h"
+#include "traversal_stats.h"
+
+/*
+BVH leaves refer to primitives by a 32 bit reference instead of a pointer to a heap object.
+The top two bits say which of primitive_store's arrays the primitive lives in, the other 30
+are its index in that array.
+*/
+using primitive_ref = uint32_t;
+
+enum primitive_kind : uint32_t {
+    PRIM_OBJECT = 0,    // Any other hittable, held by shared_ptr
+    PRIM_TRIANGLE = 1,  // A triangle of one of the store's meshes
+    PRIM_SPHERE = 2
+};
+
+constexpr int primitive_kind_shift = 30;
+constexpr uint32_t max_primitives_per_kind = 1u << primitive_kind_shift;
+constexpr uint32_t primitive_index_mask = max_primitives_per_kind - 1;
+
+inline primitive_ref make_primitive_ref(primitive_kind kind, uint32_t index) {
+    assert(index < max_primitives_per_kind);
+    return (static_cast<uint32_t>(kind) << primitive_kind_shift) | index;
+}
+
+inline primitive_kind ref_kind(primitive_ref ref) {
+    return static_cast<primitive_kind>(ref >> primitive_kind_shift);
+}
+
+inline uint32_t ref_index(primitive_ref ref) {
+    return ref & primitive_index_mask;
+}
 
 struct BVHPrimitive {
     BVHPrimitive() {}
-    BVHPrimitive(size_t primitiveIndex, const Bounds3f &bounds, shared_ptr<hittable> obj)
-        : primitiveIndex(primitiveIndex), bounds(bounds), object(obj) {}
+    BVHPrimitive(size_t primitiveIndex, const Bounds3f &bounds, primitive_ref ref)
+        : primitiveIndex(primitiveIndex), bounds(bounds), ref(ref) {}
     size_t primitiveIndex;
     Bounds3f bounds;
-    shared_ptr<hittable> object;
+    primitive_ref ref;
     // BVHPrimitive Public Methods
     vec3h Centroid() const { return .5f * bounds.pmin + .5f * bounds.pmax; }
 };
@@ -26,13 +59,15 @@ struct BVHTreeNode {
     std::unique_ptr<BVHTreeNode> right;
     Bounds3f bounds;
     std::vector<BVHPrimitive> prims;
+    int split_axis = 0;
 
     // Move constructor
     BVHTreeNode(BVHTreeNode&& other) noexcept
         : left(std::move(other.left)),
           right(std::move(other.right)),
           bounds(std::move(other.bounds)),
-          prims(std::move(other.prims)) {}
+          prims(std::move(other.prims)),
+          split_axis(other.split_axis) {}
 
     // Move assignment operator
     BVHTreeNode& operator=(BVHTreeNode&& other) noexcept {
@@ -41,6 +76,7 @@ struct BVHTreeNode {
             right = std::move(other.right);
             bounds = std::move(other.bounds);
             prims = std::move(other.prims);
+            split_axis = other.split_axis;
         }
         return *this;
     }
@@ -56,5 +92,33 @@ struct BVHTreeNode {
     }
 };
 
+struct BVHLeaf {
+    /*
+    Where a leaf's primitives are. Its triangles come first in its range of BVHAggregate's
+    primitive array and are also packed into triangle blocks starting at first_block.
+    */
+    int primitives_offset = 0;
+    int first_block = 0;
+    int triangle_count = 0;
+};
+
+struct LinearBVHNode {
+    /*
+    Fixed size node of the flattened BVH. Nodes are laid out depth first, so an interior
+    node's first child sits right after it and only the second child needs an offset.
+    With single precision bounds a node is 32 bytes, two to a cache line.
+    */
+    CompactBounds bounds;
+    union {
+        int leaf;                 // leaf: index into BVHAggregate's leaves
+        int second_child_offset;  // interior: index of the second child node
+    };
+    uint16_t n_prims = 0;         // 0 for interior nodes
+    uint8_t axis = 0;             // interior: axis the children were split along
+
+    bool isLeaf() const {
+        return n_prims > 0;
+    }
+};
 
 #endif
\ No newline at end of file
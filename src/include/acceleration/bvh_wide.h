@@ -0,0 +1,172 @@
+#ifndef BVH_WIDE_H
+#define BVH_WIDE_H
+/*
+Wide (4 or 8 way) BVH nodes collapsed from the binary SAH tree.
+Child bounds are stored structure of arrays, one array per slab plane, so a ray is tested
+against every child of a node with a handful of vector instructions instead of W scalar
+Bounds3f::intersect calls. The planes are single precision like CompactBounds, a BVH4 node's
+children fit one SSE register and a BVH8 node's one AVX register.
+*/
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "../geometry/bounds.h"
+#include "bvh_util.h"
+
+#if defined(RT_SIMD_SSE)
+#include <immintrin.h>
+#endif
+
+enum BVHWidth {
+    BVH2 = 2,
+    BVH4 = 4,
+    BVH8 = 8
+};
+
+template <int W>
+struct WideBVHNode {
+    float min_x[W], min_y[W], min_z[W];
+    float max_x[W], max_y[W], max_z[W];
+    int child[W];       // Interior child: node index. Leaf child: index into the leaves. Empty slot: -1
+    uint16_t count[W];  // Primitives in a leaf child, 0 for interior children and empty slots
+
+    WideBVHNode() {
+        // Empty slots get inverted bounds that no ray can hit
+        for (int k = 0; k < W; ++k) {
+            min_x[k] = min_y[k] = min_z[k] = std::numeric_limits<float>::infinity();
+            max_x[k] = max_y[k] = max_z[k] = -std::numeric_limits<float>::infinity();
+            child[k] = -1;
+            count[k] = 0;
+        }
+    }
+
+    void set_bounds(int k, const CompactBounds& b) {
+        min_x[k] = b.pmin.x; min_y[k] = b.pmin.y; min_z[k] = b.pmin.z;
+        max_x[k] = b.pmax.x; max_y[k] = b.pmax.y; max_z[k] = b.pmax.z;
+    }
+};
+
+template <int W>
+int collapse_bvh(const std::vector<LinearBVHNode>& nodes, int binary_index, std::vector<WideBVHNode<W>>& wide_nodes) {
+    /*
+    Emits the wide node for the binary subtree at binary_index and returns its index.
+    Starting from the two children, the interior child with the largest surface area is
+    replaced by its own two children until W slots are filled or only leaves remain.
+    */
+    int index = static_cast<int>(wide_nodes.size());
+    wide_nodes.emplace_back();
+
+    std::array<int, W> kids;
+    int n = 0;
+    const LinearBVHNode& root = nodes[binary_index];
+    if (root.isLeaf()) {
+        kids[n++] = binary_index;
+    } else {
+        kids[n++] = binary_index + 1;
+        kids[n++] = root.second_child_offset;
+    }
+
+    while (n < W) {
+        int best = -1;
+        double best_area = -1;
+        for (int i = 0; i < n; ++i) {
+            const LinearBVHNode& kid = nodes[kids[i]];
+            if (!kid.isLeaf() && kid.bounds.surface_area() > best_area) {
+                best_area = kid.bounds.surface_area();
+                best = i;
+            }
+        }
+        if (best == -1) break;
+        int opened = kids[best];
+        kids[best] = opened + 1;
+        kids[n++] = nodes[opened].second_child_offset;
+    }
+
+    for (int k = 0; k < n; ++k) {
+        const LinearBVHNode& kid = nodes[kids[k]];
+        int child;
+        if (kid.isLeaf()) {
+            child = kid.leaf;
+            wide_nodes[index].count[k] = kid.n_prims;
+        } else {
+            child = collapse_bvh<W>(nodes, kids[k], wide_nodes);
+        }
+        // wide_nodes may have reallocated during the recursion, index again
+        wide_nodes[index].child[k] = child;
+        wide_nodes[index].set_bounds(k, kid.bounds);
+    }
+    return index;
+}
+
+template <int W>
+inline int intersect_wide_bounds(const WideBVHNode<W>& node, const ray_float& r, float t_min, float t_max, float t_near[W]) {
+    /*
+    Slab test of the ray against all W child boxes at once. Returns a bit mask of the children
+    that are hit within [t_min, t_max] and writes each child's entry distance to t_near.
+    Near and far planes are picked by the ray's sign bits, so no per lane swapping is needed.
+    */
+    const float* near_x = r.sign_x ? node.min_x : node.max_x;
+    const float* far_x  = r.sign_x ? node.max_x : node.min_x;
+    const float* near_y = r.sign_y ? node.min_y : node.max_y;
+    const float* far_y  = r.sign_y ? node.max_y : node.min_y;
+    const float* near_z = r.sign_z ? node.min_z : node.max_z;
+    const float* far_z  = r.sign_z ? node.max_z : node.min_z;
+    int mask = 0;
+    int k = 0;
+
+#if defined(RT_SIMD_AVX)
+    const __m256 nx = _mm256_set1_ps(r.near_ox), ny = _mm256_set1_ps(r.near_oy), nz = _mm256_set1_ps(r.near_oz);
+    const __m256 fx = _mm256_set1_ps(r.far_ox), fy = _mm256_set1_ps(r.far_oy), fz = _mm256_set1_ps(r.far_oz);
+    const __m256 ix = _mm256_set1_ps(r.ix), iy = _mm256_set1_ps(r.iy), iz = _mm256_set1_ps(r.iz);
+    const __m256 tmin = _mm256_set1_ps(t_min), tmax = _mm256_set1_ps(t_max);
+    const __m256 scale = _mm256_set1_ps(box_far_scale);
+    for (; k + 8 <= W; k += 8) {
+        __m256 t0 = _mm256_max_ps(
+            _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_x + k), nx), ix),
+                          _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_y + k), ny), iy)),
+            _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_z + k), nz), iz), tmin));
+        __m256 t1 = _mm256_min_ps(
+            _mm256_mul_ps(_mm256_min_ps(
+                _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_x + k), fx), ix),
+                              _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_y + k), fy), iy)),
+                _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_z + k), fz), iz)), scale),
+            tmax);
+        _mm256_storeu_ps(t_near + k, t0);
+        mask |= _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)) << k;
+    }
+#endif
+#if defined(RT_SIMD_SSE)
+    const __m128 nx4 = _mm_set1_ps(r.near_ox), ny4 = _mm_set1_ps(r.near_oy), nz4 = _mm_set1_ps(r.near_oz);
+    const __m128 fx4 = _mm_set1_ps(r.far_ox), fy4 = _mm_set1_ps(r.far_oy), fz4 = _mm_set1_ps(r.far_oz);
+    const __m128 ix4 = _mm_set1_ps(r.ix), iy4 = _mm_set1_ps(r.iy), iz4 = _mm_set1_ps(r.iz);
+    const __m128 tmin4 = _mm_set1_ps(t_min), tmax4 = _mm_set1_ps(t_max);
+    const __m128 scale4 = _mm_set1_ps(box_far_scale);
+    for (; k + 4 <= W; k += 4) {
+        __m128 t0 = _mm_max_ps(
+            _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(near_x + k), nx4), ix4),
+                       _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(near_y + k), ny4), iy4)),
+            _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(near_z + k), nz4), iz4), tmin4));
+        __m128 t1 = _mm_min_ps(
+            _mm_mul_ps(_mm_min_ps(
+                _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far_x + k), fx4), ix4),
+                           _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far_y + k), fy4), iy4)),
+                _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far_z + k), fz4), iz4)), scale4),
+            tmax4);
+        _mm_storeu_ps(t_near + k, t0);
+        mask |= _mm_movemask_ps(_mm_cmple_ps(t0, t1)) << k;
+    }
+#endif
+    for (; k < W; ++k) {
+        float t0 = std::max(std::max((near_x[k] - r.near_ox) * r.ix, (near_y[k] - r.near_oy) * r.iy),
+                            std::max((near_z[k] - r.near_oz) * r.iz, t_min));
+        float t1 = std::min(std::min((far_x[k] - r.far_ox) * r.ix, (far_y[k] - r.far_oy) * r.iy),
+                            (far_z[k] - r.far_oz) * r.iz) * box_far_scale;
+        t1 = std::min(t1, t_max);
+        t_near[k] = t0;
+        mask |= (t0 <= t1) << k;
+    }
+    return mask;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TRAVERSAL_STATS_H
+#define TRAVERSAL_STATS_H
+/*
+Counts of what ray queries did. Each render thread, tile or benchmark loop keeps its own and
+passes it down by reference, so no counter is ever shared between threads. Instances pass
+theirs into their bottom level BVH, so a query's counts include the work under instances.
+*/
+
+enum traversal_counter {
+    COUNT_NODES,
+    COUNT_BOX_TESTS,
+    COUNT_PRIMITIVES,
+    COUNT_HITS,
+    COUNT_COST         // Nodes plus primitive tests, the usual single number for traversal work
+};
+
+struct traversal_stats {
+    long rays = 0;        // Queries made on the scene, the ones instances make below it aren't counted
+    long nodes = 0;       // Nodes visited
+    long box_tests = 0;   // Boxes tested, a wide node tests all its child slots at once
+    long box_hits = 0;    // Boxes the ray entered
+    long primitives = 0;  // Primitive intersection tests
+    long hits = 0;        // Primitive tests that found a hit
+
+    long count(traversal_counter counter) const {
+        switch (counter) {
+        case COUNT_NODES: return nodes;
+        case COUNT_BOX_TESTS: return box_tests;
+        case COUNT_PRIMITIVES: return primitives;
+        case COUNT_HITS: return hits;
+        default: return nodes + primitives;
+        }
+    }
+
+    traversal_stats& operator+=(const traversal_stats& other) {
+        rays += other.rays;
+        nodes += other.nodes;
+        box_tests += other.box_tests;
+        box_hits += other.box_hits;
+        primitives += other.primitives;
+        hits += other.hits;
+        return *this;
+    }
+};
+
+#endif
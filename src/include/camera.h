@@ -1,10 +1,29 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "primitive_shapes/hittable.h"
+#include "primitive_shapes/hittable_list.h"
+#include "acceleration/bvh_aggregate.h"
 #include "utils.h"
 #include "geometry/matrix.h"
 #include "geometry/transform.h"
+#include "parallel/thread_pool.h"
+#include "film/film.h"
+#include "film/sample_buffer.h"
+#include "sampling/light_list.h"
+#include "sampling/sampler.h"
+
+enum render_mode {
+    RENDER_RADIANCE,  // The path traced image
+    RENDER_HEATMAP    // Each pixel's traversal work in false color, blue for little up to red for the most
+};
 
 class camera {
 private:
@@ -36,29 +55,105 @@ private:
     }
 
 
-    color ray_color(const ray& r, int depth, const hittable_list& world, BVHTreeNode* head) const {
-        hit_record rec;
-        if (depth <= 0) {
-            return background;
-        }
+    static constexpr int pixel_dimensions = 2;   // Sampler dimensions spent on the pixel jitter
+    static constexpr int bounce_dimensions = 7;  // And on each bounce: BSDF lobe and direction, light choice and point, roulette
+    static constexpr int light_dimension = 3;     // Offsets within a bounce's block
+    static constexpr int roulette_dimension = 6;
 
-        // set interval start at 0.001 to prevent a ray from bouncing with it's start surface due to float roundoff
-        if (world.intersect(head, r, interval(0.001, infinity), rec)) {
-            //I think we need to put this reflective behaviour based on the material property of the element itself
-            // This is semi lambertian, where we are basing new ray direction on the normal, but not true
-            // Scatters rays towards the normals, but randomly
-            ray scattered;
-            color attenuation;
-            color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return hadamard_product(attenuation, ray_color(scattered, depth-1, world, head)) + color_from_emission;
-            return color_from_emission;
+    color ray_color(const ray& r, int max_depth, const hittable_list& world, const BVHAggregate& bvh, sampler& smp,
+                    traversal_stats& stats) const {
+        /*
+        Follows one path iteratively, carrying the product of the attenuations so far as
+        throughput. Paths still going after max_depth scatters see the background, as the
+        recursive version did. At every non specular hit a shadow ray to a point sampled on
+        the lights adds direct light, and emission that BSDF sampling finds is added too. Both
+        strategies can reach the same light, so each is weighted by the power heuristic over
+        the two pdfs. After the first roulette_depth bounces, Russian roulette ends a path with
+        probability 1 - q, where q is its largest throughput component capped at 0.95, and
+        divides survivors by q. Each path's expected value is unchanged but dim paths stop
+        early instead of running to max_depth. Each bounce draws its uniforms from its own
+        block of sampler dimensions, and the light and roulette draws are set to fixed offsets
+        in it, so a dimension always means the same thing whether or not the draws before it
+        happened. Every ray the path traces counts its traversal into stats.
+        */
+        color radiance(0, 0, 0, 0);
+        color throughput(1, 1, 1, 0);
+        ray current = r;
+        bool light_sampled = false;  // Whether the last scatter also sampled the lights
+        double scatter_pdf = 0;
+        for (int depth = 0; depth < max_depth; depth++) {
+            int dimension = pixel_dimensions + depth * bounce_dimensions;
+            smp.set_dimension(dimension);
+            hit_record rec;
+            // set interval start at 0.001 to prevent a ray from bouncing with it's start surface due to float roundoff
+            if (!world.intersect(bvh, current, interval(0.001, infinity), rec, stats)) {
+                return radiance + hadamard_product(throughput, background);
+            }
+            const bxdf& mat = (*world.materials)[rec.material];
+            color emitted = mat.emitted(rec.u, rec.v, rec.p);
+            if (light_sampled && lights.contains(rec.primitive)) {
+                emitted *= power_heuristic(scatter_pdf, lights.pdf(current.origin(), rec));
+            }
+            radiance += hadamard_product(throughput, emitted);
+
+            bxdf_sample s;
+            double u_lobe = smp.get_1d();
+            double u1, u2;
+            smp.get_2d(u1, u2);
+            if (!mat.sample(current, rec, u_lobe, u1, u2, s) || s.pdf <= 0) {
+                return radiance;
+            }
+            light_sampled = !s.specular && !lights.empty();
+            if (light_sampled) {
+                smp.set_dimension(dimension + light_dimension);
+                radiance += hadamard_product(throughput, direct_light(current, rec, mat, world, bvh, smp, stats));
+            }
+            scatter_pdf = s.pdf;
+            throughput = hadamard_product(throughput, s.weight(rec.normal));
+            if (depth >= roulette_depth) {
+                smp.set_dimension(dimension + roulette_dimension);
+                double survive = std::min<double>(std::max({throughput.x, throughput.y, throughput.z}), 0.95);
+                if (smp.get_1d() >= survive) {
+                    return radiance;
+                }
+                throughput /= survive;
+            }
+            current = ray(rec.p, s.direction);
         }
+        return radiance + hadamard_product(throughput, background);
+    }
+
+    color direct_light(const ray& r_in, const hit_record& rec, const bxdf& mat, const hittable_list& world,
+                       const BVHAggregate& bvh, sampler& smp, traversal_stats& stats) const {
+        // One light sample's contribution at rec, MIS weighted against sampling the BSDF. The
+        // light choice and point are the three dimensions smp is set to, see ray_color
+        double u_light = smp.get_1d();
+        double u1, u2;
+        smp.get_2d(u1, u2);
+        light_sample ls;
+        if (!lights.sample(u_light, u1, u2, ls)) return color(0,0,0);
+        vec3h to_light = ls.p - rec.p;
+        double dist = to_light.magnitude();
+        if (dist <= 0.002) return color(0,0,0);  // Too close for the shadow ray to clear both offsets
+        vec3h direction = to_light / dist;
+        double cos_light = std::fabs(dot(direction, ls.normal));
+        color f = mat.f(r_in, rec, direction);
+        if (cos_light <= 0 || (f.x == 0 && f.y == 0 && f.z == 0)) return color(0,0,0);
+        if (world.occluded(bvh, ray(rec.p, direction), dist - 0.001, stats)) return color(0,0,0);
 
-        vec3h normal_dir = (r.direction().normal_of());
-        return background;
+        double light_pdf = ls.pdf * dist * dist / cos_light;
+        double weight = power_heuristic(light_pdf, mat.pdf(r_in, rec, direction));
+        return (weight * std::fabs(dot(direction, rec.normal)) / light_pdf) * hadamard_product(f, ls.emitted);
     }
 
+    static double power_heuristic(double pdf, double other_pdf) {
+        // Veach's power heuristic with exponent 2 for one sample from each strategy
+        if (pdf <= 0) return 0;
+        return (pdf * pdf) / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    light_list lights;  // Collected from the BVH's primitives at the start of each render
+
 public:
     double aspect_ratio;  // Ratio of image width over height
     double focal_length;
@@ -69,9 +164,29 @@ public:
     int image_width;  // Rendered image width in pixel count
     int image_height;   // Rendered image height
     int ray_bounces; // four by default
+    int roulette_depth = 3;    // Bounces before Russian roulette can end a path, ray_bounces or more turns it off
+    bool sample_lights = true; // Shadow rays to emissive triangles and spheres at every diffuse hit
+    sampler_type sample_pattern = SAMPLER_SOBOL;  // How each pixel's samples are spread, see sampling/sampler.h
     double tilt_angle;
     //double defocus_angle = 0;  // Variation angle of rays through each pixel
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
+    int num_threads = 0;       // Render threads, 0 uses every hardware core
+    int tile_size = 16;        // Side length in pixels of the square tiles handed to each thread
+    uint64_t seed = 0;         // Renders with the same seed are identical for any num_threads
+    std::string output_path = "image.png";  // .ppm, .png or .pfm
+    float exposure = 1;
+    tonemap_operator tonemap = TONEMAP_CLAMP;
+    int samples_per_pass = 4;          // Samples per pixel each progressive pass adds
+    std::string checkpoint_path;       // Sample buffer checkpoint to resume from and save to, empty for none
+    double checkpoint_interval = 60;   // Seconds between checkpoints
+    double adaptive_threshold = 0;     // Pixels whose display error falls below this stop sampling, 0 samples evenly
+    int adaptive_min_samples = 16;     // Samples every pixel takes before its error estimate is trusted
+    int adaptive_max_samples = 0;      // Most samples a noisy pixel can take, 0 for 8 x aa_samples_per_px
+    render_mode mode = RENDER_RADIANCE;
+    traversal_counter heatmap_counter = COUNT_COST;  // Which count RENDER_HEATMAP shows
+    double heatmap_max = 0;            // Count shown as full red, 0 for the image's 99th percentile
+    std::vector<traversal_stats> pixel_stats;  // Traversal work of each pixel's samples in the last render, rows top to bottom
+    uint64_t total_samples = 0;        // Samples the last render's image is made of, resumed ones included
     vec3h center;         // Camera center, point
     vec3h lookat;         // Any point the camera is looking toward
     vec3h pixel00_loc;    // Location of pixel 0, 0, point
@@ -87,34 +202,253 @@ public:
     void set_img_width(int w) {image_width = w;}
     
 
-    void render(const hittable_list& world, BVHTreeNode* head) {
+    void render(const hittable_list& world, const BVHAggregate& bvh) {
+        film image = render_image(world, bvh);
+        if (image.write(output_path)) {
+            std::clog << "\rDone, wrote " << output_path << "        \n";
+        }
+    }
+
+    film render_image(const hittable_list& world, const BVHAggregate& bvh) {
+        /*
+        Renders in passes of samples_per_pass samples per pixel until every pixel has
+        aa_samples_per_px. Each pass splits the image into tiles on a thread pool and each
+        tile adds to its own pixels of a shared sample buffer. Between passes the buffer is
+        saved to checkpoint_path every checkpoint_interval seconds, and a matching checkpoint
+        already there is resumed from. A killed job loses at most one interval of work, and
+        a finished render takes more samples by raising aa_samples_per_px and running again.
+        With adaptive_threshold set, plan_pass spends the same total budget unevenly instead.
+        */
         initialize();
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+        lights = sample_lights ? light_list(bvh.get_store()) : light_list();
+        sample_buffer samples(image_width, image_height, seed);
+        samples.scene_hash = checkpoint_hash(world, bvh);
+        if (!checkpoint_path.empty()) resume_from_checkpoint(samples);
+        pixel_stats.assign(size_t(image_width) * image_height, traversal_stats());
+
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int num_tiles = tiles_x * tiles_y;
+        std::vector<uint32_t> targets(size_t(image_width) * image_height);
+        std::mutex log_lock;
+        thread_pool pool(num_threads);
+        auto last_checkpoint = std::chrono::steady_clock::now();
+
+        for (int pass = 1; plan_pass(samples, targets); pass++) {
+            std::atomic<int> tiles_done{0};
+            pool.parallel_for(num_tiles, [&](int tile) {
+                int x0 = (tile % tiles_x) * tile_size;
+                int y0 = (tile / tiles_x) * tile_size;
+                render_tile(world, bvh, samples, targets, x0, y0,
+                    std::min(x0 + tile_size, image_width), std::min(y0 + tile_size, image_height));
+
+                int done = tiles_done.fetch_add(1) + 1;
+                std::lock_guard<std::mutex> guard(log_lock);
+                std::clog << "\rPass " << pass << ", tiles remaining: " << (num_tiles - done) << ' ' << std::flush;
+            });
+
+            auto now = std::chrono::steady_clock::now();
+            if (!checkpoint_path.empty()
+                && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval) {
+                save_checkpoint(samples);
+                last_checkpoint = now;
+            }
+        }
+        if (!checkpoint_path.empty()) save_checkpoint(samples);
+        total_samples = samples.total_samples();
+        if (adaptive_threshold > 0) {
+            double per_pixel = double(samples.total_samples()) / targets.size();
+            std::clog << "\rAdaptive sampling averaged " << per_pixel << " samples per pixel of "
+                      << aa_samples_per_px << " budgeted\n";
+        }
+
+        if (mode == RENDER_HEATMAP) return heatmap();
+        film framebuffer(image_width, image_height);
+        framebuffer.exposure = exposure;
+        framebuffer.tonemap = tonemap;
+        samples.resolve(framebuffer);
+        return framebuffer;
+    }
+
+    film heatmap() const {
+        /*
+        pixel_stats as an image, heatmap_counter's count for each pixel over heatmap_max on
+        a false color ramp. The count is the pixel's total, so with adaptive sampling pixels
+        that took more samples show the extra work too. Samples a resumed checkpoint already
+        had were traced by an earlier run and aren't counted. Paths are traced in full, a
+        ray_bounces of 1 shows just the camera rays and their shadow rays.
+        */
+        std::vector<long> counts(pixel_stats.size());
+        for (size_t k = 0; k < pixel_stats.size(); k++) counts[k] = pixel_stats[k].count(heatmap_counter);
+        double top = heatmap_max;
+        if (top <= 0 && !counts.empty()) {
+            // A percentile rather than the maximum, so a few very costly pixels don't wash out the rest
+            std::vector<long> sorted = counts;
+            size_t k = (sorted.size() - 1) * 99 / 100;
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+            top = sorted[k];
+        }
+        film framebuffer(image_width, image_height);
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                long count = counts[size_t(j) * image_width + i];
+                framebuffer.set_pixel(i, j, false_color(top > 0 ? count / top : 0));
+            }
+        }
+        return framebuffer;
+    }
+
+    bool plan_pass(const sample_buffer& samples, std::vector<uint32_t>& targets) const {
+        /*
+        Sets how many samples each pixel should have once the next pass is done, and returns
+        false when no pixel needs more. Uniform sampling brings every pixel up together.
+        Adaptive sampling first gives every pixel adaptive_min_samples, then keeps adding to
+        pixels whose display_error (or a neighbour's, so isolated lucky estimates don't stop
+        a noisy region early) is above adaptive_threshold, up to adaptive_max_samples each,
+        until none are left or aa_samples_per_px times the pixel count has been spent. A pass
+        that would go over the budget is cut down to what is left of it, pixels still short of
+        adaptive_min_samples first and then the noisiest.
+        */
+        uint32_t per_pass = static_cast<uint32_t>(std::max(samples_per_pass, 1));
+        uint32_t budget_per_pixel = static_cast<uint32_t>(aa_samples_per_px);
+        if (adaptive_threshold <= 0) {
+            uint32_t lowest = samples.min_samples();
+            std::fill(targets.begin(), targets.end(), std::min(lowest + per_pass, budget_per_pixel));
+            return lowest < budget_per_pixel;
+        }
+        uint64_t budget = uint64_t(budget_per_pixel) * targets.size();
+        uint64_t spent = samples.total_samples();
+        if (spent >= budget) return false;
 
+        uint32_t max_samples = adaptive_max_samples > 0 ? adaptive_max_samples : 8 * budget_per_pixel;
+        uint32_t min_samples = std::min(static_cast<uint32_t>(adaptive_min_samples), max_samples);
+        std::vector<double> error(targets.size());
+        std::vector<char> noisy(targets.size());
         for (int j = 0; j < image_height; j++) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
             for (int i = 0; i < image_width; i++) {
-                vec3h pixel_color = vec3h();
-                for (int s = 0; s < aa_samples_per_px; s++) {
-                    ray offset_ray = generate_offset_ray(i, j, s);
-                    pixel_color += ray_color(offset_ray, ray_bounces, world, head);
+                error[size_t(j) * image_width + i] = samples.display_error(i, j);
+                noisy[size_t(j) * image_width + i] = error[size_t(j) * image_width + i] > adaptive_threshold;
+            }
+        }
+
+        uint64_t requested = 0;
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                uint32_t have = samples.samples(i, j);
+                uint32_t want = have;
+                if (have < min_samples) {
+                    want = min_samples;
+                } else if (have < max_samples) {
+                    bool active = false;
+                    for (int y = std::max(j - 1, 0); y <= std::min(j + 1, image_height - 1); y++) {
+                        for (int x = std::max(i - 1, 0); x <= std::min(i + 1, image_width - 1); x++) {
+                            active = active || noisy[size_t(y) * image_width + x];
+                        }
+                    }
+                    if (active) want = std::min(have + per_pass, max_samples);
                 }
-                write_color(std::cout, pixel_samples_scale * pixel_color);
+                targets[size_t(j) * image_width + i] = want;
+                requested += want - have;
             }
         }
 
-        std::clog << "\rDone.                 \n"; 
+        uint64_t remaining = budget - spent;
+        if (requested > remaining) {
+            std::vector<size_t> order;
+            for (size_t p = 0; p < targets.size(); p++) {
+                if (targets[p] > samples.count[p]) order.push_back(p);
+            }
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                bool a_short = samples.count[a] < min_samples, b_short = samples.count[b] < min_samples;
+                return a_short != b_short ? a_short : error[a] > error[b];
+            });
+            for (size_t p : order) {
+                uint64_t extra = std::min<uint64_t>(targets[p] - samples.count[p], remaining);
+                targets[p] = samples.count[p] + static_cast<uint32_t>(extra);
+                remaining -= extra;
+            }
+        }
+        return requested > 0;
     }
 
-    ray generate_offset_ray(int i, int j, int sample_coord) {
-        /* Generate a single offset  
-            sample_coord may be 0,1,2,3
+    void render_tile(const hittable_list& world, const BVHAggregate& bvh, sample_buffer& samples,
+                     const std::vector<uint32_t>& targets, int x0, int y0, int x1, int y1) {
+        // Brings each pixel in [x0, x1) x [y0, y1) up to its number of samples in targets
+        std::unique_ptr<sampler> smp = make_sampler(sample_pattern, seed, aa_samples_per_px);
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                uint32_t target = targets[size_t(j) * image_width + i];
+                // Only this tile's thread touches these pixels, so their counters need no locking
+                traversal_stats& stats = pixel_stats[size_t(j) * image_width + i];
+                for (uint32_t s = samples.samples(i, j); s < target; s++) {
+                    // Every sample gets its own random stream so the thread or pass that runs it doesn't matter
+                    seed_random(hash_seed(seed, i, j, s));
+                    smp->start_pixel_sample(i, j, s);
+                    ray offset_ray = generate_offset_ray(i, j, *smp);
+                    samples.add(i, j, ray_color(offset_ray, ray_bounces, world, bvh, *smp, stats));
+                }
+            }
+        }
+    }
+
+    uint64_t checkpoint_hash(const hittable_list& world, const BVHAggregate& bvh) const {
+        /*
+        Hash of everything besides the seed that decides what a pixel's samples are: the view,
+        the path tracing settings and the scene, which is fingerprinted by every primitive's
+        kind and bounds and the number of materials. aa_samples_per_px only counts for the
+        stratified and rank-1 samplers, which spread a pixel's samples over the whole budget,
+        the others draw the same samples whatever the budget.
         */
-        sample_coord = sample_coord % 4;
-        double i_offset = random_double(0, 0.5) * ((sample_coord == 0 || sample_coord == 2) ? 1 : -1);
-        double j_offset = random_double(0, 0.5) * ((sample_coord == 0 || sample_coord == 3) ? 1 : -1);
+        uint64_t h = hash_seed(image_width, image_height, ray_bounces, roulette_depth);
+        auto mix = [&h](double v) {
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            h = hash_seed(h, bits);
+        };
+        h = hash_seed(h, sample_lights, sample_pattern,
+                       sample_pattern == SAMPLER_STRATIFIED || sample_pattern == SAMPLER_RANK1 ? aa_samples_per_px : 0);
+        for (const vec3h& v : {center, lookat, background}) {
+            mix(v.x); mix(v.y); mix(v.z);
+        }
+        mix(fov); mix(tilt_angle); mix(focus_dist);
+
+        h = hash_seed(h, bvh.get_primitives().size(), world.materials->size());
+        for (primitive_ref ref : bvh.get_primitives()) {
+            Bounds3f b = bvh.get_store().bounds(ref);
+            h = hash_seed(h, ref_kind(ref));
+            mix(b.pmin.x); mix(b.pmin.y); mix(b.pmin.z);
+            mix(b.pmax.x); mix(b.pmax.y); mix(b.pmax.z);
+        }
+        return h;
+    }
+
+    void resume_from_checkpoint(sample_buffer& samples) const {
+        sample_buffer saved;
+        if (!saved.load(checkpoint_path)) return;
+        if (saved.width != image_width || saved.height != image_height || saved.seed != seed) {
+            std::clog << "Checkpoint " << checkpoint_path << " is for a different image or seed, starting over\n";
+            return;
+        }
+        if (saved.scene_hash != samples.scene_hash) {
+            std::clog << "Checkpoint " << checkpoint_path << " is for a different scene or render settings, starting over\n";
+            return;
+        }
+        samples = std::move(saved);
+        std::clog << "Resuming from " << checkpoint_path << " at " << samples.min_samples() << " samples per pixel\n";
+    }
+
+    void save_checkpoint(const sample_buffer& samples) const {
+        if (!samples.save(checkpoint_path)) {
+            std::cerr << "Failed to write checkpoint " << checkpoint_path << "\n";
+        }
+    }
+
+    ray generate_offset_ray(int i, int j, sampler& smp) {
+        // A ray through a point of pixel i, j placed by the sampler's first two dimensions
+        double i_offset, j_offset;
+        smp.get_2d(i_offset, j_offset);
         //auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
-        auto sample_center = pixel00_loc + ((i + i_offset) * pixel_delta_u) + ((j+j_offset) * pixel_delta_v);
+        auto sample_center = pixel00_loc + ((i + i_offset - 0.5) * pixel_delta_u) + ((j + j_offset - 0.5) * pixel_delta_v);
         return ray(center, sample_center - center);
     }
 
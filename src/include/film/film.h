@@ -0,0 +1,151 @@
+#ifndef FILM_H
+#define FILM_H
+/*
+Linear float framebuffer the camera renders into. Display output goes through a single
+pass over the whole buffer that applies exposure, the tonemap and gamma, and quantizes
+to bytes four channels at a time, in place of formatting each pixel separately. The
+image is then saved as PPM (P6), PNG or PFM depending on the file extension, and PFM
+files can be read back as references to measure error against.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../color.h"
+#include "image_io.h"
+#if defined(RT_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+enum tonemap_operator {
+    TONEMAP_CLAMP,     // Values past 1 clip to white
+    TONEMAP_REINHARD   // x / (1 + x), rolls highlights off instead of clipping
+};
+
+inline color false_color(double x) {
+    /*
+    Blue through cyan, green and yellow to red for x from 0 to 1, clamped outside. The
+    ramp is squared into linear radiance so the display's gamma 2 shows it as given.
+    */
+    static const double stops[5][3] = {{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}};
+    x = std::min(std::max(x, 0.0), 1.0) * 4;
+    int k = std::min(static_cast<int>(x), 3);
+    double f = x - k;
+    double c[3];
+    for (int a = 0; a < 3; a++) {
+        double v = stops[k][a] + f * (stops[k + 1][a] - stops[k][a]);
+        c[a] = v * v;
+    }
+    return color(c[0], c[1], c[2], 0);
+}
+
+class film {
+public:
+    int width;
+    int height;
+    std::vector<float> rgb;  // Linear radiance, three floats per pixel, rows top to bottom
+    float exposure = 1;      // Scales radiance before tonemapping
+    tonemap_operator tonemap = TONEMAP_CLAMP;
+
+    film() : width(0), height(0) {}
+    film(int width, int height) : width(width), height(height), rgb(3 * size_t(width) * height, 0.0f) {}
+
+    void set_pixel(int i, int j, const color& c) {
+        float* p = &rgb[3 * (size_t(j) * width + i)];
+        p[0] = static_cast<float>(c.x);
+        p[1] = static_cast<float>(c.y);
+        p[2] = static_cast<float>(c.z);
+    }
+
+    color get_pixel(int i, int j) const {
+        const float* p = &rgb[3 * (size_t(j) * width + i)];
+        return color(p[0], p[1], p[2], 0);
+    }
+
+    std::vector<uint8_t> to_bytes() const {
+        /*
+        8 bit display values, three per pixel. Gamma is 2 (a square root) and the byte is
+        int(256 * min(v, 0.999)) as the old per pixel writer did, so clamped renders keep
+        the same levels. Negative and NaN radiance become black.
+        */
+        std::vector<uint8_t> bytes(rgb.size());
+        size_t n = rgb.size();
+        size_t k = 0;
+#if defined(RT_SIMD_SSE)
+        const __m128 scale = _mm_set1_ps(exposure);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 top = _mm_set1_ps(0.999f);
+        const __m128 levels = _mm_set1_ps(256.0f);
+        const bool reinhard = tonemap == TONEMAP_REINHARD;
+        for (; k + 4 <= n; k += 4) {
+            // max with the value first turns NaN into zero
+            __m128 v = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&rgb[k]), scale), zero);
+            if (reinhard) v = _mm_div_ps(v, _mm_add_ps(v, one));
+            v = _mm_mul_ps(_mm_min_ps(_mm_sqrt_ps(v), top), levels);
+            __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(&bytes[k], &packed, 4);
+        }
+#endif
+        for (; k < n; k++) {
+            float v = rgb[k] * exposure;
+            v = v > 0 ? v : 0;
+            if (tonemap == TONEMAP_REINHARD) v = v / (1 + v);
+            v = std::sqrt(v);
+            bytes[k] = static_cast<uint8_t>(256 * (v < 0.999f ? v : 0.999f));
+        }
+        return bytes;
+    }
+
+    bool write(const std::string& path) const {
+        /* Saves as .ppm, .png or .pfm by extension, PFM keeps the linear floats untouched */
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        std::vector<uint8_t> encoded;
+        if (extension == "pfm") {
+            encoded = encode_pfm(width, height, rgb.data());
+        } else if (extension == "png") {
+            encoded = encode_png(width, height, to_bytes().data());
+        } else if (extension == "ppm") {
+            encoded = encode_ppm(width, height, to_bytes().data());
+        } else {
+            std::cerr << "Unknown image format for " << path << ", use .ppm, .png or .pfm\n";
+            return false;
+        }
+        if (!write_file(path, encoded)) {
+            std::cerr << "Failed to write " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool read(const std::string& path) {
+        /* Loads a .pfm written by write(), the other formats have lost the linear values */
+        std::vector<uint8_t> bytes;
+        if (!read_file(path, bytes)) {
+            std::cerr << "Failed to read " << path << "\n";
+            return false;
+        }
+        if (!decode_pfm(bytes, width, height, rgb)) {
+            std::cerr << path << " is not a colour PFM\n";
+            return false;
+        }
+        return true;
+    }
+};
+
+inline double rmse(const film& image, const film& reference) {
+    // Root mean square difference of the linear radiance over every channel of every pixel
+    double sum = 0;
+    for (size_t k = 0; k < image.rgb.size(); k++) {
+        double d = double(image.rgb[k]) - reference.rgb[k];
+        sum += d * d;
+    }
+    return image.rgb.empty() ? 0 : std::sqrt(sum / image.rgb.size());
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+/*
+Writers for the image formats the film can save: binary PPM (P6) and PNG for 8 bit display
+images, and PFM for the linear float framebuffer, which can also be read back to compare
+renders. PNG needs zlib's deflate, so a small encoder lives here (LZ77 with hash chains
+plus the fixed Huffman code from RFC 1951) to keep the renderer free of external
+dependencies.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+inline uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // 5552 is the most bytes that can be summed before b overflows 32 bits
+        size_t chunk = size < 5552 ? size : 5552;
+        for (size_t i = 0; i < chunk; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+class deflate_bit_writer {
+public:
+    std::vector<uint8_t>& out;
+    uint64_t buffer = 0;
+    int bit_count = 0;
+
+    deflate_bit_writer(std::vector<uint8_t>& out) : out(out) {}
+
+    void put_bits(uint32_t value, int count) {
+        // Deflate packs values starting from the least significant bit
+        buffer |= uint64_t(value) << bit_count;
+        bit_count += count;
+        if (bit_count >= 32) {
+            for (int k = 0; k < 4; k++) out.push_back(static_cast<uint8_t>(buffer >> (8 * k)));
+            buffer >>= 32;
+            bit_count -= 32;
+        }
+    }
+
+    void put_code(uint32_t code, int length) {
+        // Huffman codes go most significant bit first, the reverse of everything else
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        put_bits(reversed, length);
+    }
+
+    void put_literal(int symbol) {
+        // Fixed Huffman code for literal/length symbols 0-287, bit reversed once up front
+        struct fixed_code { uint16_t bits; uint8_t length; };
+        static const std::array<fixed_code, 288> codes = [] {
+            std::array<fixed_code, 288> table;
+            for (int s = 0; s < 288; s++) {
+                uint32_t code; int length;
+                if (s < 144) { code = 0x30 + s; length = 8; }
+                else if (s < 256) { code = 0x190 + s - 144; length = 9; }
+                else if (s < 280) { code = s - 256; length = 7; }
+                else { code = 0xc0 + s - 280; length = 8; }
+                uint32_t reversed = 0;
+                for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+                table[s] = {static_cast<uint16_t>(reversed), static_cast<uint8_t>(length)};
+            }
+            return table;
+        }();
+        put_bits(codes[symbol].bits, codes[symbol].length);
+    }
+
+    void flush() {
+        for (; bit_count > 0; bit_count -= 8) {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+        }
+        buffer = 0;
+        bit_count = 0;
+    }
+};
+
+inline void put_match(deflate_bit_writer& bits, int length, int distance) {
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                          257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                          8193, 12289, 16385, 24577};
+    static const int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int l = 28;
+    while (length_base[l] > length) l--;
+    bits.put_literal(257 + l);
+    bits.put_bits(length - length_base[l], length_extra[l]);
+
+    int d = 29;
+    while (distance_base[d] > distance) d--;
+    bits.put_code(d, 5);
+    bits.put_bits(distance - distance_base[d], distance_extra[d]);
+}
+
+inline std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t size) {
+    /*
+    zlib stream holding a single fixed Huffman block. Matches are found greedily through
+    hash chains over 3 byte prefixes, searching at most max_chain earlier positions.
+    */
+    const int window = 32768, min_match = 3, max_match = 258, max_chain = 8;
+    const int max_insert = 32;  // Longer matches skip hashing their interior, as zlib does
+    const int hash_bits = 15;
+    std::vector<uint8_t> out = {0x78, 0x01};
+    out.reserve(size / 2);
+    deflate_bit_writer bits(out);
+    bits.put_bits(1, 1);  // Final block
+    bits.put_bits(1, 2);  // Fixed Huffman codes
+
+    std::vector<int> head(1 << hash_bits, -1);
+    std::vector<int> prev(window, -1);
+    auto hash_at = [&](size_t i) {
+        uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+        return static_cast<int>((v * 2654435761u) >> (32 - hash_bits));
+    };
+    auto insert = [&](size_t i) {
+        if (i + min_match > size) return;
+        int h = hash_at(i);
+        prev[i & (window - 1)] = head[h];
+        head[h] = static_cast<int>(i);
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        int best_length = 0, best_distance = 0;
+        if (i + min_match <= size) {
+            int limit = static_cast<int>(std::min<size_t>(max_match, size - i));
+            int candidate = head[hash_at(i)];
+            for (int chain = 0; candidate >= 0 && chain < max_chain; chain++) {
+                int distance = static_cast<int>(i) - candidate;
+                if (distance > window - 1) break;
+                if (data[candidate + best_length] == data[i + best_length]) {
+                    int length = 0;
+                    while (length < limit && data[candidate + length] == data[i + length]) length++;
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = distance;
+                        if (length == limit) break;
+                    }
+                }
+                int next = prev[candidate & (window - 1)];
+                if (next >= candidate) break;  // Slot was reused by a newer position
+                candidate = next;
+            }
+        }
+        insert(i);
+        if (best_length >= min_match) {
+            put_match(bits, best_length, best_distance);
+            if (best_length <= max_insert) {
+                for (int k = 1; k < best_length; k++) insert(i + k);
+            }
+            i += best_length;
+        } else {
+            bits.put_literal(data[i]);
+            i++;
+        }
+    }
+    bits.put_literal(256);  // End of block
+    bits.flush();
+
+    uint32_t check = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(check >> shift));
+    return out;
+}
+
+inline void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(v >> shift));
+}
+
+inline void put_png_chunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+    put_be32(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_be32(out, crc32_update(0, out.data() + start, out.size() - start));
+}
+
+inline uint8_t paeth_predictor(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+inline void filter_row(int type, const uint8_t* row, const uint8_t* up, uint8_t* out, size_t stride) {
+    // PNG filter type 0-4 of one RGB row. The first pixel's left and upper left neighbours are zero.
+    switch (type) {
+    case 0:
+        std::memcpy(out, row, stride);
+        break;
+    case 1:
+        for (size_t x = 0; x < 3; x++) out[x] = row[x];
+        for (size_t x = 3; x < stride; x++) out[x] = static_cast<uint8_t>(row[x] - row[x - 3]);
+        break;
+    case 2:
+        for (size_t x = 0; x < stride; x++) out[x] = static_cast<uint8_t>(row[x] - up[x]);
+        break;
+    case 3:
+        for (size_t x = 0; x < 3; x++) out[x] = static_cast<uint8_t>(row[x] - up[x] / 2);
+        for (size_t x = 3; x < stride; x++) out[x] = static_cast<uint8_t>(row[x] - (row[x - 3] + up[x]) / 2);
+        break;
+    default:
+        for (size_t x = 0; x < 3; x++) out[x] = static_cast<uint8_t>(row[x] - up[x]);
+        for (size_t x = 3; x < stride; x++) {
+            out[x] = static_cast<uint8_t>(row[x] - paeth_predictor(row[x - 3], up[x], up[x - 3]));
+        }
+        break;
+    }
+}
+
+inline std::vector<uint8_t> encode_png(int width, int height, const uint8_t* rgb) {
+    /*
+    8 bit RGB PNG. Each row gets whichever of the five PNG filters leaves the smallest sum
+    of absolute (signed) residuals, the usual heuristic from the PNG spec.
+    */
+    const size_t stride = 3 * static_cast<size_t>(width);
+    std::vector<uint8_t> filtered((stride + 1) * height);
+    std::vector<uint8_t> candidate(stride);
+    std::vector<uint8_t> zero_row(stride, 0);
+    for (int j = 0; j < height; j++) {
+        const uint8_t* row = rgb + j * stride;
+        const uint8_t* up = j > 0 ? row - stride : zero_row.data();
+        uint8_t* dst = &filtered[j * (stride + 1)];
+        long best_score = -1;
+        for (int type = 0; type < 5; type++) {
+            filter_row(type, row, up, candidate.data(), stride);
+            long score = 0;
+            for (size_t x = 0; x < stride; x++) score += std::abs(static_cast<int8_t>(candidate[x]));
+            if (best_score < 0 || score < best_score) {
+                best_score = score;
+                dst[0] = static_cast<uint8_t>(type);
+                std::memcpy(dst + 1, candidate.data(), stride);
+            }
+        }
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    put_be32(header, static_cast<uint32_t>(width));
+    put_be32(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), {8, 2, 0, 0, 0});  // 8 bit depth, RGB, deflate, standard filters, no interlace
+    put_png_chunk(png, "IHDR", header);
+    put_png_chunk(png, "IDAT", zlib_compress(filtered.data(), filtered.size()));
+    put_png_chunk(png, "IEND", {});
+    return png;
+}
+
+inline std::vector<uint8_t> encode_ppm(int width, int height, const uint8_t* rgb) {
+    std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+    std::vector<uint8_t> ppm(header.begin(), header.end());
+    ppm.insert(ppm.end(), rgb, rgb + 3 * static_cast<size_t>(width) * height);
+    return ppm;
+}
+
+inline std::vector<uint8_t> encode_pfm(int width, int height, const float* rgb) {
+    /*
+    Portable float map. Rows go bottom to top and a negative scale marks little endian
+    floats, so the sign is picked from the byte order of the machine writing the file.
+    */
+    const uint32_t one = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&one) == 1;
+    std::string header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height)
+                       + (little_endian ? "\n-1.0\n" : "\n1.0\n");
+    std::vector<uint8_t> pfm(header.begin(), header.end());
+    const size_t row_bytes = 3 * sizeof(float) * static_cast<size_t>(width);
+    for (int j = height - 1; j >= 0; j--) {
+        const uint8_t* row = reinterpret_cast<const uint8_t*>(rgb + 3 * static_cast<size_t>(width) * j);
+        pfm.insert(pfm.end(), row, row + row_bytes);
+    }
+    return pfm;
+}
+
+inline bool decode_pfm(const std::vector<uint8_t>& pfm, int& width, int& height, std::vector<float>& rgb) {
+    /* Colour PFM back to rows top to bottom, swapping bytes when the file's order isn't the machine's */
+    std::string text(pfm.begin(), pfm.begin() + std::min<size_t>(pfm.size(), 64));
+    char* end = nullptr;
+    if (text.compare(0, 3, "PF\n") != 0) return false;
+    long w = std::strtol(text.c_str() + 3, &end, 10);
+    long h = std::strtol(end, &end, 10);
+    double scale = std::strtod(end, &end);
+    if (w <= 0 || h <= 0 || scale == 0 || *end != '\n') return false;
+    size_t header = static_cast<size_t>(end - text.c_str()) + 1;
+    size_t count = 3 * static_cast<size_t>(w) * static_cast<size_t>(h);
+    if (pfm.size() != header + count * sizeof(float)) return false;
+
+    const uint32_t one = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&one) == 1;
+    bool swap = (scale < 0) != little_endian;
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+    rgb.resize(count);
+    const size_t row_floats = 3 * static_cast<size_t>(width);
+    for (int j = 0; j < height; j++) {
+        const uint8_t* row = pfm.data() + header + (height - 1 - j) * row_floats * sizeof(float);
+        for (size_t k = 0; k < row_floats; k++) {
+            uint8_t bytes[4];
+            std::memcpy(bytes, row + k * sizeof(float), 4);
+            if (swap) {
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+            }
+            std::memcpy(&rgb[j * row_floats + k], bytes, 4);
+        }
+    }
+    return true;
+}
+
+inline bool read_file(const std::string& path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline bool write_file(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return static_cast<bool>(file);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+/*
+Running per pixel radiance sums and sample counts for progressive rendering. Every sample
+seeds its own random stream from (seed, pixel, sample index), so the seed and the counts
+are the whole RNG state: a render resumed from a checkpoint draws exactly the samples an
+uninterrupted one would have. The checkpoint also keeps a hash of the scene and render
+settings the samples were taken with, so a resume only adds to samples of the same image.
+
+Alongside the sums each pixel keeps the Welford running M2 of its samples' luminance, from
+which adaptive sampling estimates how far the pixel's mean still is from converged.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../color.h"
+#include "film.h"
+
+class sample_buffer {
+public:
+    int width;
+    int height;
+    uint64_t seed;
+    uint64_t scene_hash = 0;      // Set by the renderer, see camera::checkpoint_hash
+    std::vector<double> sum;      // Radiance summed over samples, three per pixel
+    std::vector<uint32_t> count;  // Samples taken so far, also the next sample index
+    std::vector<double> m2;       // Sum of squared luminance deviations from the running mean
+
+    sample_buffer() : width(0), height(0), seed(0) {}
+    sample_buffer(int width, int height, uint64_t seed) :
+        width(width), height(height), seed(seed), sum(3 * size_t(width) * height, 0.0),
+        count(size_t(width) * height, 0), m2(size_t(width) * height, 0.0) {}
+
+    void add(int i, int j, const color& radiance) {
+        size_t p = size_t(j) * width + i;
+        double value = luminance(radiance);
+        double mean_before = count[p] > 0 ? mean_luminance(p) : 0.0;
+        sum[3 * p] += radiance.x;
+        sum[3 * p + 1] += radiance.y;
+        sum[3 * p + 2] += radiance.z;
+        count[p]++;
+        // Welford's update, the running mean itself comes from the sums
+        m2[p] += (value - mean_before) * (value - mean_luminance(p));
+    }
+
+    double mean_luminance(size_t p) const {
+        return luminance(vec3d(sum[3 * p], sum[3 * p + 1], sum[3 * p + 2], 0)) / count[p];
+    }
+
+    double display_error(int i, int j) const {
+        /*
+        Standard error of the pixel's mean luminance, carried through the display's gamma 2
+        (d sqrt(x) = dx / (2 sqrt(x))) so dark and bright pixels are judged by how visible
+        their noise is. Pixels with fewer than two samples have no estimate yet.
+        */
+        size_t p = size_t(j) * width + i;
+        if (count[p] < 2) return infinity;
+        double variance = m2[p] / (count[p] - 1);
+        double standard_error = std::sqrt(variance / count[p]);
+        return standard_error / (2 * std::sqrt(std::max(mean_luminance(p), 1e-4)));
+    }
+
+    uint32_t samples(int i, int j) const {
+        return count[size_t(j) * width + i];
+    }
+
+    uint64_t total_samples() const {
+        uint64_t total = 0;
+        for (uint32_t c : count) total += c;
+        return total;
+    }
+
+    uint32_t min_samples() const {
+        uint32_t lowest = UINT32_MAX;
+        for (uint32_t c : count) lowest = c < lowest ? c : lowest;
+        return count.empty() ? 0 : lowest;
+    }
+
+    void resolve(film& image) const {
+        // Writes the mean of each pixel's samples into the film
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t p = size_t(j) * width + i;
+                double scale = count[p] > 0 ? 1.0 / count[p] : 0.0;
+                image.set_pixel(i, j, scale * color(sum[3 * p], sum[3 * p + 1], sum[3 * p + 2], 0));
+            }
+        }
+    }
+
+    bool save(const std::string& path) const {
+        /*
+        Writes to a temporary file and renames it over the old checkpoint, so a job killed
+        mid write still leaves the previous checkpoint intact.
+        */
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary);
+            if (!file) return false;
+            const uint32_t header[2] = {checkpoint_magic, checkpoint_version};
+            const int32_t size[2] = {width, height};
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(size), sizeof(size));
+            file.write(reinterpret_cast<const char*>(&seed), sizeof(seed));
+            file.write(reinterpret_cast<const char*>(&scene_hash), sizeof(scene_hash));
+            file.write(reinterpret_cast<const char*>(count.data()), count.size() * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(sum.data()), sum.size() * sizeof(double));
+            file.write(reinterpret_cast<const char*>(m2.data()), m2.size() * sizeof(double));
+            if (!file) return false;
+        }
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            // Windows won't rename onto an existing file
+            std::remove(path.c_str());
+            return std::rename(temp_path.c_str(), path.c_str()) == 0;
+        }
+        return true;
+    }
+
+    bool load(const std::string& path) {
+        /*
+        Replaces this buffer with a saved checkpoint, returns false if there isn't a valid one.
+        The file has to be exactly as long as its header says, so a corrupt size can't make
+        this allocate more than the file holds or leave part of the buffer unread.
+        */
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+        uint64_t file_size = static_cast<uint64_t>(file.tellg());
+        file.seekg(0);
+        uint32_t header[2];
+        int32_t size[2];
+        uint64_t saved_seed, saved_hash;
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        file.read(reinterpret_cast<char*>(size), sizeof(size));
+        file.read(reinterpret_cast<char*>(&saved_seed), sizeof(saved_seed));
+        file.read(reinterpret_cast<char*>(&saved_hash), sizeof(saved_hash));
+        if (!file || header[0] != checkpoint_magic || header[1] != checkpoint_version || size[0] <= 0 || size[1] <= 0) {
+            return false;
+        }
+        uint64_t pixels = uint64_t(size[0]) * uint64_t(size[1]);
+        uint64_t header_bytes = sizeof(header) + sizeof(size) + sizeof(saved_seed) + sizeof(saved_hash);
+        uint64_t pixel_bytes = sizeof(uint32_t) + 3 * sizeof(double) + sizeof(double);
+        if (pixels > (file_size - header_bytes) / pixel_bytes || header_bytes + pixels * pixel_bytes != file_size) {
+            return false;
+        }
+        sample_buffer loaded(size[0], size[1], saved_seed);
+        loaded.scene_hash = saved_hash;
+        file.read(reinterpret_cast<char*>(loaded.count.data()), loaded.count.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(loaded.sum.data()), loaded.sum.size() * sizeof(double));
+        file.read(reinterpret_cast<char*>(loaded.m2.data()), loaded.m2.size() * sizeof(double));
+        if (!file) return false;
+        *this = std::move(loaded);
+        return true;
+    }
+
+private:
+    static constexpr uint32_t checkpoint_magic = 0x4b435452;  // "RTCK" read little endian
+    static constexpr uint32_t checkpoint_version = 3;
+};
+
+#endif
@@ -1,22 +1,27 @@
 #ifndef BOUNDS_H
 #define BOUNDS_H
 
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include "vec3.h"
 #include "math.h"
 
-struct Bounds3f {
-    vec3h pmin, pmax;
+template <typename T>
+struct Bounds3 {
+    vec3h_t<T> pmin, pmax;
 
-    Bounds3f() : pmin(vec3h{infinity, infinity, infinity, 1}), pmax(vec3h{-1.0 * infinity, -1.0 * infinity, -1.0 * infinity, 1}) {}
+    Bounds3() : pmin(vec3h_t<T>(infinity, infinity, infinity, 1)), pmax(vec3h_t<T>(-1.0 * infinity, -1.0 * infinity, -1.0 * infinity, 1)) {}
 
     // Constructor to create bounds from min and max points
-    Bounds3f(const vec3h& p1, const vec3h& p2){
+    Bounds3(const vec3h_t<T>& p1, const vec3h_t<T>& p2){
         pmin = vec_min(p1, p2);
         pmax = vec_max(p1, p2);
     }
 
     // Example: Expanding the bounding box to include a point
-    void expand(const vec3h& p) {
+    void expand(const vec3h_t<T>& p) {
         pmin.x = std::min(pmin.x, p.x);
         pmin.y = std::min(pmin.y, p.y);
         pmin.z = std::min(pmin.z, p.z);
@@ -27,58 +32,58 @@ struct Bounds3f {
     }
 
     // Example: Checking if a point is inside the bounds
-    bool contains(const vec3h& p) const {
+    bool contains(const vec3h_t<T>& p) const {
         return (p.x >= pmin.x && p.x <= pmax.x &&
                 p.y >= pmin.y && p.y <= pmax.y &&
                 p.z >= pmin.z && p.z <= pmax.z);
     }
 
-    vec3h diagonal() const { return pmax - pmin; }
+    vec3h_t<T> diagonal() const { return pmax - pmin; }
 
-    double surface_area() const {
-        vec3h d = diagonal();
+    T surface_area() const {
+        vec3h_t<T> d = diagonal();
         return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
     }
 
-    double inverse_surface_area() const {
+    T inverse_surface_area() const {
         // SAH cost function divides by surface area. might as well just inverse here and multiply
         return 1.0 / (surface_area() > 1e-6f ? surface_area() : 1.0e-6);
     }
 
-    double volume() const {
-        vec3h d = diagonal();
+    T volume() const {
+        vec3h_t<T> d = diagonal();
         return d.x * d.y * d.z;
     }
 
-    vec3h lerp_point(vec3h t) const {
-        return vec3h(
+    vec3h_t<T> lerp_point(vec3h_t<T> t) const {
+        return vec3h_t<T>(
             lerp(pmin.x, pmax.x, t.x),
             lerp(pmin.y, pmax.y, t.y),
             lerp(pmin.z, pmax.z, t.z), 1);
     }
 
     int max_dimen() const {
-        vec3h d = diagonal();
+        vec3h_t<T> d = diagonal();
         if (d.x > d.y && d.x > d.z) return 0;
         else if (d.y > d.z)         return 1;
         else                        return 2;
     }
 
-    double axis_length(int axis) const {
-        vec3h p_axis = pmax - pmin;
+    T axis_length(int axis) const {
+        vec3h_t<T> p_axis = pmax - pmin;
         if (axis == 0) return p_axis.x;
         if (axis == 1) return p_axis.y;
         if (axis == 2) return p_axis.z;
         throw std::out_of_range("Invalid axis: must be 0, 1, or 2.");
     }
 
-    bool intersect(const ray &r, interval ray_t) const {
+    bool intersect(const ray_t<T> &r, interval ray_t) const {
         /*
         A modified version of Smit's algorithm by Amy William et al. 
         An Efficient and Robust Ray–Box Intersection Algorithm 
         */
 
-        double t1, t2, tmin, tmax;
+        T t1, t2, tmin, tmax;
         // Check for intersection along the X-axis
         t1 = (pmin.x - r.origin().x) * r.inv_direction().x;
         t2 = (pmax.x - r.origin().x) * r.inv_direction().x;
@@ -110,15 +115,19 @@ struct Bounds3f {
         tmax = std::min(tmax, t2);
 
         // If the ray doesn't intersect along the Z-axis, return false
-        return ((tmin < ray_t.max) && (tmax > ray_t.min));
+        return (tmin <= tmax) && (tmin < ray_t.max) && (tmax > ray_t.min);
     }
 };
 
-Bounds3f bounds_intersection(const Bounds3f& b1, const Bounds3f& b2) {
-    return Bounds3f(vec_max(b1.pmin, b2.pmin), vec_min(b1.pmax, b2.pmax));
+using Bounds3f = Bounds3<Float>;
+
+template <typename T>
+Bounds3<T> bounds_intersection(const Bounds3<T>& b1, const Bounds3<T>& b2) {
+    return Bounds3<T>(vec_max(b1.pmin, b2.pmin), vec_min(b1.pmax, b2.pmax));
 }
 
-bool bounds_overlaps(const Bounds3f& b1, const Bounds3f& b2) {
+template <typename T>
+bool bounds_overlaps(const Bounds3<T>& b1, const Bounds3<T>& b2) {
     bool x = (b1.pmax.x >= b2.pmin.x) && (b1.pmin.x <= b2.pmax.x);
     bool y = (b1.pmax.y >= b2.pmin.y) && (b1.pmin.y <= b2.pmax.y);
     bool z = (b1.pmax.z >= b2.pmin.z) && (b1.pmin.z <= b2.pmax.z);
@@ -126,18 +135,130 @@ bool bounds_overlaps(const Bounds3f& b1, const Bounds3f& b2) {
 }
 
 
-Bounds3f Union(const Bounds3f &b, vec3h& p) {
-    Bounds3f ret;
+template <typename T>
+Bounds3<T> Union(const Bounds3<T> &b, vec3h_t<T>& p) {
+    Bounds3<T> ret;
     ret.pmin = vec_min(b.pmin, p);
     ret.pmax = vec_max(b.pmax, p);
     return ret;
 }
 
-Bounds3f Union(const Bounds3f &b1, const Bounds3f& b2) {
-    vec3h newMin = vec_min(b1.pmin, b2.pmin);
-    vec3h newMax = vec_max(b1.pmax, b2.pmax);
-    return Bounds3f(newMin, newMax);
+template <typename T>
+Bounds3<T> Union(const Bounds3<T> &b1, const Bounds3<T>& b2) {
+    vec3h_t<T> newMin = vec_min(b1.pmin, b2.pmin);
+    vec3h_t<T> newMax = vec_max(b1.pmax, b2.pmax);
+    return Bounds3<T>(newMin, newMax);
 }
 
 
+/*
+BVH nodes keep their boxes in single precision, 24 bytes instead of a double Bounds3f's 64, and test
+them with a single precision copy of the ray. Nothing the double test would hit is missed:
+- boxes are rounded outward when converted,
+- the ray origin is rounded twice, towards the box for near planes and away from it for far
+  planes, so the rounded origins can only widen the slab interval,
+- far distances are scaled up by pbrt's 1 + 2 gamma(3) bound on the slab arithmetic.
+Primitive tests stay in double.
+*/
+constexpr float float_gamma3 = (3 * 0.5f * FLT_EPSILON) / (1 - 3 * 0.5f * FLT_EPSILON);
+constexpr float box_far_scale = 1 + 2 * float_gamma3;
+
+inline float next_float_up(float f) {
+    // Neighbouring float towards +infinity by stepping the bit pattern, f must not be +infinity or NaN
+    if (f == 0) return std::numeric_limits<float>::denorm_min();
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    bits += f > 0 ? 1 : -1;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline float next_float_down(float f) {
+    // Neighbouring float towards -infinity, f must not be -infinity or NaN
+    if (f == 0) return -std::numeric_limits<float>::denorm_min();
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    bits += f > 0 ? -1 : 1;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline float round_down(double v) {
+    float f = static_cast<float>(v);
+    return (f > v) ? next_float_down(f) : f;
+}
+
+inline float round_up(double v) {
+    float f = static_cast<float>(v);
+    return (f < v) ? next_float_up(f) : f;
+}
+
+inline void round_outward(double v, float& down, float& up) {
+    // round_down and round_up of v from a single conversion
+    float f = static_cast<float>(v);
+    down = (f > v) ? next_float_down(f) : f;
+    up = (f < v) ? next_float_up(f) : f;
+}
+
+struct ray_float {
+    /* Rounded origins and reciprocal direction of a ray, made once per traversal for the box tests */
+    float near_ox, near_oy, near_oz;  // Origin for near planes, moved along the ray
+    float far_ox, far_oy, far_oz;     // Origin for far planes, moved against it
+    float ix, iy, iz;
+    bool sign_x, sign_y, sign_z;
+
+    explicit ray_float(const ray& r)
+        : ix(static_cast<float>(r.inv_direction().x)), iy(static_cast<float>(r.inv_direction().y)), iz(static_cast<float>(r.inv_direction().z)),
+          sign_x(r.sign_x()), sign_y(r.sign_y()), sign_z(r.sign_z()) {
+        const vec3h& o = r.origin();
+        float down, up;
+        round_outward(o.x, down, up);
+        near_ox = sign_x ? up : down;
+        far_ox = sign_x ? down : up;
+        round_outward(o.y, down, up);
+        near_oy = sign_y ? up : down;
+        far_oy = sign_y ? down : up;
+        round_outward(o.z, down, up);
+        near_oz = sign_z ? up : down;
+        far_oz = sign_z ? down : up;
+    }
+};
+
+struct CompactBounds {
+    vec3f pmin, pmax;
+
+    CompactBounds()
+        : pmin(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()),
+          pmax(-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()) {}
+
+    explicit CompactBounds(const Bounds3f& b)
+        : pmin(round_down(b.pmin.x), round_down(b.pmin.y), round_down(b.pmin.z)),
+          pmax(round_up(b.pmax.x), round_up(b.pmax.y), round_up(b.pmax.z)) {}
+
+    Bounds3f to_bounds() const {
+        return Bounds3f(pmin, pmax);
+    }
+
+    bool contains(const vec3f& p) const {
+        return (p.x >= pmin.x && p.x <= pmax.x &&
+                p.y >= pmin.y && p.y <= pmax.y &&
+                p.z >= pmin.z && p.z <= pmax.z);
+    }
+
+    double surface_area() const {
+        return to_bounds().surface_area();
+    }
+
+    bool intersect(const ray_float& r, float t_min, float t_max) const {
+        // Slab test with near and far planes picked by the ray's sign bits
+        float t0 = std::max(std::max(((r.sign_x ? pmin.x : pmax.x) - r.near_ox) * r.ix,
+                                     ((r.sign_y ? pmin.y : pmax.y) - r.near_oy) * r.iy),
+                            std::max(((r.sign_z ? pmin.z : pmax.z) - r.near_oz) * r.iz, t_min));
+        float t1 = std::min(std::min(((r.sign_x ? pmax.x : pmin.x) - r.far_ox) * r.ix,
+                                     ((r.sign_y ? pmax.y : pmin.y) - r.far_oy) * r.iy),
+                            ((r.sign_z ? pmax.z : pmin.z) - r.far_oz) * r.iz) * box_far_scale;
+        return t0 <= std::min(t1, t_max);
+    }
+};
+
 #endif
\ No newline at end of file
@@ -6,10 +6,10 @@
 #include <iostream>
 #include "vec3.h"
 
-template <int N>
+template <int N, typename T = Float>
 class squareMatrix {
 public:
-    double matrix[N][N];
+    T matrix[N][N];
     squareMatrix() {
         // Default constructor is identity matrix
         for (int i = 0; i < N; ++i){
@@ -19,7 +19,7 @@ public:
         }
     }
 
-    squareMatrix(double x) {
+    squareMatrix(T x) {
         // Fills the entire matrix with entry x
         // let x = 0 for the zero matrix
         for (int i = 0; i < N; ++i){
@@ -29,7 +29,7 @@ public:
         }
     }
 
-    squareMatrix(const double m[N][N]) {
+    squareMatrix(const T m[N][N]) {
         // Fills the entire matrix with entry x
         // let x = 0 for the zero matrix
         for (int i = 0; i < N; ++i){
@@ -68,7 +68,7 @@ public:
 
     
     squareMatrix operator*(squareMatrix& m) {
-        squareMatrix ret;
+        squareMatrix ret(0.0); // Accumulates, so it starts from zero rather than identity
         for (int i = 0; i < N; ++i){
             for (int j = 0; j < N; ++j) {
                 for (int k = 0; k < N; ++k){
@@ -79,7 +79,7 @@ public:
         return ret;
     }
 
-    squareMatrix operator*(double x) {
+    squareMatrix operator*(T x) {
         squareMatrix ret = *this;
         for (int i = 0; i < N; ++i){
             for (int j = 0; j < N; ++j) {
@@ -89,7 +89,7 @@ public:
         return ret;
     }
 
-    squareMatrix operator/(double x) {
+    squareMatrix operator/(T x) {
         if (x == 0.0) {
             throw std::invalid_argument("Division by zero is not allowed.");
         }
@@ -102,25 +102,18 @@ public:
         return ret;
     }
 
-    double* operator[](int row) {
+    T* operator[](int row) {
         return matrix[row];  // Return a pointer to the row
     }
 
     // Const version for read-only access
-    const double* operator[](int row) const {
+    const T* operator[](int row) const {
         return matrix[row];  // Return a pointer to the row
     }
 };
 
-template <int N>
-inline squareMatrix<N> inverse(const squareMatrix<N> &m);
-
-template <int N>
-inline squareMatrix<N> operator*(const squareMatrix<N> &m1,
-                                              const squareMatrix<N> &m2);
-
-template <int N>
-inline squareMatrix<N> transpose(squareMatrix<N>& m) {
+template <int N, typename T>
+inline squareMatrix<N, T> transpose(squareMatrix<N, T>& m) {
     for (int i = 0; i < N; ++i) {
         for (int j = i + 1; j < N; ++j) {
             std::swap(m[i][j], m[j][i]);
@@ -129,72 +122,85 @@ inline squareMatrix<N> transpose(squareMatrix<N>& m) {
     return m;
 };
 
-inline double determinant_2x2(double a, double d, double c, double b) {
+template <typename T>
+inline T sum_of_products(T a, T b, T c, T d, T e, T f) {
+    // a*b + c*d + e*f, the operands come in pairs unlike dot() which takes two xyz triples
+    return a * b + c * d + e * f;
+}
+
+template <typename T>
+inline T sum_of_products(T a, T b, T c, T d, T e, T f, T g, T h) {
+    return a * b + c * d + e * f + g * h;
+}
+
+template <typename T>
+inline T determinant_2x2(T a, T d, T c, T b) {
     return a*d - c*b;
 }
 
-template <>
-inline squareMatrix<4> inverse(const squareMatrix<4> &m) {
+template <typename T>
+inline squareMatrix<4, T> inverse(const squareMatrix<4, T> &m) {
     // Via: https://github.com/google/ion/blob/master/ion/math/matrixutils.cc,
     // (c) Google, Apache license.
-    double s0 = determinant_2x2(m[0][0], m[1][1], m[1][0], m[0][1]);
-    double s1 = determinant_2x2(m[0][0], m[1][2], m[1][0], m[0][2]);
-    double s2 = determinant_2x2(m[0][0], m[1][3], m[1][0], m[0][3]);
+    T s0 = determinant_2x2(m[0][0], m[1][1], m[1][0], m[0][1]);
+    T s1 = determinant_2x2(m[0][0], m[1][2], m[1][0], m[0][2]);
+    T s2 = determinant_2x2(m[0][0], m[1][3], m[1][0], m[0][3]);
 
-    double s3 = determinant_2x2(m[0][1], m[1][2], m[1][1], m[0][2]);
-    double s4 = determinant_2x2(m[0][1], m[1][3], m[1][1], m[0][3]);
-    double s5 = determinant_2x2(m[0][2], m[1][3], m[1][2], m[0][3]);
+    T s3 = determinant_2x2(m[0][1], m[1][2], m[1][1], m[0][2]);
+    T s4 = determinant_2x2(m[0][1], m[1][3], m[1][1], m[0][3]);
+    T s5 = determinant_2x2(m[0][2], m[1][3], m[1][2], m[0][3]);
 
-    double c0 = determinant_2x2(m[2][0], m[3][1], m[3][0], m[2][1]);
-    double c1 = determinant_2x2(m[2][0], m[3][2], m[3][0], m[2][2]);
-    double c2 = determinant_2x2(m[2][0], m[3][3], m[3][0], m[2][3]);
+    T c0 = determinant_2x2(m[2][0], m[3][1], m[3][0], m[2][1]);
+    T c1 = determinant_2x2(m[2][0], m[3][2], m[3][0], m[2][2]);
+    T c2 = determinant_2x2(m[2][0], m[3][3], m[3][0], m[2][3]);
 
-    double c3 = determinant_2x2(m[2][1], m[3][2], m[3][1], m[2][2]);
-    double c4 = determinant_2x2(m[2][1], m[3][3], m[3][1], m[2][3]);
-    double c5 = determinant_2x2(m[2][2], m[3][3], m[3][2], m[2][3]);
+    T c3 = determinant_2x2(m[2][1], m[3][2], m[3][1], m[2][2]);
+    T c4 = determinant_2x2(m[2][1], m[3][3], m[3][1], m[2][3]);
+    T c5 = determinant_2x2(m[2][2], m[3][3], m[3][2], m[2][3]);
 
     // Calculate the determinant
-    double determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    T determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
     if (determinant == 0)
         return {}; // Return empty matrix if determinant is 0 (singular matrix)
-    double s = 1.0 / determinant;
+    T s = 1.0 / determinant;
 
-    double inv[4][4] = {{s * dot(m[1][1], c5, m[1][3], c3, -m[1][2], c4),
-                        s * dot(-m[0][1], c5, m[0][2], c4, -m[0][3], c3),
-                        s * dot(m[3][1], s5, m[3][3], s3, -m[3][2], s4),
-                        s * dot(-m[2][1], s5, m[2][2], s4, -m[2][3], s3)},
+    T inv[4][4] = {{s * sum_of_products(m[1][1], c5, m[1][3], c3, -m[1][2], c4),
+                        s * sum_of_products(-m[0][1], c5, m[0][2], c4, -m[0][3], c3),
+                        s * sum_of_products(m[3][1], s5, m[3][3], s3, -m[3][2], s4),
+                        s * sum_of_products(-m[2][1], s5, m[2][2], s4, -m[2][3], s3)},
 
-                       {s * dot(-m[1][0], c5, m[1][2], c2, -m[1][3], c1),
-                        s * dot(m[0][0], c5, m[0][3], c1, -m[0][2], c2),
-                        s * dot(-m[3][0], s5, m[3][2], s2, -m[3][3], s1),
-                        s * dot(m[2][0], s5, m[2][3], s1, -m[2][2], s2)},
+                       {s * sum_of_products(-m[1][0], c5, m[1][2], c2, -m[1][3], c1),
+                        s * sum_of_products(m[0][0], c5, m[0][3], c1, -m[0][2], c2),
+                        s * sum_of_products(-m[3][0], s5, m[3][2], s2, -m[3][3], s1),
+                        s * sum_of_products(m[2][0], s5, m[2][3], s1, -m[2][2], s2)},
 
-                       {s * dot(m[1][0], c4, m[1][3], c0, -m[1][1], c2),
-                        s * dot(-m[0][0], c4, m[0][1], c2, -m[0][3], c0),
-                        s * dot(m[3][0], s4, m[3][3], s0, -m[3][1], s2),
-                        s * dot(-m[2][0], s4, m[2][1], s2, -m[2][3], s0)},
+                       {s * sum_of_products(m[1][0], c4, m[1][3], c0, -m[1][1], c2),
+                        s * sum_of_products(-m[0][0], c4, m[0][1], c2, -m[0][3], c0),
+                        s * sum_of_products(m[3][0], s4, m[3][3], s0, -m[3][1], s2),
+                        s * sum_of_products(-m[2][0], s4, m[2][1], s2, -m[2][3], s0)},
 
-                       {s * dot(-m[1][0], c3, m[1][1], c1, -m[1][2], c0),
-                        s * dot(m[0][0], c3, m[0][2], c0, -m[0][1], c1),
-                        s * dot(-m[3][0], s3, m[3][1], s1, -m[3][2], s0),
-                        s * dot(m[2][0], s3, m[2][2], s0, -m[2][1], s1)}};
+                       {s * sum_of_products(-m[1][0], c3, m[1][1], c1, -m[1][2], c0),
+                        s * sum_of_products(m[0][0], c3, m[0][2], c0, -m[0][1], c1),
+                        s * sum_of_products(-m[3][0], s3, m[3][1], s1, -m[3][2], s0),
+                        s * sum_of_products(m[2][0], s3, m[2][2], s0, -m[2][1], s1)}};
 
-    return squareMatrix<4>(inv);
+    return squareMatrix<4, T>(inv);
 }
 
-template <>
-inline squareMatrix<4> operator*(const squareMatrix<4> &m1,
-                                              const squareMatrix<4> &m2) {
-    squareMatrix<4> r;
+template <typename T>
+inline squareMatrix<4, T> operator*(const squareMatrix<4, T> &m1,
+                                    const squareMatrix<4, T> &m2) {
+    squareMatrix<4, T> r;
     for (int i = 0; i < 4; ++i)
         for (int j = 0; j < 4; ++j)
-            r[i][j] = dot(m1[i][0], m2[0][j], m1[i][1], m2[1][j], m1[i][2],
+            r[i][j] = sum_of_products(m1[i][0], m2[0][j], m1[i][1], m2[1][j], m1[i][2],
                 m2[2][j], m1[i][3], m2[3][j]);
     return r;
 }
 
-inline vec3h operator*(const vec3h &u, const squareMatrix<4> &m) {
-    vec3h v;
+template <typename T>
+inline vec3h_t<T> operator*(const vec3h_t<T> &u, const squareMatrix<4, T> &m) {
+    vec3h_t<T> v;
     v.x = m[0][0] * u.x + m[0][1] * u.y + m[0][2] * u.z + m[0][3] * u.w;
     v.y = m[1][0] * u.x + m[1][1] * u.y + m[1][2] * u.z + m[1][3] * u.w;
     v.z = m[2][0] * u.x + m[2][1] * u.y + m[2][2] * u.z + m[2][3] * u.w;
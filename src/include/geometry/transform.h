@@ -7,40 +7,66 @@ General transformation utils for generating a transformation matrix
 #include "matrix.h"
 #include "vec3.h"
 
-class transform {
+template <typename T>
+class transform_t {
 public:
-    transform();
-    transform(const squareMatrix<4>& m) : m(m) {}
-    transform& operator=(const transform& t1) {
+    transform_t();
+    transform_t(const squareMatrix<4, T>& m) : m(m) {}
+    transform_t& operator=(const transform_t& t1) {
         if (this != &t1) {
             m = t1.m;
         }
         return *this;
     }
-    squareMatrix<4> m;
+    squareMatrix<4, T> m;
 };
 
-vec3h apply_transform(squareMatrix<4> &transform, vec3h u) {
+using transform = transform_t<Float>;
+
+template <typename T>
+vec3h_t<T> apply_transform(const squareMatrix<4, T> &transform, vec3h_t<T> u) {
     return u*transform;
 }
 
-transform combine_transform(transform &t1, transform &t2) {
-    return transform(t1.m * t2.m);
+template <typename T>
+transform_t<T> inverse(const transform_t<T> &t) {
+    return transform_t<T>(inverse(t.m));
+}
+
+template <typename T>
+vec3h_t<T> apply_normal_transform(const squareMatrix<4, T> &inverse_transform, const vec3h_t<T>& n) {
+    /*
+    Normals go through the inverse transpose to stay perpendicular to the surface under
+    non uniform scales. Takes the inverse of the transform applied to the points.
+    */
+    const squareMatrix<4, T> &m = inverse_transform;
+    return vec3h_t<T>(
+        m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+        m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+        m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z,
+        0);
+}
+
+template <typename T>
+transform_t<T> combine_transform(transform_t<T> &t1, transform_t<T> &t2) {
+    return transform_t<T>(t1.m * t2.m);
 }
 
-transform combine_transform(transform &t1, transform &t2, transform &t3) {
-    return transform(t1.m * t2.m * t3.m);
+template <typename T>
+transform_t<T> combine_transform(transform_t<T> &t1, transform_t<T> &t2, transform_t<T> &t3) {
+    return transform_t<T>(t1.m * t2.m * t3.m);
 }
 
-transform combine_transform(transform &t1, transform &t2, transform &t3, transform &t4) {
-    return transform(t1.m * t2.m * t3.m * t4.m);
+template <typename T>
+transform_t<T> combine_transform(transform_t<T> &t1, transform_t<T> &t2, transform_t<T> &t3, transform_t<T> &t4) {
+    return transform_t<T>(t1.m * t2.m * t3.m * t4.m);
 }
 
 transform translate(vec3h delta) {
     /*
     Generates a matrix transform that will translate a point vector by the delta vector.
     */
-    const double m[4][4] = {
+    const Float m[4][4] = {
         {1, 0, 0, delta.x},
         {0, 1, 0, delta.y},
         {0, 0, 1, delta.z},
@@ -49,11 +75,11 @@ transform translate(vec3h delta) {
     return transform(squareMatrix<4>(m));
 }
 
-transform scale(double x, double y, double z) {
+transform scale(Float x, Float y, Float z) {
     /*
     Generates a matrix transform that applies a scale to the three axis' of a vector. 
     */
-    const double m[4][4] = {
+    const Float m[4][4] = {
         {x, 0, 0, 0},
         {0, y, 0, 0},
         {0, 0, z, 0},
@@ -62,14 +88,14 @@ transform scale(double x, double y, double z) {
     return transform(squareMatrix<4>(m));
 }
 
-transform rotateX(double theta) {
+transform rotateX(Float theta) {
     /*
     Generates a matrix transform that applies a rotation about the 'x' axis. 
     Expects angle to be in radians
     */
-    double sin_theta = std::sin(theta);
-    double cos_theta = std::cos(theta);
-    const double m[4][4] = {
+    Float sin_theta = std::sin(theta);
+    Float cos_theta = std::cos(theta);
+    const Float m[4][4] = {
         {1, 0,         0,          0},
         {0, cos_theta, -sin_theta, 0},
         {0, sin_theta, cos_theta,  0},
@@ -78,14 +104,14 @@ transform rotateX(double theta) {
     return transform(squareMatrix<4>(m));
 }
 
-transform rotateY(double theta) {
+transform rotateY(Float theta) {
     /*
     Generates a matrix transform that applies a rotation about the 'y' axis. 
     Expects angle to be in radians
     */
-    double sin_theta = std::sin(theta);
-    double cos_theta = std::cos(theta);
-    const double m[4][4] = {
+    Float sin_theta = std::sin(theta);
+    Float cos_theta = std::cos(theta);
+    const Float m[4][4] = {
         {cos_theta,  0, sin_theta, 0},
         {0,          1, 0,         0},
         {-sin_theta, 0, cos_theta, 0},
@@ -94,14 +120,14 @@ transform rotateY(double theta) {
     return transform(squareMatrix<4>(m));
 }
 
-transform rotateZ(double theta) {
+transform rotateZ(Float theta) {
     /*
     Generates a matrix transform that applies a rotation about the 'z' axis. 
     Expects angle to be in radians
     */
-    double sin_theta = std::sin(theta);
-    double cos_theta = std::cos(theta);
-    const double m[4][4] = {
+    Float sin_theta = std::sin(theta);
+    Float cos_theta = std::cos(theta);
+    const Float m[4][4] = {
         {cos_theta, -sin_theta, 0, 0},
         {sin_theta, cos_theta,  0, 0},
         {0,         0,          1, 0},
@@ -110,20 +136,20 @@ transform rotateZ(double theta) {
     return transform(squareMatrix<4>(m));
 }
 
-transform rotateAxis(vec3h axis, double theta) {
+transform rotateAxis(vec3h axis, Float theta) {
     /*
     Generates a matrix transform that applies a rotation about the 'axis' axis. 
      */
     axis = axis.normal_of(); // Ensure the axis is a unit vector
-    double sin_theta = std::sin(theta);
-    double cos_theta = std::cos(theta);
-    double one_minus_cos = 1.0 - cos_theta;
+    Float sin_theta = std::sin(theta);
+    Float cos_theta = std::cos(theta);
+    Float one_minus_cos = 1.0 - cos_theta;
 
-    const double x = axis.x;
-    const double y = axis.y;
-    const double z = axis.z;
+    const Float x = axis.x;
+    const Float y = axis.y;
+    const Float z = axis.z;
 
-    const double m[4][4] = {
+    const Float m[4][4] = {
         {cos_theta + x * x * one_minus_cos,      x * y * one_minus_cos - z * sin_theta, x * z * one_minus_cos + y * sin_theta, 0},
         {y * x * one_minus_cos + z * sin_theta, cos_theta + y * y * one_minus_cos,      y * z * one_minus_cos - x * sin_theta, 0},
         {z * x * one_minus_cos - y * sin_theta, z * y * one_minus_cos + x * sin_theta, cos_theta + z * z * one_minus_cos,      0},
@@ -138,7 +164,7 @@ transform lookAt(vec3h pos, vec3h look, vec3h up) {
     vec3h right = (cross_product(up, forward)).normal_of();
     vec3h new_up = cross_product(forward, right);
 
-    const double m[4][4] = {
+    const Float m[4][4] = {
         {right.x,   right.y,   right.z,   -dot(right, pos)},
         {new_up.x,  new_up.y,  new_up.z,  -dot(new_up, pos)},
         {forward.x, forward.y, forward.z, -dot(forward, pos)},
@@ -147,9 +173,9 @@ transform lookAt(vec3h pos, vec3h look, vec3h up) {
     return transform(squareMatrix<4>(m));
 }
 
-transform orthographic(double znear, double zfar) {
-    double depth = zfar - znear;
-    const double m[4][4] = {
+transform orthographic(Float znear, Float zfar) {
+    Float depth = zfar - znear;
+    const Float m[4][4] = {
         {1, 0, 0, 0},
         {0, 1, 0, 0},
         {0, 0, -2 / depth, -(zfar + znear) / depth},
@@ -158,11 +184,11 @@ transform orthographic(double znear, double zfar) {
     return transform(squareMatrix<4>(m));
 }
 
-transform perspective(double fov, double znear, double zfar) {
-    double tan_half_fov = std::tan(fov / 2.0);
-    double depth = zfar - znear;
+transform perspective(Float fov, Float znear, Float zfar) {
+    Float tan_half_fov = std::tan(fov / 2.0);
+    Float depth = zfar - znear;
 
-    const double m[4][4] = {
+    const Float m[4][4] = {
         {1 / tan_half_fov, 0, 0, 0},
         {0, 1 / tan_half_fov, 0, 0},
         {0, 0, -(zfar + znear) / depth, -2 * zfar * znear / depth},
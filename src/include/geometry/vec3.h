@@ -11,26 +11,29 @@ if w is 1, then the object is a point. If w is 0, it is a vector direction.
 #include <iostream>
 #include "../utils.h"
 
-class vec3h {
+template <typename T>
+class vec3h_t {
   public:
-    double x,y,z,w;
+    T x,y,z,w;
 
-    vec3h() : x(0.0), y(0.0), z(0.0), w(0.0) {};
-    vec3h(double x0, double y0, double z0, double w0) : x(x0), y(y0), z(z0), w(w0) {};
-    vec3h(double x0, double y0, double z0) : x(x0), y(y0), z(z0), w(0.0) {};
+    vec3h_t() : x(0.0), y(0.0), z(0.0), w(0.0) {};
+    vec3h_t(T x0, T y0, T z0, T w0) : x(x0), y(y0), z(z0), w(w0) {};
+    vec3h_t(T x0, T y0, T z0) : x(x0), y(y0), z(z0), w(0.0) {};
+    template <typename U>
+    explicit vec3h_t(const vec3h_t<U>& v) : x(v.x), y(v.y), z(v.z), w(v.w) {};
 
-    double magnitude() const {
+    T magnitude() const {
         return std::sqrt(x * x + y * y + z * z);
     }
 
-    double operator[](int axis) const {
+    T operator[](int axis) const {
         if (axis == 0) return x;
         if (axis == 1) return y;
         if (axis == 2) return z;
         throw std::out_of_range("Invalid axis: must be 0, 1, or 2.");
     }
-    vec3h operator-() const { return vec3h(-x, -y, -z, w); }
-    vec3h& operator+=(const vec3h& v) {
+    vec3h_t operator-() const { return vec3h_t(-x, -y, -z, w); }
+    vec3h_t& operator+=(const vec3h_t& v) {
         // Adds a vector onto the current vector
         x += v.x; 
         y += v.y;  
@@ -38,7 +41,7 @@ class vec3h {
         return *this;
     }
 
-    vec3h& operator*=(double t) {
+    vec3h_t& operator*=(T t) {
         // Scales the vector by a constant
         x *= t;
         y *= t;
@@ -46,30 +49,30 @@ class vec3h {
         return *this;
     }
 
-    vec3h& operator/=(double t) {
+    vec3h_t& operator/=(T t) {
         if (t != 0) { // Handle division by zero
             return *this *= 1 / t;
         }
         return *this;
     }
 
-    bool operator==(const vec3h&u) {
+    bool operator==(const vec3h_t&u) const {
         if (x == u.x && y == u.y && z == u.z) {
             return true;
         }
         return false;
     }
-    bool operator!=(vec3h&u) {
+    bool operator!=(vec3h_t&u) {
         if (x != u.x || y != u.y || z != u.z) {
             return true;
         }
         return false;
     }
 
-    vec3h normal_of() const {
-        double mag = magnitude();
-        if (mag > 0.0) { return vec3h(x / mag, y / mag, z / mag, w);}
-        return vec3h();
+    vec3h_t normal_of() const {
+        T mag = magnitude();
+        if (mag > 0.0) { return vec3h_t(x / mag, y / mag, z / mag, w);}
+        return vec3h_t();
     }
 
     
@@ -83,31 +86,61 @@ class vec3h {
         else if (y > z)     return 1;
         else                return 2;
     }
+
+    // Arithmetic is defined as friends so scalars of another type convert to T
+
+    friend vec3h_t operator+(const vec3h_t& u, const vec3h_t& v) {
+        return vec3h_t(u.x + v.x, u.y + v.y, u.z + v.z, std::max(u.w, v.w));
+    }
+
+    friend vec3h_t operator-(const vec3h_t& u, const vec3h_t& v) {
+        return vec3h_t(u.x - v.x, u.y - v.y, u.z - v.z, std::max(u.w, v.w));
+    }
+
+    friend vec3h_t operator*(const T t, const vec3h_t& u) {
+        return vec3h_t(u.x * t, u.y * t, u.z * t, u.w);
+    }
+
+    friend vec3h_t operator/(const vec3h_t& u, const T t) {
+        return vec3h_t(u.x / t, u.y / t, u.z / t, u.w);
+    }
 };
 
-// Vector Utility Functions
+using vec3h = vec3h_t<Float>;
+using vec3d = vec3h_t<double>;  // Double whatever Float is, for tests that need it to stay robust
 
-inline std::ostream& operator<<(std::ostream& out, const vec3h& v) {
-    return out << v.x << ' ' << v.y << ' ' << v.z;
-}
+struct vec3f {
+    /*
+    Single precision point for storage, 12 bytes against a double vec3h's 32. Nothing is
+    computed in it: a vec3f converts to a vec3h point when loaded, so vertex data is half the
+    memory and the math keeps its precision.
+    */
+    float x, y, z;
 
-inline vec3h operator+(const vec3h& u, const vec3h& v) {
-    return vec3h(u.x + v.x, u.y + v.y, u.z + v.z, std::max(u.w, v.w));
-}
+    vec3f() : x(0.0f), y(0.0f), z(0.0f) {}
+    vec3f(float x0, float y0, float z0) : x(x0), y(y0), z(z0) {}
+    explicit vec3f(const vec3h& p) : x(static_cast<float>(p.x)), y(static_cast<float>(p.y)), z(static_cast<float>(p.z)) {}
 
-inline vec3h operator-(const vec3h& u, const vec3h& v) {
-    return vec3h(u.x - v.x, u.y - v.y, u.z - v.z, std::max(u.w, v.w));
-}
+    template <typename T>
+    operator vec3h_t<T>() const { return vec3h_t<T>(x, y, z, 1); }
 
-inline vec3h operator*(const double t, const vec3h& u) {
-    return vec3h(u.x * t, u.y * t, u.z * t, u.w);
-}
+    float operator[](int axis) const {
+        if (axis == 0) return x;
+        if (axis == 1) return y;
+        if (axis == 2) return z;
+        throw std::out_of_range("Invalid axis: must be 0, 1, or 2.");
+    }
+};
+
+// Vector Utility Functions
 
-inline vec3h operator/(const vec3h& u, const double t) {
-    return vec3h(u.x / t, u.y / t, u.z / t, u.w);
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const vec3h_t<T>& v) {
+    return out << v.x << ' ' << v.y << ' ' << v.z;
 }
 
-double dot(const vec3h& u, const vec3h& v) {
+template <typename T>
+T dot(const vec3h_t<T>& u, const vec3h_t<T>& v) {
     // Inner product with two vectors
     return u.x * v.x + u.y * v.y + u.z * v.z;
 }
@@ -122,9 +155,10 @@ double dot(double ux, double uy, double uz, double uw, double vx, double vy, dou
     return ux * vx + uy * vy + uz * vz + uw * vw;
 }
 
-vec3h cross_product(const vec3h& u, const vec3h& v) {
+template <typename T>
+vec3h_t<T> cross_product(const vec3h_t<T>& u, const vec3h_t<T>& v) {
     // Returns cross product
-    return vec3h(
+    return vec3h_t<T>(
         u.y * v.z - u.z * v.y,
         u.z * v.x - u.x * v.z,
         u.x * v.y - u.y * v.x,
@@ -132,8 +166,9 @@ vec3h cross_product(const vec3h& u, const vec3h& v) {
     );
 }
 
-inline vec3h hadamard_product(const vec3h& u, const vec3h& v) {
-    return vec3h(u.x * v.x, u.y * v.y, u.z * v.z, std::max(u.w, v.w));
+template <typename T>
+inline vec3h_t<T> hadamard_product(const vec3h_t<T>& u, const vec3h_t<T>& v) {
+    return vec3h_t<T>(u.x * v.x, u.y * v.y, u.z * v.z, std::max(u.w, v.w));
 }
 
 inline vec3h generate_random_vector() {
@@ -150,12 +185,11 @@ inline vec3h generate_random_vector(double min, double max) {
     }
 
 inline vec3h random_unit_vector() {
-    while (true) {
-        auto p = generate_random_vector(-1,1);
-        auto lensq = p.magnitude();
-        if (1e-160 < lensq && lensq <= 1)
-            return p / sqrt(lensq);
-    }
+    // Uniform on the unit sphere: z is uniform on [-1, 1] (Archimedes' hat-box theorem) and the azimuth on [0, 2 pi)
+    double z = 1 - 2 * random_double();
+    double r = std::sqrt(std::max(0.0, 1 - z * z));
+    double phi = 2 * pi * random_double();
+    return vec3h(r * std::cos(phi), r * std::sin(phi), z, 0);
 }
 
 inline vec3h random_vec_on_hemisphere(const vec3h& normal) {
@@ -175,22 +209,26 @@ inline vec3h random_unit_aperture_loc() {
     return vec3h(x, y, 0, 1);
 }
 
-vec3h vec_max(const vec3h& u, const vec3h& v) {
+template <typename T>
+vec3h_t<T> vec_max(const vec3h_t<T>& u, const vec3h_t<T>& v) {
     /*
     Computes the max vector of two given vectors | if u is (1,1,3) and 
     v is (2,2,1) then the max is (2,2,3)
     */
-    return vec3h(std::max(u.x, v.x), std::max(u.y, v.y), std::max(u.z, v.z), 1);
+    return vec3h_t<T>(std::max(u.x, v.x), std::max(u.y, v.y), std::max(u.z, v.z), 1);
 }
 
-vec3h vec_min(const vec3h& u, const vec3h& v) {
+template <typename T>
+vec3h_t<T> vec_min(const vec3h_t<T>& u, const vec3h_t<T>& v) {
     /*
     Computes the max vector of two given vectors | if u is (1,1,3) and 
     v is (2,2,1) then the max is (2,2,3)
     */
-    return vec3h(std::min(u.x, v.x), std::min(u.y, v.y), std::min(u.z, v.z), 1);
+    return vec3h_t<T>(std::min(u.x, v.x), std::min(u.y, v.y), std::min(u.z, v.z), 1);
 }
-void print(const vec3h&u) {
+
+template <typename T>
+void print(const vec3h_t<T>&u) {
     std::cout << "x: " << u.x << ", y: " << u.y << ", z: "<< u.z << std::endl;
 }
 
@@ -1,22 +1,55 @@
 #ifndef BXDF_H
 #define BXDF_H
 
+#include <cmath>
 #include "../primitive_shapes/hittable.h"
 #include "../color.h"
 
+struct bxdf_sample {
+    vec3h direction;   // Sampled scattered direction, unit length
+    color f;           // bxdf value for that direction
+    double pdf;        // Solid angle density of direction, or the chosen lobe's probability if specular
+    bool specular;     // A delta lobe, only f * |cos| / pdf means anything
+
+    color weight(const vec3h& normal) const {
+        // What the path throughput gets multiplied by, f * |cos| / pdf
+        return (std::fabs(dot(direction, normal)) / pdf) * f;
+    }
+};
+
 class bxdf {
   public:
     virtual ~bxdf() = default;
 
-    virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+    virtual bool sample(
+        const ray& r_in, const hit_record& rec, double u_lobe, double u1, double u2, bxdf_sample& s
     ) const {
+        /*
+        Picks a scattered direction from the uniforms in [0,1) it is handed: u_lobe chooses
+        between lobes, u1 and u2 place the direction within the lobe. Returns false when the
+        material absorbs the ray.
+        */
         return false;
     }
 
+    virtual color f(const ray& r_in, const hit_record& rec, const vec3h& direction) const {
+        // Value of the non specular lobes for a given scattered direction
+        return color(0,0,0);
+    }
+
+    virtual double pdf(const ray& r_in, const hit_record& rec, const vec3h& direction) const {
+        // Density sample() would pick direction with, zero for purely specular materials
+        return 0;
+    }
+
     virtual color emitted(double u, double v, const vec3h& p) const {
         return color(0,0,0);
     }
+
+    virtual bool emits() const {
+        // Surfaces that can return a nonzero emitted(), the ones lights are collected from
+        return false;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
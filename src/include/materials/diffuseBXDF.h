@@ -20,12 +20,23 @@ public:
     diffuseBXDF(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
     diffuseBXDF(shared_ptr<texture> tex) : tex(tex) {}
     
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-        // TODO: This is not full attenuation formula, scale for light direction too
-        attenuation = tex->value(rec.u, rec.v, rec.p);
-        vec3h direction = scatter_diffuse(rec.normal);
-        scattered = ray(rec.p, direction);
-        return true;
+    bool sample(const ray& r_in, const hit_record& rec, double u_lobe, double u1, double u2,
+                bxdf_sample& s) const override {
+        // Cosine weighted, so f * cos / pdf is just the albedo
+        s.direction = local_to_world(rec.normal, sample_cosine_hemisphere(u1, u2));
+        s.f = tex->value(rec.u, rec.v, rec.p) / pi;
+        s.pdf = std::max<double>(dot(s.direction, rec.normal), 0.0) / pi;
+        s.specular = false;
+        return s.pdf > 0;
+    }
+
+    color f(const ray& r_in, const hit_record& rec, const vec3h& direction) const override {
+        if (dot(direction, rec.normal) <= 0) return color(0,0,0);
+        return tex->value(rec.u, rec.v, rec.p) / pi;
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3h& direction) const override {
+        return std::max<double>(dot(direction.normal_of(), rec.normal), 0.0) / pi;
     }
 };
 
@@ -37,6 +48,10 @@ class diffuse_light : public bxdf {
       color emitted(double u, double v, const vec3h& p) const override {
           return tex->value(u, v, p);
       }
+
+      bool emits() const override {
+          return true;
+      }
   
     private:
       shared_ptr<texture> tex;
@@ -0,0 +1,62 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+/*
+Every material in a scene, owned in one array and referred to everywhere else by its
+32 bit index. Primitives and hit records carry only the index, so traversal copies no
+shared_ptr and does no atomic reference counting. The integrator looks the material up
+once per path vertex, after the closest hit is known.
+
+The scene's primitive_store owns the table. Register a material with it and build the
+primitives with the index it returns. Bottom level BVHs of instances are given the same
+table, so an index means the same material at every level. Index 0 is a grey lambertian,
+the material of primitives built without one. Build the scene before rendering: looking
+up while another thread registers is not safe.
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "bxdf.h"
+#include "diffuseBXDF.h"
+
+class material_table {
+public:
+    static constexpr uint32_t default_material = 0;
+
+    material_table() {
+        add(std::make_shared<diffuseBXDF>(color(0.5, 0.5, 0.5, 0)));
+    }
+
+    uint32_t add(const std::shared_ptr<bxdf>& material) {
+        // Index of material, the same one every time it is added again
+        if (!material) {
+            std::cerr << "material_table: null material, using the default one\n";
+            return default_material;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = ids.find(material.get());
+        if (found != ids.end()) return found->second;
+        uint32_t id = static_cast<uint32_t>(entries.size());
+        entries.push_back(material);
+        ids.emplace(material.get(), id);
+        return id;
+    }
+
+    const bxdf& operator[](uint32_t id) const {
+        return *entries[id];
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+private:
+    std::vector<std::shared_ptr<bxdf>> entries;
+    std::unordered_map<const bxdf*, uint32_t> ids;
+    std::mutex lock;
+};
+
+#endif
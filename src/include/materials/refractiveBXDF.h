@@ -5,6 +5,7 @@
 #include "bxdf.h"
 #include "../color.h"
 #include "../ray.h"
+#include "scattering.h"
 
 
 class refractiveBXDF : public bxdf {
@@ -17,15 +18,34 @@ private:
 public:
     refractiveBXDF(const color& albedo, double eta) : albedo(albedo), light_color(color(1,1,1,0)), eta(eta){}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-    // should calculate two rays using snell and fresnel refraction and reflection
-    // for now just do refraction lmao TODO add reflection, need to use scatter_reflect func
-        attenuation = light_color; // TODO make this awesome and 
-        vec3h direction = scatter_refract(r_in.direction(), rec.normal, eta);
-        scattered = ray(rec.p, direction);
-        return true;
+    bool sample(const ray& r_in, const hit_record& rec, double u_lobe, double u1, double u2,
+                bxdf_sample& s) const override {
+        /*
+        Smooth dielectric, eta is the index inside the surface. Reflects with probability
+        equal to the Fresnel reflectance F and refracts otherwise, so either way the weight
+        f * |cos| / pdf comes out as the albedo.
+        */
+        vec3h unit_dir = r_in.direction().normal_of();
+        double eta_ratio = rec.front_face ? 1.0 / eta : eta;
+        double cos_in = std::min<double>(-dot(unit_dir, rec.normal), 1.0);
+        if (cos_in <= 0) return false;
+        double reflectance = fresnel_dielectric(cos_in, eta_ratio);
+
+        vec3h refracted;
+        if (u_lobe < reflectance || !scatter_refract(unit_dir, rec.normal, eta_ratio, refracted)) {
+            s.direction = scatter_reflect(unit_dir, rec.normal);
+            s.pdf = reflectance;
+            s.f = (reflectance / cos_in) * albedo;
+        } else {
+            s.direction = refracted;
+            s.pdf = 1 - reflectance;
+            double cos_out = std::fabs(dot(refracted, rec.normal));
+            if (cos_out == 0) return false;
+            s.f = ((1 - reflectance) / cos_out) * albedo;
+        }
+        s.specular = true;
+        return s.pdf > 0;
     }
-
 };
 
 using refractive = refractiveBXDF;
@@ -8,60 +8,52 @@
 #include "../interval.h"
 #include "../utils.h"
 
-vec3h scatter_diffuse(vec3h normal) {
-    vec3h direction = normal + random_vec_on_hemisphere(normal);
-    // Catch degenerate scatter direction
-    if (direction.near_zero())
-        direction = normal;
-    return direction;
+vec3h local_to_world(const vec3h& n, const vec3h& local) {
+    /*
+    Maps a direction given in a frame whose z axis is the unit vector n into world space.
+    Tangents are from Duff et al. 2017, "Building an Orthonormal Basis, Revisited", which
+    has no branch on n other than its sign.
+    */
+    double sign = std::copysign(1.0, n.z);
+    double a = -1.0 / (sign + n.z);
+    double b = n.x * n.y * a;
+    vec3h t(1.0 + sign * n.x * n.x * a, sign * b, -sign * n.x, 0);
+    vec3h s(b, sign + n.y * n.y * a, -n.y, 0);
+    return local.x * t + local.y * s + local.z * n;
+}
+
+vec3h sample_cosine_hemisphere(double u1, double u2) {
+    // Malley's method, uniform on the unit disk lifted onto the hemisphere, pdf = cos(theta) / pi
+    double r = std::sqrt(u1);
+    double phi = 2 * pi * u2;
+    return vec3h(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0, 1 - u1)), 0);
 }
 
 vec3h scatter_reflect(const vec3h& r_in_dir, vec3h normal) {
     return -2*dot(r_in_dir, normal) * normal + r_in_dir;
 }
 
-vec3h scatter_refract(const vec3h& r_in_dir, vec3h normal, double eta) {
-    vec3h r_in_norm = r_in_dir.normal_of();
-    vec3h norm = normal.normal_of();
-
-    double cos_r_in = clamp(dot(-r_in_norm, norm), -1.0, 1.0); // Correct sign for cos(theta)
-    bool entering = cos_r_in > 0.0;
-
-    if (!entering) { 
-        norm = -norm; // Flip normal if exiting the medium.
-        cos_r_in = -cos_r_in;
-    }
-
-    double sin_r_out = sqrt(std::max(0.0, 1.0 - cos_r_in * cos_r_in)) / eta;
-
-    if (sin_r_out >= 1.0) { // Total internal reflection
-        return scatter_reflect(r_in_norm, norm); // Reflect function handles reflection vector.
-    }
-
-    double cos_r_out = sqrt(std::max(0.0, 1.0 - sin_r_out * sin_r_out));
-    return eta * r_in_norm + (eta * cos_r_in - cos_r_out) * norm;
+bool scatter_refract(const vec3h& unit_dir, const vec3h& normal, double eta_ratio, vec3h& refracted) {
+    /*
+    Snell's law for a unit direction hitting a surface whose unit normal faces back along
+    it, with eta_ratio = eta_incident / eta_transmitted. False on total internal reflection.
+    */
+    double cos_in = std::min<double>(-dot(unit_dir, normal), 1.0);
+    double sin2_out = eta_ratio * eta_ratio * std::max(0.0, 1.0 - cos_in * cos_in);
+    if (sin2_out >= 1.0) return false;
+    double cos_out = std::sqrt(1.0 - sin2_out);
+    refracted = eta_ratio * unit_dir + (eta_ratio * cos_in - cos_out) * normal;
+    return true;
 }
 
-
-double fresnel_dielectric(const vec3h& r_in_dir, vec3h normal, double eta) {
-    vec3h r_in_norm = r_in_dir.normal_of();
-    vec3h norm = normal.normal_of();
-
-    double cos_r_in = clamp(dot(r_in_norm, norm), -1.0, 1.0); // Clamps to -1.0, 1.0
-    double sin_r_in = sqrt(std::max(0.0, 1.0 - cos_r_in * cos_r_in));
-    double sin_r_out = sin_r_in / eta;
-    
-    // Handle total internal reflection
-    if (sin_r_out >= 1.0) {
-        return 1.0; 
-    }
-    double cos_r_out = sqrt(std::max(0.0, 1.0 - sin_r_out * sin_r_out)); 
-
-    double r_out_parallel = (eta * cos_r_in - cos_r_out) / (eta * cos_r_in + cos_r_out);
-    double r_out_perpendicular = (cos_r_in - eta * cos_r_out) / (cos_r_in + eta * cos_r_out);
-
-    // Return average reflection coefficient
-    return (r_out_parallel * r_out_parallel + r_out_perpendicular * r_out_perpendicular) / 2;
+double fresnel_dielectric(double cos_in, double eta_ratio) {
+    // Unpolarized reflectance of a smooth dielectric boundary, 1 on total internal reflection
+    double sin2_out = eta_ratio * eta_ratio * std::max(0.0, 1.0 - cos_in * cos_in);
+    if (sin2_out >= 1.0) return 1.0;
+    double cos_out = std::sqrt(1.0 - sin2_out);
+    double r_parallel = (cos_in - eta_ratio * cos_out) / (cos_in + eta_ratio * cos_out);
+    double r_perpendicular = (eta_ratio * cos_in - cos_out) / (eta_ratio * cos_in + cos_out);
+    return (r_parallel * r_parallel + r_perpendicular * r_perpendicular) / 2;
 }
 
-#endif
\ No newline at end of file
+#endif
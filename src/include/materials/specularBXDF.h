@@ -17,12 +17,15 @@ private:
 public:
     specularBXDF(const color& albedo) : albedo(albedo), light_color(color(1,1,1,0)){}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-        // TODO: This is not full attenuation formula, scale for light direction too
-        attenuation = color(albedo.x * light_color.x, 
-            albedo.y * light_color.y, albedo.z * light_color.z,0);
-        vec3h direction = scatter_reflect(r_in.direction(), rec.normal);
-        scattered = ray(rec.p, direction);
+    bool sample(const ray& r_in, const hit_record& rec, double u_lobe, double u1, double u2,
+                bxdf_sample& s) const override {
+        // Mirror, a single delta lobe whose weight is the albedo
+        s.direction = scatter_reflect(r_in.direction().normal_of(), rec.normal);
+        double cos_out = std::fabs(dot(s.direction, rec.normal));
+        if (cos_out == 0) return false;
+        s.f = hadamard_product(albedo, light_color) / cos_out;
+        s.pdf = 1;
+        s.specular = true;
         return true;
     }
 };
@@ -20,7 +20,7 @@ class obj_loader {
         bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str());
 
         if (!warn.empty()) {
-            std::cout << "WARN: " << warn << std::endl;
+            std::clog << "WARN: " << warn << std::endl;
         }
         if (!err.empty()) {
             std::cerr << "ERR: " << err << std::endl;
@@ -92,9 +92,10 @@ class obj_loader {
                 index_offset += fv;
             }
         }
-        mesh.vertices = vertices;
+        mesh.vertices = std::vector<vec3f>(vertices.begin(), vertices.end());
         mesh.indices = indices;
         mesh.num_triangles = (int) indices.size() / 3;
+        mesh.invalidate_cache();
         return (int) indices.size() / 3; // this is num of triangles
     }
 };
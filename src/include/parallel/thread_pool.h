@@ -0,0 +1,172 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+/*
+Fixed size pool of worker threads for splitting up renders and builds.
+Every thread owns a task deque. A thread pops work from the front of its own deque and,
+once that runs dry, steals from the back of the other deques. Uneven work (a tile full of
+glass spheres next to a tile of sky) then balances out without one shared queue.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class task_group {
+    /* Counts the tasks of one batch that have not finished yet */
+public:
+    std::atomic<int> pending{0};
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+class thread_pool {
+private:
+    struct task {
+        std::function<void()> fn;
+        task_group* group = nullptr;
+    };
+
+    struct task_queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    // Queue 0 belongs to whichever outside thread is waiting on the pool, 1..n-1 to the workers
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    std::atomic<unsigned> next_queue{0};
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    inline static thread_local const thread_pool* current_pool = nullptr;
+    inline static thread_local int current_index = 0;
+
+    int own_index() const {
+        return (current_pool == this) ? current_index : 0;
+    }
+
+    bool pop_own(int index, task& t) {
+        task_queue& q = *queues[index];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        t = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(int index, task& t) {
+        int n = static_cast<int>(queues.size());
+        for (int k = 1; k < n; ++k) {
+            task_queue& q = *queues[(index + k) % n];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            t = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    bool run_one(int index) {
+        task t;
+        if (!pop_own(index, t) && !steal(index, t)) return false;
+        queued.fetch_sub(1);
+        t.fn();
+        if (t.group) t.group->pending.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void worker_loop(int index) {
+        current_pool = this;
+        current_index = index;
+        while (true) {
+            if (run_one(index)) continue;
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+
+public:
+    explicit thread_pool(int num_threads = 0) {
+        /*
+        num_threads counts the calling thread, which runs tasks while it waits.
+        0 uses one thread per hardware core.
+        */
+        if (num_threads <= 0) num_threads = default_thread_count();
+        for (int i = 0; i < num_threads; ++i) {
+            queues.push_back(std::make_unique<task_queue>());
+        }
+        for (int i = 1; i < num_threads; ++i) {
+            workers.emplace_back(&thread_pool::worker_loop, this, i);
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& w : workers) w.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    static int default_thread_count() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    int size() const { return static_cast<int>(queues.size()); }
+
+    void submit(std::function<void()> fn, task_group& group) {
+        /*
+        Tasks spawned from inside a task go to the front of the spawning thread's own deque
+        so nested work stays depth first. Tasks from outside are dealt out round robin.
+        */
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        if (current_pool == this) {
+            task_queue& q = *queues[current_index];
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_front(task{std::move(fn), &group});
+        } else {
+            task_queue& q = *queues[next_queue.fetch_add(1) % queues.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_back(task{std::move(fn), &group});
+        }
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+        }
+        wake.notify_one();
+    }
+
+    void wait(task_group& group) {
+        // Help out instead of blocking, this is also what makes nested waits safe
+        int index = own_index();
+        while (!group.done()) {
+            if (!run_one(index)) std::this_thread::yield();
+        }
+    }
+
+    template <typename F>
+    void parallel_for(int count, F&& fn) {
+        /* Runs fn(i) for every i in [0, count) and returns once all of them finished */
+        task_group group;
+        for (int i = 0; i < count; ++i) {
+            submit([&fn, i] { fn(i); }, group);
+        }
+        wait(group);
+    }
+};
+
+#endif
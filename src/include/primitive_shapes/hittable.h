@@ -3,14 +3,16 @@
 
 #include "../ray.h"
 #include "geometry/bounds.h"
-
-class bxdf;
+#include "../acceleration/traversal_stats.h"
 
 class hit_record {
   public:
+    static constexpr uint32_t no_primitive = ~0u;
+
     vec3h p; // position
     vec3h normal; // surface normal to the position
-    shared_ptr<bxdf> mat;
+    uint32_t material; // Index into the scene's material_table
+    uint32_t primitive = no_primitive; // primitive_ref of the top level primitive hit, set by BVH traversal
     double t; // scaling distance
     double u;
     double v; // u, v are for texture mapping
@@ -30,6 +32,25 @@ class hittable {
     virtual Bounds3f bounds() const = 0;
     
     virtual bool intersect(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        // Any hit at all within ray_t, shapes override this to skip filling in a hit record
+        hit_record rec;
+        return intersect(r, ray_t, rec);
+    }
+
+    // The same queries counting traversal work into stats, for objects with a BVH of their own
+    virtual bool intersect(const ray& r, interval ray_t, hit_record& rec, traversal_stats&) const {
+        return intersect(r, ray_t, rec);
+    }
+    virtual bool occluded(const ray& r, interval ray_t, traversal_stats&) const {
+        return occluded(r, ray_t);
+    }
+
+    virtual bool counts_own_traversal() const {
+        // Whether the queries above count this object's work, else its BVH counts it as one primitive test
+        return false;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -5,75 +5,111 @@
 #include <memory>
 #include <vector>
 #include "hittable.h"
-#include "../acceleration/bvh_util.h"
+#include "../acceleration/bvh_aggregate.h"
 #include "../geometry/vec3.h"
+#include "primitive_store.h"
 #include "triangle.h"
 #include "quadrilateral.h"
 
 using std::make_shared;
 using std::shared_ptr;
 
-class hittable_list{
+class hittable_list : public primitive_store {
+    /*
+    The scene's primitives. Meshes and spheres added here are stored compactly by
+    primitive_store, build the BVH from the list itself so it can refer to them.
+    */
 private:
 public:
-    std::vector<shared_ptr<hittable>> objects;
-    mutable int comparisons = 0;
     hittable_list() {}
     hittable_list(shared_ptr<hittable> object) { add(object); }
 
-    void clear() { objects.clear(); }
-
-    void add(std::shared_ptr<hittable> object) {
-        objects.push_back(object);
+    void clear() {
+        objects.clear();
+        meshes.clear();
+        triangles.clear();
+        spheres.clear();
+        materials = std::make_shared<material_table>();
     }
 
-    void add(triangleMesh* mesh) {
-        for (int i = 0; i < mesh->num_triangles; i++) {
-            objects.push_back(std::make_shared<triangle>(mesh, i, mesh->mat));
-        }
-    }
+    using primitive_store::add;
 
     void add(quadrilateral *quad) {
         add(&quad->mesh);
     }
 
-bool intersect(BVHTreeNode* head, const ray& r, interval ray_t, hit_record& rec) const {
-    hit_record left_rec, right_rec;
+    bool intersect(const BVHAggregate& bvh, const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        stats.rays += 1;
+        return bvh.intersect(r, ray_t, rec, stats);
+    }
+
+    bool occluded(const BVHAggregate& bvh, const ray& r, double t_max, traversal_stats& stats) const {
+        stats.rays += 1;
+        return bvh.occluded(r, t_max, stats);
+    }
+
+    bool intersect(const BVHAggregate& bvh, const ray& r, interval ray_t, hit_record& rec) const {
+        traversal_stats stats;
+        return intersect(bvh, r, ray_t, rec, stats);
+    }
+
+    bool occluded(const BVHAggregate& bvh, const ray& r, double t_max) const {
+        traversal_stats stats;
+        return occluded(bvh, r, t_max, stats);
+    }
+
+    bool intersect_tree(const BVHAggregate& bvh, const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        // Recursive traversal of the flattened nodes, kept to compare against the stack traversal
+        stats.rays += 1;
+        return !bvh.get_nodes().empty() && intersect_node(bvh, 0, r, ray_t, rec, stats);
+    }
+
+    bool intersect_tree(const BVHAggregate& bvh, const ray& r, interval ray_t, hit_record& rec) const {
+        traversal_stats stats;
+        return intersect_tree(bvh, r, ray_t, rec, stats);
+    }
+
+private:
+bool intersect_node(const BVHAggregate& bvh, int index, const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+    // Visits the nearer child first and shrinks ray_t to the closest hit as it goes
+    const LinearBVHNode& node = bvh.get_nodes()[index];
+    hit_record temp_rec;
     bool hit_anything = false;
-    auto closest_so_far = ray_t.max;
-    comparisons +=1;
+    stats.nodes += 1;
+    stats.box_tests += 1;
     // Check intersection with current node bounds
-    if (head->bounds.intersect(r, ray_t)) {
-        comparisons +=1;
-        if (head->isLeaf()) {
-            for (const BVHPrimitive& prim : head->prims) {
-                comparisons +=1;
-                if (prim.object->intersect(r, interval(ray_t.min, closest_so_far), left_rec)) {
+    if (node.bounds.to_bounds().intersect(r, ray_t)) {
+        stats.box_hits += 1;
+        if (node.isLeaf()) {
+            const primitive_store& store = bvh.get_store();
+            const int offset = bvh.get_leaves()[node.leaf].primitives_offset;
+            for (int i = 0; i < node.n_prims; ++i) {
+                const primitive_ref ref = bvh.get_primitives()[offset + i];
+                const bool counted = store.counts_own_traversal(ref);
+                if (!counted) stats.primitives += 1;
+                if (store.intersect(ref, r, ray_t, temp_rec, stats)) {
+                    if (!counted) stats.hits += 1;
+                    temp_rec.primitive = ref;
                     hit_anything = true;
-                    closest_so_far = left_rec.t;
-                    rec = left_rec;
+                    ray_t.max = temp_rec.t;
+                    rec = temp_rec;
                 }
             }
             return hit_anything;
         } else {
-            bool left_hit = false;
-            if (head->left) {
-                left_hit = intersect(head->left.get(), r, ray_t, left_rec);
-                if (left_hit) {
-                    closest_so_far = left_rec.t;
-                    rec = left_rec;
-                }
-            }
+            const bool dir_is_neg[3] = {!r.sign_x(), !r.sign_y(), !r.sign_z()};
+            int near_child = index + 1;
+            int far_child = node.second_child_offset;
+            if (dir_is_neg[node.axis]) std::swap(near_child, far_child);
 
-            bool right_hit = false;
-            if (head->right) {
-                right_hit = intersect(head->right.get(), r, ray_t, right_rec);
-                if (right_hit && right_rec.t < closest_so_far) {
-                    rec = right_rec;
-                    closest_so_far = right_rec.t;
+            for (int child : {near_child, far_child}) {
+                if (intersect_node(bvh, child, r, ray_t, temp_rec, stats)) {
+                    hit_anything = true;
+                    ray_t.max = temp_rec.t;
+                    rec = temp_rec;
                 }
             }
-            return left_hit || right_hit;
+            return hit_anything;
         }
     }
     return false;
@@ -0,0 +1,90 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+/*
+Two level acceleration. A mesh gets one bottom level BVH in its own object space, and each
+placed copy of it is an instance: a reference to that BVH plus a transform and its inverse.
+Instances go into the top level BVH like any other hittable, rays are moved into object
+space when they reach one. Memory and build time then scale with unique meshes, not copies.
+*/
+
+#include <cassert>
+#include <memory>
+#include "hittable.h"
+#include "hittable_list.h"
+#include "../acceleration/bvh_aggregate.h"
+#include "../geometry/transform.h"
+
+std::shared_ptr<BVHAggregate> make_mesh_bvh(triangleMesh* mesh, std::shared_ptr<material_table> materials,
+                                           int max_prims = 4, BVHWidth width = BVH2) {
+    /*
+    Bottom level BVH over a mesh's triangles, share it between every instance of the mesh.
+    materials is the table of the scene the instances go into, the one mesh->material indexes.
+    */
+    assert(materials && mesh->material < materials->size());
+    primitive_store triangles;
+    triangles.materials = materials;
+    triangles.add(mesh);
+    return std::make_shared<BVHAggregate>(std::move(triangles), max_prims, 0, width);
+}
+
+class instance : public hittable {
+private:
+    std::shared_ptr<BVHAggregate> blas;
+    transform object_to_world;
+    transform world_to_object;
+    Bounds3f world_bounds;
+
+    ray to_object_space(const ray& r) const {
+        // Affine maps keep the ray parameter, so t found in object space is valid in world space
+        vec3h origin = r.origin();
+        vec3h direction = r.direction();
+        origin.w = 1;
+        direction.w = 0;
+        return ray(apply_transform(world_to_object.m, origin), apply_transform(world_to_object.m, direction));
+    }
+
+public:
+    instance(std::shared_ptr<BVHAggregate> blas, const transform& object_to_world)
+        : blas(blas), object_to_world(object_to_world), world_to_object(inverse(object_to_world)) {
+        // World bounds are the bounds of the object space box's transformed corners
+        Bounds3f b = blas->bounds();
+        for (int corner = 0; corner < 8; ++corner) {
+            vec3h p((corner & 1) ? b.pmax.x : b.pmin.x,
+                    (corner & 2) ? b.pmax.y : b.pmin.y,
+                    (corner & 4) ? b.pmax.z : b.pmin.z, 1);
+            world_bounds.expand(apply_transform(this->object_to_world.m, p));
+        }
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        traversal_stats stats;
+        return intersect(r, ray_t, rec, stats);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        traversal_stats stats;
+        return occluded(r, ray_t, stats);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const override {
+        if (!blas->intersect(to_object_space(r), ray_t, rec, stats)) return false;
+        rec.p = r.line(rec.t);
+        rec.normal = apply_normal_transform(world_to_object.m, rec.normal).normal_of();
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t, traversal_stats& stats) const override {
+        return blas->occluded(to_object_space(r), ray_t, stats);
+    }
+
+    Bounds3f bounds() const override {
+        return world_bounds;
+    }
+
+    bool counts_own_traversal() const override {
+        // The BLAS counts its nodes, triangle tests and hits, the wrapper is not a test of its own
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef PRIMITIVE_STORE_H
+#define PRIMITIVE_STORE_H
+/*
+Owns the scene's primitives in one array per kind so a BVH can refer to them by
+primitive_ref. Triangles are a mesh and triangle index pair rather than a heap allocated
+triangle object each, and spheres are kept by value. Everything else (instances, user
+hittables) goes in objects behind a shared_ptr as before. The store also owns the scene's
+material_table, which the primitives' material indices refer to.
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "hittable.h"
+#include "triangle.h"
+#include "sphere.h"
+#include "../acceleration/bvh_util.h"
+#include "../materials/material_table.h"
+
+struct mesh_triangle {
+    uint32_t mesh;   // Index into primitive_store::meshes
+    uint32_t index;  // Triangle within that mesh
+};
+
+class primitive_store {
+public:
+    std::vector<std::shared_ptr<hittable>> objects;
+    std::vector<triangleMesh*> meshes;  // Not owned, same as triangle's mesh pointer
+    std::vector<mesh_triangle> triangles;
+    std::vector<sphere> spheres;
+    std::shared_ptr<material_table> materials = std::make_shared<material_table>();
+
+    primitive_store() {}
+    primitive_store(const std::vector<std::shared_ptr<hittable>>& objects) : objects(objects) {}
+
+    void add(std::shared_ptr<hittable> object) {
+        if (!object) {
+            std::cerr << "primitive_store: null object, not added\n";
+            return;
+        }
+        objects.push_back(object);
+    }
+
+    void add(triangleMesh* mesh) {
+        uint32_t mesh_id = static_cast<uint32_t>(meshes.size());
+        meshes.push_back(mesh);
+        triangles.reserve(triangles.size() + mesh->num_triangles);
+        for (int i = 0; i < mesh->num_triangles; i++) {
+            triangles.push_back(mesh_triangle{mesh_id, static_cast<uint32_t>(i)});
+        }
+    }
+
+    void add(const sphere& s) {
+        spheres.push_back(s);
+    }
+
+    size_t size() const {
+        return objects.size() + triangles.size() + spheres.size();
+    }
+
+    bool addressable() const {
+        // Whether every primitive's index fits in the bits a primitive_ref has for it
+        return objects.size() <= max_primitives_per_kind && triangles.size() <= max_primitives_per_kind &&
+               spheres.size() <= max_primitives_per_kind && size() <= static_cast<size_t>(INT32_MAX);
+    }
+
+    primitive_ref ref(size_t i) const {
+        // The i'th primitive counting objects, then triangles, then spheres
+        if (i < objects.size()) return make_primitive_ref(PRIM_OBJECT, static_cast<uint32_t>(i));
+        i -= objects.size();
+        if (i < triangles.size()) return make_primitive_ref(PRIM_TRIANGLE, static_cast<uint32_t>(i));
+        return make_primitive_ref(PRIM_SPHERE, static_cast<uint32_t>(i - triangles.size()));
+    }
+
+    const triangleMesh& mesh_of(primitive_ref ref) const {
+        // Mesh of a PRIM_TRIANGLE ref
+        return *meshes[triangles[ref_index(ref)].mesh];
+    }
+
+    bool counts_own_traversal(primitive_ref ref) const {
+        // Objects like instances that count their own BVH's work into traversal_stats
+        return ref_kind(ref) == PRIM_OBJECT && objects[ref_index(ref)]->counts_own_traversal();
+    }
+
+    bool degenerate(primitive_ref ref) const {
+        // Zero area triangles, which no ray can hit
+        if (ref_kind(ref) != PRIM_TRIANGLE) return false;
+        const mesh_triangle& tri = triangles[ref_index(ref)];
+        return meshes[tri.mesh]->data(tri.index).degenerate;
+    }
+
+    Bounds3f bounds(primitive_ref ref) const {
+        uint32_t index = ref_index(ref);
+        switch (ref_kind(ref)) {
+        case PRIM_TRIANGLE: {
+            const mesh_triangle& tri = triangles[index];
+            return triangle::bounds(*meshes[tri.mesh], tri.index);
+        }
+        case PRIM_SPHERE:
+            return spheres[index].bounds();
+        default:
+            return objects[index]->bounds();
+        }
+    }
+
+    bool intersect(primitive_ref ref, const ray& r, interval ray_t, hit_record& rec) const {
+        uint32_t index = ref_index(ref);
+        switch (ref_kind(ref)) {
+        case PRIM_TRIANGLE: {
+            const mesh_triangle& tri = triangles[index];
+            return triangle::intersect(*meshes[tri.mesh], tri.index, r, ray_t, rec);
+        }
+        case PRIM_SPHERE:
+            return spheres[index].intersect(r, ray_t, rec);
+        default:
+            return objects[index]->intersect(r, ray_t, rec);
+        }
+    }
+
+    bool intersect(primitive_ref ref, const ray& r, interval ray_t, hit_record& rec, traversal_stats& stats) const {
+        // Objects count their own traversal into stats, triangles and spheres are one test
+        if (ref_kind(ref) == PRIM_OBJECT) return objects[ref_index(ref)]->intersect(r, ray_t, rec, stats);
+        return intersect(ref, r, ray_t, rec);
+    }
+
+    bool distance(primitive_ref ref, const ray& r, interval ray_t, double& t) const {
+        /*
+        First half of intersect for triangles and spheres: only the nearest t in ray_t, no
+        hit record. Traversal keeps the closest ref and calls fill_hit for it once at the end.
+        */
+        uint32_t index = ref_index(ref);
+        if (ref_kind(ref) == PRIM_TRIANGLE) {
+            const mesh_triangle& tri = triangles[index];
+            return triangle::distance(*meshes[tri.mesh], tri.index, r, ray_t, t);
+        }
+        return spheres[index].distance(r, ray_t, t);
+    }
+
+    void fill_hit(primitive_ref ref, const ray& r, double t, hit_record& rec) const {
+        // Second half, the surface at distance t of a triangle or sphere
+        uint32_t index = ref_index(ref);
+        if (ref_kind(ref) == PRIM_TRIANGLE) {
+            const mesh_triangle& tri = triangles[index];
+            triangle::fill_hit(*meshes[tri.mesh], tri.index, r, t, rec);
+        } else {
+            spheres[index].fill_hit(r, t, rec);
+        }
+    }
+
+    bool occluded(primitive_ref ref, const ray& r, interval ray_t) const {
+        uint32_t index = ref_index(ref);
+        switch (ref_kind(ref)) {
+        case PRIM_TRIANGLE: {
+            const mesh_triangle& tri = triangles[index];
+            return triangle::occluded(*meshes[tri.mesh], tri.index, r, ray_t);
+        }
+        case PRIM_SPHERE:
+            return spheres[index].occluded(r, ray_t);
+        default:
+            return objects[index]->occluded(r, ray_t);
+        }
+    }
+
+    bool occluded(primitive_ref ref, const ray& r, interval ray_t, traversal_stats& stats) const {
+        if (ref_kind(ref) == PRIM_OBJECT) return objects[ref_index(ref)]->occluded(r, ray_t, stats);
+        return occluded(ref, r, ray_t);
+    }
+
+    size_t memory_bytes() const {
+        // Bytes spent referencing primitives, mesh vertex and index data is not counted
+        return objects.capacity() * sizeof(std::shared_ptr<hittable>)
+             + meshes.capacity() * sizeof(triangleMesh*)
+             + triangles.capacity() * sizeof(mesh_triangle)
+             + spheres.capacity() * sizeof(sphere);
+    }
+
+    size_t shared_ptr_memory_bytes() const {
+        /*
+        What the same primitives cost when every triangle and sphere was its own make_shared
+        object: the object and its control block, plus one shared_ptr in the scene list and
+        another in the BVH's leaf array.
+        */
+        const size_t control_block = 2 * sizeof(long);
+        const size_t list_entries = 2 * sizeof(std::shared_ptr<hittable>);
+        return triangles.size() * (sizeof(triangle) + control_block + list_entries)
+             + spheres.size() * (sizeof(sphere) + control_block + list_entries)
+             + objects.size() * list_entries;
+    }
+};
+
+#endif
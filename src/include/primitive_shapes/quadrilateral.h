@@ -13,7 +13,7 @@ struct quadrilateral {
     std::shared_ptr<bxdf> mat; // Material for the sphere
     // Constructor with material
     quadrilateral();
-    quadrilateral(const vec3h& origin, const vec3h& dir_a, const vec3h& dir_b, std::shared_ptr<bxdf> material)
+    quadrilateral(const vec3h& origin, const vec3h& dir_a, const vec3h& dir_b, uint32_t material)
         : mesh(
             std::vector<vec3h>{ origin, origin + dir_a, origin + dir_b, origin + dir_a + dir_b },
             std::vector<int>{ 0, 1, 2, 1, 2, 3 },
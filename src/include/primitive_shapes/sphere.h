@@ -5,26 +5,32 @@
 #include "./hittable.h"
 #include "../geometry/vec3.h"
 #include "../materials/bxdf.h"
-#include "../materials/diffuseBXDF.h"
+#include "../materials/material_table.h"
 
-class sphere : public hittable {
+class sphere final : public hittable {
 private:
     vec3h center;
     double radius;
 
 public:
-std::shared_ptr<bxdf> mat; // Material for the sphere
+uint32_t material; // Material for the sphere, index into the scene's material_table
 
-    // Constructor with material
-    sphere(const vec3h& center, double radius, std::shared_ptr<bxdf> material) 
-        : center(center), radius(std::fmax(0, radius)), mat(material) {}
+    sphere(const vec3h& center, double radius, uint32_t material = material_table::default_material)
+        : center(center), radius(std::fmax(0, radius)), material(material) {}
 
-    // Constructor without explicit material (default material)
-    sphere(const vec3h& center, double radius) 
-        : center(center), radius(std::fmax(0, radius)), mat(std::make_shared<diffuseBXDF>(color(0.5, 0.5, 0.5, 0))) {}
+    const vec3h& get_center() const { return center; }
+    double get_radius() const { return radius; }
 
 
     bool intersect(const ray& r, interval ray_t, hit_record& rec) const {
+        double t;
+        if (!distance(r, ray_t, t)) return false;
+        fill_hit(r, t, rec);
+        return true;
+    }
+
+    bool distance(const ray& r, interval ray_t, double& t) const {
+        // The root test alone, the nearest t in ray_t where r meets the sphere
         vec3h dist = center - r.origin();
         auto a = dot(r.direction(), r.direction());
         auto h = dot(r.direction(), dist);
@@ -43,16 +49,34 @@ std::shared_ptr<bxdf> mat; // Material for the sphere
             if (!ray_t.surrounds(root))
                 return false;
         }
+        t = root;
+        return true;
+    }
 
-        rec.t = root;
+    void fill_hit(const ray& r, double t, hit_record& rec) const {
+        // Hit point, face normal and uv for a t that distance() found
+        rec.t = t;
         rec.p = r.line(rec.t);
-        rec.mat = mat;
+        rec.material = material;
         vec3h outward_normal = (rec.p - center) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
-        // Set the normal, point, and ray direction scalar to hit record
-        return true;
-    }   
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        // Same root test as intersect without the hit point, normal and uv
+        vec3h dist = center - r.origin();
+        auto a = dot(r.direction(), r.direction());
+        auto h = dot(r.direction(), dist);
+        auto c = dot(dist, dist) - radius*radius;
+        auto discriminant = h*h - a*c;
+
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
 
     static void get_sphere_uv(const vec3h& p, double& u, double& v) {
         // Normalized angles u: phi, v: theta
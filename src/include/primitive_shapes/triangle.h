@@ -1,14 +1,16 @@
 #ifndef TRIANGLE_H
 #define TRIANGLE_H
 
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include "./hittable.h"
 #include "../geometry/vec3.h"
 #include "../materials/bxdf.h"
 #include "../geometry/bounds.h"
 #include "../geometry/transform.h"
-#include "../materials/diffuseBXDF.h"
+#include "../materials/material_table.h"
 
 
 struct triangleIntersection {
@@ -21,26 +23,88 @@ struct triangleIntersection {
     triangleIntersection() : b0(0), b1(0), b2(0), dist(0), valid(false) {}
 };
 
+struct triangle_data {
+    /*
+    What only changes with the vertices, worked out once per triangle instead of per ray.
+    Single precision like the vertices, 20 bytes a triangle. Bounds aren't kept, the BVH build
+    is their only user and takes them from the vertices.
+    */
+    vec3f unit_normal;  // Unit (p1 - p0) x (p2 - p0), zero when degenerate
+    float area;
+    bool degenerate;    // Zero area, no ray can hit it
+
+    vec3h normal() const {
+        return vec3h(unit_normal.x, unit_normal.y, unit_normal.z, 0);
+    }
+};
+
 struct triangleMesh {
-    std::vector<vec3h> vertices;  // Stores unique vertex positions
+    std::vector<vec3f> vertices;  // Unique vertex positions, single precision
     std::vector<int> indices;     // Stores triangle vertex indices (3 per triangle)
     int num_triangles = 0;
     Bounds3f total_bound;
-    std::shared_ptr<bxdf> mat; // Shared material for all triangles
-    triangleMesh(std::shared_ptr<bxdf> mat) : mat(mat) {}
-    triangleMesh(const std::vector<vec3h>& verts, const std::vector<int>& inds, int num_tri,  std::shared_ptr<bxdf> mat)
-        : vertices(verts), indices(inds), num_triangles(num_tri), mat(mat) {}
-    triangleMesh(const std::vector<vec3h>& verts, const std::vector<int>& inds, int num_tri)
-        : vertices(verts), indices(inds), num_triangles(num_tri), mat(std::make_shared<diffuseBXDF>(color(0.5, 0.5, 0.5, 0))) {}
+    uint32_t material; // Shared material for all triangles, index into the scene's material_table
+    explicit triangleMesh(uint32_t mat) : material(mat) {}
+    triangleMesh(const std::vector<vec3h>& verts, const std::vector<int>& inds, int num_tri, uint32_t mat = material_table::default_material)
+        : vertices(verts.begin(), verts.end()), indices(inds), num_triangles(num_tri), material(mat) {}
+    triangleMesh(const triangleMesh& other)
+        : vertices(other.vertices), indices(other.indices), num_triangles(other.num_triangles),
+          total_bound(other.total_bound), material(other.material) {}
+    triangleMesh& operator=(const triangleMesh& other) {
+        vertices = other.vertices;
+        indices = other.indices;
+        num_triangles = other.num_triangles;
+        total_bound = other.total_bound;
+        material = other.material;
+        invalidate_cache();
+        return *this;
+    }
     void apply_total_transform(transform& t);
     Bounds3f bounds();
 
+    const triangle_data& data(int index) const {
+        /*
+        Per triangle normal and area, built on first use after the vertices last
+        changed. Safe to call from several threads, the first one in builds the cache.
+        */
+        if (!cache_valid.load(std::memory_order_acquire)) build_cache();
+        return cache[index];
+    }
+
+    void invalidate_cache() {
+        // Call after changing vertices or indices other than through apply_total_transform
+        cache_valid.store(false, std::memory_order_release);
+    }
+
+private:
+    mutable std::vector<triangle_data> cache;
+    mutable std::atomic<bool> cache_valid{false};
+    mutable std::mutex cache_lock;
+
+    void build_cache() const {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        if (cache_valid.load(std::memory_order_relaxed)) return;
+        cache.resize(num_triangles);
+        for (int i = 0; i < num_triangles; i++) {
+            vec3h p0 = vertices[indices[3 * i]];
+            vec3h p1 = vertices[indices[3 * i + 1]];
+            vec3h p2 = vertices[indices[3 * i + 2]];
+            vec3h n = cross_product(p1 - p0, p2 - p0);
+            double length = n.magnitude();
+            triangle_data& d = cache[i];
+            d.area = static_cast<float>(0.5 * length);
+            d.degenerate = !(length > 0);
+            d.unit_normal = vec3f(n.normal_of());
+        }
+        cache_valid.store(true, std::memory_order_release);
+    }
 };
 
 void triangleMesh::apply_total_transform(transform& t) {
     for (int i = 0; i < vertices.size(); i++) {
-        vertices[i] = apply_transform(t.m, vertices[i]);
+        vertices[i] = vec3f(apply_transform(t.m, vec3h(vertices[i])));
     }
+    invalidate_cache();
 }
 
 
@@ -48,26 +112,31 @@ class triangle : public hittable {
 private:
     triangleMesh* mesh = nullptr;
     int mesh_index;
-    triangleIntersection check_intersection(const ray& r, interval ray_t, vec3h p0, vec3h p1, vec3h p2) const;
-    void permutation(vec3h direction, vec3h& dirt, vec3h& p0t, vec3h& p1t, vec3h& p2t) const;
-    void shear(vec3h& dirt, vec3h& p0t, vec3h& p1t, vec3h& p2t) const;
+    // The watertight test runs in double whatever Float is, like the SIMD blocks
+    static triangleIntersection check_intersection(const ray& r, interval ray_t, vec3d p0, vec3d p1, vec3d p2);
+    static void permutation(vec3d direction, vec3d& dirt, vec3d& p0t, vec3d& p1t, vec3d& p2t);
+    static void shear(vec3d& dirt, vec3d& p0t, vec3d& p1t, vec3d& p2t);
 
     public:
-std::shared_ptr<bxdf> mat; // Material for the sphere
-
-    // Constructor with material
-    triangle(triangleMesh* triMesh, int mesh_index, std::shared_ptr<bxdf> material) 
-        : mesh(triMesh), mesh_index(mesh_index), mat(material) {}
+uint32_t material; // Material for the triangle, index into the scene's material_table
 
-    // Constructor without explicit material (default material)
-    triangle(triangleMesh* triMesh, int mesh_index) 
-        : mesh(triMesh), mesh_index(mesh_index), mat(std::make_shared<diffuseBXDF>(color(0.5, 0.5, 0.5, 0))) {}
+    triangle(triangleMesh* triMesh, int mesh_index, uint32_t material = material_table::default_material)
+        : mesh(triMesh), mesh_index(mesh_index), material(material) {}
 
-    triangle() : mesh(nullptr), mesh_index(-1), mat(std::make_shared<diffuseBXDF>(color(0.5, 0.5, 0.5, 0))) {}
+    triangle() : triangle(nullptr, -1) {}
 
     bool intersect(const ray& r, interval ray_t, hit_record& rec) const override;
+    bool occluded(const ray& r, interval ray_t) const override;
     Bounds3f bounds() const override;
-    double area(const vec3h& p0, const vec3h& p1, const vec3h& p2) const;
+
+    // The same tests for triangle index of mesh without a triangle object, used by index based BVH leaves
+    static bool intersect(const triangleMesh& mesh, int index, const ray& r, interval ray_t, hit_record& rec);
+    static bool occluded(const triangleMesh& mesh, int index, const ray& r, interval ray_t);
+    static bool distance(const triangleMesh& mesh, int index, const ray& r, interval ray_t, double& t);
+    static void fill_hit(const triangleMesh& mesh, int index, const ray& r, double t, hit_record& rec);
+    static Bounds3f bounds(const triangleMesh& mesh, int index);
+
+    static double area(const vec3h& p0, const vec3h& p1, const vec3h& p2);
     double area() const;
     friend void test_permutation();
     friend void test_shear();
@@ -76,45 +145,63 @@ std::shared_ptr<bxdf> mat; // Material for the sphere
 
 
 bool triangle::intersect(const ray& r, interval ray_t, hit_record& rec) const {
-    int i0 = mesh->indices[3 * mesh_index];
-    int i1 = mesh->indices[3 * mesh_index + 1];
-    int i2 = mesh->indices[3 * mesh_index + 2];
-    
-    vec3h p0 = mesh->vertices[i0];
-    vec3h p1 = mesh->vertices[i1];
-    vec3h p2 = mesh->vertices[i2];
+    if (!intersect(*mesh, mesh_index, r, ray_t, rec)) return false;
+    rec.material = material;
+    return true;
+}
 
+bool triangle::occluded(const ray& r, interval ray_t) const {
+    return occluded(*mesh, mesh_index, r, ray_t);
+}
 
-    triangleIntersection triIntersection = check_intersection(r, ray_t, p0, p1, p2);
-    if (triIntersection.valid == false) return false;
+bool triangle::intersect(const triangleMesh& mesh, int index, const ray& r, interval ray_t, hit_record& rec) {
+    double t;
+    if (!distance(mesh, index, r, ray_t, t)) return false;
+    fill_hit(mesh, index, r, t, rec);
+    return true;
+}
 
-    // Calculate normal
-    vec3h normal = cross_product(p1 - p0, p2 - p0).normal_of();
-    double t = triIntersection.dist / r.direction().magnitude();
+bool triangle::distance(const triangleMesh& mesh, int index, const ray& r, interval ray_t, double& t) {
+    // The watertight test alone, dist is already in units of the ray parameter like every other primitive's t
+    int i0 = mesh.indices[3 * index];
+    int i1 = mesh.indices[3 * index + 1];
+    int i2 = mesh.indices[3 * index + 2];
+    triangleIntersection triIntersection = check_intersection(r, ray_t, mesh.vertices[i0], mesh.vertices[i1], mesh.vertices[i2]);
+    if (triIntersection.valid == false) return false;
+    t = triIntersection.dist;
+    return true;
+}
 
+void triangle::fill_hit(const triangleMesh& mesh, int index, const ray& r, double t, hit_record& rec) {
+    // Hit point and face normal for a t that distance() found
     rec.t = t;
     rec.p = r.line(t);
-    rec.normal = normal;
-    rec.mat = mat;
-    return true;
+    rec.set_face_normal(r, mesh.data(index).normal());
+    rec.material = mesh.material;
 }
 
-triangleIntersection triangle::check_intersection(const ray& r, interval ray_t, vec3h p0, vec3h p1, vec3h p2) const {
-    /* 1. check if degenerate*/
-    if (area(p0, p1, p2) == 0) return triangleIntersection();
-    
-    /* 2. transform triangle and ray coordinate system so that ray direction faces down
+bool triangle::occluded(const triangleMesh& mesh, int index, const ray& r, interval ray_t) {
+    // Only the watertight test, no normal or hit point
+    int i0 = mesh.indices[3 * index];
+    int i1 = mesh.indices[3 * index + 1];
+    int i2 = mesh.indices[3 * index + 2];
+    return check_intersection(r, ray_t, mesh.vertices[i0], mesh.vertices[i1], mesh.vertices[i2]).valid;
+}
+
+triangleIntersection triangle::check_intersection(const ray& r, interval ray_t, vec3d p0, vec3d p1, vec3d p2) {
+    /* 1. transform triangle and ray coordinate system so that ray direction faces down
     the z axis, and ray origin is treated as (0,0,0). Requires a translation, coordinate permutation
     and shear */
-    vec3h dir_t; // _t is for transformed
+    vec3d dir_t; // _t is for transformed
 
     // Translation
-    vec3h p0_t = p0 - r.origin(); 
-    vec3h p1_t = p1 - r.origin();
-    vec3h p2_t = p2 - r.origin();
+    const vec3d origin(r.origin());
+    vec3d p0_t = p0 - origin; 
+    vec3d p1_t = p1 - origin;
+    vec3d p2_t = p2 - origin;
 
     // Permutation, desire z axis as longest axis
-    permutation(r.direction(), dir_t, p0_t, p1_t, p2_t);
+    permutation(vec3d(r.direction()), dir_t, p0_t, p1_t, p2_t);
 
     // Shearing
     shear(dir_t, p0_t, p1_t, p2_t);
@@ -128,6 +215,8 @@ triangleIntersection triangle::check_intersection(const ray& r, interval ray_t,
     if (!((e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0))) {
         return triangleIntersection(); // (0,0) not in triangle 
     }
+    // Degenerate triangles and rays in the triangle's plane, no sqrt'd area needed to catch them
+    if (det == 0) return triangleIntersection();
 
     // Get barycentric coordinates
     double inverse_det = 1.0 / det;
@@ -143,8 +232,9 @@ triangleIntersection triangle::check_intersection(const ray& r, interval ray_t,
     return triangleIntersection{b0, b1, b2, dist};  // This object would hold the intersection information
 }
 
-void triangle::permutation(vec3h direction, vec3h& dirt, vec3h& p0t, vec3h& p1t, vec3h& p2t) const {
-    int longest_axis = direction.max_dimen();
+void triangle::permutation(vec3d direction, vec3d& dirt, vec3d& p0t, vec3d& p1t, vec3d& p2t) {
+    // Longest by magnitude, a negative component can be the longest and z must not end up near 0
+    int longest_axis = vec3d(std::fabs(direction.x), std::fabs(direction.y), std::fabs(direction.z), 0).max_dimen();
     double temp = 0.0;
     if (longest_axis == 0) {
         dirt.x = direction.z;
@@ -186,7 +276,7 @@ void triangle::permutation(vec3h direction, vec3h& dirt, vec3h& p0t, vec3h& p1t,
     }
 }
 
-void triangle::shear(vec3h& dirt, vec3h& p0t, vec3h& p1t, vec3h& p2t) const{
+void triangle::shear(vec3d& dirt, vec3d& p0t, vec3d& p1t, vec3d& p2t) {
     double shear_x = -dirt.x / dirt.z;
     double shear_y = -dirt.y / dirt.z;
     double shear_z = 1.0 / dirt.z;
@@ -202,7 +292,7 @@ void triangle::shear(vec3h& dirt, vec3h& p0t, vec3h& p1t, vec3h& p2t) const{
     p2t.z *= shear_z;
 }
 
-double triangle::area(const vec3h& p0, const vec3h& p1, const vec3h& p2) const {    
+double triangle::area(const vec3h& p0, const vec3h& p1, const vec3h& p2) {    
     // Calculates the area of a triangle given the 3 points that define it's vertice
     // recall cross length gives area of parallelogram, so we half that
     vec3h a = p1 - p0;
@@ -230,24 +320,19 @@ double triangle::area() const {
 }
 
 Bounds3f triangle::bounds() const  { 
-    int i0 = mesh->indices[3 * mesh_index];
-    int i1 = mesh->indices[3 * mesh_index + 1];
-    int i2 = mesh->indices[3 * mesh_index + 2];
-    
-    vec3h p0 = mesh->vertices[i0];
-    vec3h p1 = mesh->vertices[i1];
-    vec3h p2 = mesh->vertices[i2];
+    return bounds(*mesh, mesh_index);
+}
 
-    Bounds3f b = Bounds3f(p0, p1);
-    b.expand(p2);
+Bounds3f triangle::bounds(const triangleMesh& mesh, int index) {
+    Bounds3f b(vec3h(mesh.vertices[mesh.indices[3 * index]]), vec3h(mesh.vertices[mesh.indices[3 * index + 1]]));
+    b.expand(vec3h(mesh.vertices[mesh.indices[3 * index + 2]]));
     return b;
 }
 
 Bounds3f triangleMesh::bounds() {
     Bounds3f full_bounds;
     for (int i = 0; i < num_triangles; i++) {
-        triangle curr = triangle(this, i);
-        full_bounds = Union(full_bounds, curr.bounds());
+        full_bounds = Union(full_bounds, triangle::bounds(*this, i));
     }
     total_bound = full_bounds;
     return full_bounds;
@@ -0,0 +1,190 @@
+#ifndef TRIANGLE_BLOCK_H
+#define TRIANGLE_BLOCK_H
+/*
+Four triangles of a BVH leaf with their vertices copied out structure of arrays, so one ray
+is tested against all of them with a few vector instructions and no index lookups.
+The math is the same watertight test as triangle::check_intersection (translate, permute,
+shear, edge functions) done per lane in the same order, so a block finds exactly the hits
+and distances the scalar test finds.
+*/
+
+#include <cstdint>
+#include <vector>
+#include "triangle.h"
+#include "../acceleration/bvh_util.h"
+
+#if defined(RT_SIMD_SSE)
+#include <immintrin.h>
+#endif
+
+constexpr int triangle_block_width = 4;
+
+struct triangle_block {
+    // Vertex coordinates as [axis][lane]. Unused lanes keep all three vertices at the origin,
+    // every edge function is then 0 and the lane is rejected like any degenerate triangle.
+    alignas(32) double p0[3][triangle_block_width];
+    alignas(32) double p1[3][triangle_block_width];
+    alignas(32) double p2[3][triangle_block_width];
+    primitive_ref refs[triangle_block_width];
+    int count = 0;
+
+    triangle_block() {
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int k = 0; k < triangle_block_width; ++k) {
+                p0[axis][k] = p1[axis][k] = p2[axis][k] = 0;
+            }
+        }
+        for (int k = 0; k < triangle_block_width; ++k) refs[k] = 0;
+    }
+
+    void add(const triangleMesh& mesh, int index, primitive_ref ref) {
+        const vec3f& a = mesh.vertices[mesh.indices[3 * index]];
+        const vec3f& b = mesh.vertices[mesh.indices[3 * index + 1]];
+        const vec3f& c = mesh.vertices[mesh.indices[3 * index + 2]];
+        for (int axis = 0; axis < 3; ++axis) {
+            p0[axis][count] = a[axis];
+            p1[axis][count] = b[axis];
+            p2[axis][count] = c[axis];
+        }
+        refs[count++] = ref;
+    }
+};
+
+struct triangle_ray {
+    /* Per ray half of the watertight test, worked out once and reused for every block */
+    int kx, ky, kz;
+    double ox, oy, oz;  // Origin, permuted
+    double sx, sy, sz;  // Shear
+
+    explicit triangle_ray(const ray& r) {
+        const vec3d d(r.direction());
+        // Same permutation as triangle::permutation, swap the longest axis with z
+        kz = vec3d(std::fabs(d.x), std::fabs(d.y), std::fabs(d.z), 0).max_dimen();
+        kx = (kz == 0) ? 2 : 0;
+        ky = (kz == 1) ? 2 : 1;
+        const vec3d o(r.origin());
+        ox = o[kx]; oy = o[ky]; oz = o[kz];
+        sx = -d[kx] / d[kz];
+        sy = -d[ky] / d[kz];
+        sz = 1.0 / d[kz];
+    }
+};
+
+inline int intersect_triangle_block(const triangle_block& block, const triangle_ray& tr, double t_min, double t_max, double t_hit[triangle_block_width]) {
+    /*
+    Returns a bit mask of the lanes hit within [t_min, t_max] and writes each lane's distance
+    to t_hit. A lane is hit when its three edge functions share a sign and they don't sum to 0.
+    */
+    int mask = 0;
+#if defined(RT_SIMD_AVX)
+    const __m256d ox = _mm256_set1_pd(tr.ox), oy = _mm256_set1_pd(tr.oy), oz = _mm256_set1_pd(tr.oz);
+    const __m256d sx = _mm256_set1_pd(tr.sx), sy = _mm256_set1_pd(tr.sy), sz = _mm256_set1_pd(tr.sz);
+    const __m256d zero = _mm256_setzero_pd();
+
+    __m256d p0x = _mm256_sub_pd(_mm256_load_pd(block.p0[tr.kx]), ox);
+    __m256d p0y = _mm256_sub_pd(_mm256_load_pd(block.p0[tr.ky]), oy);
+    __m256d p0z = _mm256_sub_pd(_mm256_load_pd(block.p0[tr.kz]), oz);
+    __m256d p1x = _mm256_sub_pd(_mm256_load_pd(block.p1[tr.kx]), ox);
+    __m256d p1y = _mm256_sub_pd(_mm256_load_pd(block.p1[tr.ky]), oy);
+    __m256d p1z = _mm256_sub_pd(_mm256_load_pd(block.p1[tr.kz]), oz);
+    __m256d p2x = _mm256_sub_pd(_mm256_load_pd(block.p2[tr.kx]), ox);
+    __m256d p2y = _mm256_sub_pd(_mm256_load_pd(block.p2[tr.ky]), oy);
+    __m256d p2z = _mm256_sub_pd(_mm256_load_pd(block.p2[tr.kz]), oz);
+
+    p0x = _mm256_add_pd(p0x, _mm256_mul_pd(p0z, sx));
+    p0y = _mm256_add_pd(p0y, _mm256_mul_pd(p0z, sy));
+    p0z = _mm256_mul_pd(p0z, sz);
+    p1x = _mm256_add_pd(p1x, _mm256_mul_pd(p1z, sx));
+    p1y = _mm256_add_pd(p1y, _mm256_mul_pd(p1z, sy));
+    p1z = _mm256_mul_pd(p1z, sz);
+    p2x = _mm256_add_pd(p2x, _mm256_mul_pd(p2z, sx));
+    p2y = _mm256_add_pd(p2y, _mm256_mul_pd(p2z, sy));
+    p2z = _mm256_mul_pd(p2z, sz);
+
+    __m256d e0 = _mm256_sub_pd(_mm256_mul_pd(p1x, p2y), _mm256_mul_pd(p1y, p2x));
+    __m256d e1 = _mm256_sub_pd(_mm256_mul_pd(p2x, p0y), _mm256_mul_pd(p2y, p0x));
+    __m256d e2 = _mm256_sub_pd(_mm256_mul_pd(p0x, p1y), _mm256_mul_pd(p0y, p1x));
+    __m256d det = _mm256_add_pd(_mm256_add_pd(e0, e1), e2);
+
+    __m256d all_ge = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(e0, zero, _CMP_GE_OQ), _mm256_cmp_pd(e1, zero, _CMP_GE_OQ)), _mm256_cmp_pd(e2, zero, _CMP_GE_OQ));
+    __m256d all_le = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(e0, zero, _CMP_LE_OQ), _mm256_cmp_pd(e1, zero, _CMP_LE_OQ)), _mm256_cmp_pd(e2, zero, _CMP_LE_OQ));
+    __m256d valid = _mm256_and_pd(_mm256_or_pd(all_ge, all_le), _mm256_cmp_pd(det, zero, _CMP_NEQ_OQ));
+    if (_mm256_movemask_pd(valid) == 0) return 0;
+
+    __m256d inverse_det = _mm256_div_pd(_mm256_set1_pd(1.0), det);
+    __m256d dist = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(e0, inverse_det), p0z),
+                                               _mm256_mul_pd(_mm256_mul_pd(e1, inverse_det), p1z)),
+                                 _mm256_mul_pd(_mm256_mul_pd(e2, inverse_det), p2z));
+    valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(dist, _mm256_set1_pd(t_min), _CMP_NLT_UQ),
+                                               _mm256_cmp_pd(dist, _mm256_set1_pd(t_max), _CMP_NGT_UQ)));
+    _mm256_storeu_pd(t_hit, dist);
+    mask = _mm256_movemask_pd(valid);
+#elif defined(RT_SIMD_SSE)
+    const __m128d ox = _mm_set1_pd(tr.ox), oy = _mm_set1_pd(tr.oy), oz = _mm_set1_pd(tr.oz);
+    const __m128d sx = _mm_set1_pd(tr.sx), sy = _mm_set1_pd(tr.sy), sz = _mm_set1_pd(tr.sz);
+    const __m128d zero = _mm_setzero_pd();
+    for (int k = 0; k < triangle_block_width; k += 2) {
+        __m128d p0x = _mm_sub_pd(_mm_load_pd(block.p0[tr.kx] + k), ox);
+        __m128d p0y = _mm_sub_pd(_mm_load_pd(block.p0[tr.ky] + k), oy);
+        __m128d p0z = _mm_sub_pd(_mm_load_pd(block.p0[tr.kz] + k), oz);
+        __m128d p1x = _mm_sub_pd(_mm_load_pd(block.p1[tr.kx] + k), ox);
+        __m128d p1y = _mm_sub_pd(_mm_load_pd(block.p1[tr.ky] + k), oy);
+        __m128d p1z = _mm_sub_pd(_mm_load_pd(block.p1[tr.kz] + k), oz);
+        __m128d p2x = _mm_sub_pd(_mm_load_pd(block.p2[tr.kx] + k), ox);
+        __m128d p2y = _mm_sub_pd(_mm_load_pd(block.p2[tr.ky] + k), oy);
+        __m128d p2z = _mm_sub_pd(_mm_load_pd(block.p2[tr.kz] + k), oz);
+
+        p0x = _mm_add_pd(p0x, _mm_mul_pd(p0z, sx));
+        p0y = _mm_add_pd(p0y, _mm_mul_pd(p0z, sy));
+        p0z = _mm_mul_pd(p0z, sz);
+        p1x = _mm_add_pd(p1x, _mm_mul_pd(p1z, sx));
+        p1y = _mm_add_pd(p1y, _mm_mul_pd(p1z, sy));
+        p1z = _mm_mul_pd(p1z, sz);
+        p2x = _mm_add_pd(p2x, _mm_mul_pd(p2z, sx));
+        p2y = _mm_add_pd(p2y, _mm_mul_pd(p2z, sy));
+        p2z = _mm_mul_pd(p2z, sz);
+
+        __m128d e0 = _mm_sub_pd(_mm_mul_pd(p1x, p2y), _mm_mul_pd(p1y, p2x));
+        __m128d e1 = _mm_sub_pd(_mm_mul_pd(p2x, p0y), _mm_mul_pd(p2y, p0x));
+        __m128d e2 = _mm_sub_pd(_mm_mul_pd(p0x, p1y), _mm_mul_pd(p0y, p1x));
+        __m128d det = _mm_add_pd(_mm_add_pd(e0, e1), e2);
+
+        __m128d all_ge = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(e0, zero), _mm_cmpge_pd(e1, zero)), _mm_cmpge_pd(e2, zero));
+        __m128d all_le = _mm_and_pd(_mm_and_pd(_mm_cmple_pd(e0, zero), _mm_cmple_pd(e1, zero)), _mm_cmple_pd(e2, zero));
+        __m128d valid = _mm_and_pd(_mm_or_pd(all_ge, all_le), _mm_cmpneq_pd(det, zero));
+        if (_mm_movemask_pd(valid) == 0) continue;
+
+        __m128d inverse_det = _mm_div_pd(_mm_set1_pd(1.0), det);
+        __m128d dist = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_mul_pd(e0, inverse_det), p0z),
+                                             _mm_mul_pd(_mm_mul_pd(e1, inverse_det), p1z)),
+                                  _mm_mul_pd(_mm_mul_pd(e2, inverse_det), p2z));
+        valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpnlt_pd(dist, _mm_set1_pd(t_min)), _mm_cmpngt_pd(dist, _mm_set1_pd(t_max))));
+        _mm_storeu_pd(t_hit + k, dist);
+        mask |= _mm_movemask_pd(valid) << k;
+    }
+#else
+    for (int k = 0; k < triangle_block_width; ++k) {
+        double p0x = block.p0[tr.kx][k] - tr.ox, p0y = block.p0[tr.ky][k] - tr.oy, p0z = block.p0[tr.kz][k] - tr.oz;
+        double p1x = block.p1[tr.kx][k] - tr.ox, p1y = block.p1[tr.ky][k] - tr.oy, p1z = block.p1[tr.kz][k] - tr.oz;
+        double p2x = block.p2[tr.kx][k] - tr.ox, p2y = block.p2[tr.ky][k] - tr.oy, p2z = block.p2[tr.kz][k] - tr.oz;
+        p0x += p0z * tr.sx; p0y += p0z * tr.sy; p0z *= tr.sz;
+        p1x += p1z * tr.sx; p1y += p1z * tr.sy; p1z *= tr.sz;
+        p2x += p2z * tr.sx; p2y += p2z * tr.sy; p2z *= tr.sz;
+
+        double e0 = (p1x * p2y) - (p1y * p2x);
+        double e1 = (p2x * p0y) - (p2y * p0x);
+        double e2 = (p0x * p1y) - (p0y * p1x);
+        double det = e0 + e1 + e2;
+        if (!((e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0)) || det == 0) continue;
+
+        double inverse_det = 1.0 / det;
+        double dist = (e0 * inverse_det) * p0z + (e1 * inverse_det) * p1z + (e2 * inverse_det) * p2z;
+        if (dist < t_min || dist > t_max) continue;
+        t_hit[k] = dist;
+        mask |= 1 << k;
+    }
+#endif
+    return mask;
+}
+
+#endif
@@ -3,18 +3,19 @@
 
 #include "geometry/vec3.h"
 
-class ray {
+template <typename T>
+class ray_t {
 private:
-    vec3h orig;
-    vec3h dir;
-    vec3h inv_dir;
+    vec3h_t<T> orig;
+    vec3h_t<T> dir;
+    vec3h_t<T> inv_dir;
     bool signx, signy, signz; // https://dl.acm.org/doi/abs/10.1145/1198555.1198748 
 public:
 
-    ray() : orig(vec3h()), dir(vec3h()), inv_dir(vec3h()), signx(false), signy(false), signz(false) {}
+    ray_t() : orig(vec3h_t<T>()), dir(vec3h_t<T>()), inv_dir(vec3h_t<T>()), signx(false), signy(false), signz(false) {}
 
-    ray(const vec3h& origin, const vec3h& direction) : orig(origin), dir(direction) {
-          inv_dir = vec3h(
+    ray_t(const vec3h_t<T>& origin, const vec3h_t<T>& direction) : orig(origin), dir(direction) {
+          inv_dir = vec3h_t<T>(
               1.0 / (fabs(direction.x) > 1e-6f ? direction.x : 1.0e-6),
               1.0 / (fabs(direction.y) > 1e-6f ? direction.y : 1.0e-6),
               1.0 / (fabs(direction.z) > 1e-6f ? direction.z : 1.0e-6), 
@@ -26,16 +27,16 @@ public:
           signz = (inv_dir.z >= 0);
     }
 
-    const vec3h& origin() const  { return orig; }
-    const vec3h& direction() const { return dir; }
-    const vec3h& inv_direction() const { return inv_dir; }
+    const vec3h_t<T>& origin() const  { return orig; }
+    const vec3h_t<T>& direction() const { return dir; }
+    const vec3h_t<T>& inv_direction() const { return inv_dir; }
     const bool sign_x() const { return signx; }
     const bool sign_y() const { return signy; }
     const bool sign_z() const { return signz; }
 
-    void set_direction(vec3h& d) {
+    void set_direction(vec3h_t<T>& d) {
         dir = d;
-        inv_dir = vec3h(
+        inv_dir = vec3h_t<T>(
             1.0 / (fabs(d.x) > 1e-6f ? d.x : 1.0e-6),
             1.0 / (fabs(d.y) > 1e-6f ? d.y : 1.0e-6),
             1.0 / (fabs(d.z) > 1e-6f ? d.z : 1.0e-6), 
@@ -46,14 +47,16 @@ public:
         return;
     }
 
-    void set_origin(vec3h& o) {
+    void set_origin(vec3h_t<T>& o) {
         orig = o;
         return;
     }
 
-    vec3h line(double t) const {
+    vec3h_t<T> line(T t) const {
         return orig + t*dir;
     }
 };
 
+using ray = ray_t<Float>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+/*
+The scene's emissive triangles and spheres, for sampling points on lights directly. A light
+is picked with probability proportional to its area and a point uniformly on it, so every
+point on every light has the same area density 1 / total_area. The pdf of a light hit found
+by BSDF sampling therefore only needs the hit itself, not which light it was.
+
+Emitters inside instances or other hittable objects are not collected, paths still find
+them by hitting them. Lights are kept by primitive_ref, so only hits on a collected
+primitive get an MIS weight, not every surface sharing a light's material.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "../primitive_shapes/primitive_store.h"
+
+struct light_sample {
+    vec3h p;        // Point on the light
+    vec3h normal;   // Outward surface normal there
+    color emitted;  // Radiance the light gives off at p
+    double pdf;     // Area density of p, 1 / total_area
+};
+
+class light_list {
+public:
+    light_list() {}
+    light_list(const primitive_store& store) : table(store.materials) {
+        for (size_t i = 0; i < store.triangles.size(); i++) {
+            const mesh_triangle& tri = store.triangles[i];
+            const triangleMesh& mesh = *store.meshes[tri.mesh];
+            if (!(*store.materials)[mesh.material].emits()) continue;
+            emitter e;
+            e.p0 = mesh.vertices[mesh.indices[3 * tri.index]];
+            e.p1 = mesh.vertices[mesh.indices[3 * tri.index + 1]];
+            e.p2 = mesh.vertices[mesh.indices[3 * tri.index + 2]];
+            e.radius = 0;
+            e.material = mesh.material;
+            add(e, mesh.data(tri.index).area, make_primitive_ref(PRIM_TRIANGLE, static_cast<uint32_t>(i)));
+        }
+        for (size_t i = 0; i < store.spheres.size(); i++) {
+            const sphere& s = store.spheres[i];
+            if (!(*store.materials)[s.material].emits()) continue;
+            emitter e;
+            e.p0 = s.get_center();
+            e.radius = s.get_radius();
+            e.material = s.material;
+            add(e, 4 * pi * e.radius * e.radius, make_primitive_ref(PRIM_SPHERE, static_cast<uint32_t>(i)));
+        }
+    }
+
+    bool empty() const { return emitters.empty(); }
+    size_t size() const { return emitters.size(); }
+    double total_area() const { return cdf.empty() ? 0 : cdf.back(); }
+
+    bool contains(uint32_t primitive) const {
+        // Whether the primitive a hit_record names is sampled, so hits on it need an MIS weight
+        return std::binary_search(primitives.begin(), primitives.end(), primitive);
+    }
+
+    bool sample(double u_light, double u1, double u2, light_sample& s) const {
+        /* u_light picks the light by area through the cdf, u1 and u2 the point on it */
+        if (emitters.empty()) return false;
+        double target = u_light * cdf.back();
+        size_t k = std::upper_bound(cdf.begin(), cdf.end(), target) - cdf.begin();
+        const emitter& e = emitters[std::min(k, emitters.size() - 1)];
+
+        double u = 0, v = 0;
+        if (e.radius == 0) {
+            // Uniform on the triangle, Osada et al. 2002
+            double su = std::sqrt(u1);
+            double b1 = u2 * su, b0 = 1 - su;
+            s.p = b0 * e.p0 + b1 * e.p1 + (1 - b0 - b1) * e.p2;
+            s.normal = cross_product(e.p1 - e.p0, e.p2 - e.p0).normal_of();
+        } else {
+            double z = 1 - 2 * u1;
+            double r = std::sqrt(std::max(0.0, 1 - z * z));
+            double phi = 2 * pi * u2;
+            s.normal = vec3h(r * std::cos(phi), r * std::sin(phi), z, 0);
+            s.p = e.p0 + e.radius * s.normal;
+            sphere::get_sphere_uv(s.normal, u, v);
+        }
+        s.emitted = (*table)[e.material].emitted(u, v, s.p);
+        s.pdf = 1.0 / cdf.back();
+        return true;
+    }
+
+    double pdf(const vec3h& origin, const hit_record& rec) const {
+        // Solid angle density sample() gives the light point rec as seen from origin
+        vec3h to_light = rec.p - origin;
+        double cos_light = std::fabs(dot(to_light.normal_of(), rec.normal));
+        if (cos_light <= 0 || cdf.empty()) return 0;
+        return dot(to_light, to_light) / (cos_light * cdf.back());
+    }
+
+private:
+    struct emitter {
+        vec3h p0, p1, p2;  // Triangle corners, or the center in p0 for a sphere
+        double radius;     // 0 for triangles
+        uint32_t material;
+    };
+
+    std::shared_ptr<material_table> table;  // The scene's, what emitter materials index
+    std::vector<emitter> emitters;
+    std::vector<double> cdf;  // Running total of emitter areas
+    std::vector<primitive_ref> primitives;  // Of the emitters, ascending as they're collected in store order
+
+    void add(const emitter& e, double area, primitive_ref ref) {
+        if (area <= 0) return;
+        emitters.push_back(e);
+        cdf.push_back(total_area() + area);
+        primitives.push_back(ref);
+    }
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef RNG_H
+#define RNG_H
+/*
+PCG32 random number generator by Melissa O'Neill, https://www.pcg-random.org
+Small (16 bytes), fast, and cheap to reseed, so each pixel sample can start its own
+stream. Renders then come out the same no matter which thread drew which sample.
+*/
+
+#include <cstdint>
+
+inline uint64_t mix_bits(uint64_t v) {
+    // splitmix64 finalizer, spreads neighbouring inputs (pixel coords, sample ids) apart
+    v ^= (v >> 31);
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= (v >> 27);
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= (v >> 33);
+    return v;
+}
+
+inline uint64_t hash_seed(uint64_t a, uint64_t b, uint64_t c = 0, uint64_t d = 0) {
+    uint64_t h = mix_bits(a + 0x9e3779b97f4a7c15ULL);
+    h = mix_bits(h ^ (b + 0x9e3779b97f4a7c15ULL));
+    h = mix_bits(h ^ (c + 0x9e3779b97f4a7c15ULL));
+    return mix_bits(h ^ (d + 0x9e3779b97f4a7c15ULL));
+}
+
+class pcg32 {
+private:
+    uint64_t state;
+    uint64_t inc;
+
+    static constexpr uint64_t multiplier = 0x5851f42d4c957f2dULL;
+
+public:
+    pcg32() : state(0x853c49e6748fea9bULL), inc(0xda3e39cb94b95bdbULL) {}
+    pcg32(uint64_t seq_index, uint64_t seed = 0x853c49e6748fea9bULL) { set_sequence(seq_index, seed); }
+
+    void set_sequence(uint64_t seq_index, uint64_t seed = 0x853c49e6748fea9bULL) {
+        /*
+        Two generators with different seq_index never produce overlapping streams. Like
+        pcg32_srandom the state is seeded as well as the increment, from seed and a hash of
+        seq_index, so neighbouring stream ids don't start out in step with each other.
+        */
+        state = 0u;
+        inc = (seq_index << 1u) | 1u;
+        next_uint();
+        state += seed ^ mix_bits(seq_index);
+        next_uint();
+    }
+
+    uint32_t next_uint() {
+        uint64_t old_state = state;
+        state = old_state * multiplier + inc;
+        uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    }
+
+    double uniform() {
+        // Returns a random real in [0,1)
+        return next_uint() * 0x1p-32;
+    }
+
+    uint64_t get_state() const { return state; }
+    uint64_t get_inc() const { return inc; }
+    void set_state(uint64_t s, uint64_t i) { state = s; inc = i; }
+};
+
+inline pcg32& thread_rng() {
+    // Generator used by random_double(), one per thread so threads never share state
+    static thread_local pcg32 rng;
+    return rng;
+}
+
+#endif
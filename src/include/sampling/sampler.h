@@ -0,0 +1,283 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+/*
+Samplers hand the camera the uniforms for one pixel sample, one dimension at a time: two
+for the pixel jitter, then a fixed block per bounce for the BSDF and light samples. Every
+value is a pure function of (seed, pixel, sample index, dimension), so renders stay the
+same for any thread count and resume from a checkpoint exactly like the independent
+sampler did.
+
+    SAMPLER_INDEPENDENT  this thread's generator, seeded per pixel sample by the camera
+    SAMPLER_STRATIFIED   jittered strata over the expected sample count, shuffled per dimension
+    SAMPLER_SOBOL        2D Sobol points with hashed Owen scrambling and per dimension index
+                         shuffling, Burley 2020, "Practical Hash-based Owen Scrambling"
+    SAMPLER_RANK1        the R2 rank-1 lattice, offset per pixel by an R2 dither mask so
+                         neighbouring pixels' errors come out as blue noise
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include "rng.h"
+
+enum sampler_type {
+    SAMPLER_INDEPENDENT,
+    SAMPLER_STRATIFIED,
+    SAMPLER_SOBOL,
+    SAMPLER_RANK1
+};
+
+inline uint32_t reverse_bits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    // Randomizes each bit by the bits below it, on bit reversed input this is an Owen scramble
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+inline uint32_t permutation_element(uint32_t i, uint32_t length, uint32_t seed) {
+    /*
+    Element i of a random permutation of [0, length) chosen by seed, without storing it.
+    Kensler 2013, "Correlated Multi-Jittered Sampling", cycle walks a hash over the next
+    power of two until it lands inside the range.
+    */
+    uint32_t mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & mask) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & mask) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & mask) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & mask) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & mask) >> 2;
+        i *= 0xc860a3dfu;
+        i &= mask;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+inline double bits_to_unit(uint32_t bits) {
+    // Top 32 bits as a real in [0,1)
+    return bits * 0x1p-32;
+}
+
+class sampler {
+public:
+    virtual ~sampler() = default;
+
+    void start_pixel_sample(int i, int j, uint32_t sample_index) {
+        px = i;
+        py = j;
+        index = sample_index;
+        dimension = 0;
+    }
+
+    void set_dimension(int d) {
+        // Jumps to a fixed dimension, so a sample that took fewer branches stays in step with its neighbours
+        dimension = d;
+    }
+
+    double get_1d() {
+        double u = sample_1d(dimension);
+        dimension += 1;
+        return u;
+    }
+
+    void get_2d(double& u1, double& u2) {
+        sample_2d(dimension, u1, u2);
+        dimension += 2;
+    }
+
+protected:
+    uint64_t seed;
+    int px = 0, py = 0;
+    uint32_t index = 0;
+    int dimension = 0;
+
+    sampler(uint64_t seed) : seed(seed) {}
+
+    uint32_t dimension_hash(int d, bool per_pixel = true) const {
+        return static_cast<uint32_t>(per_pixel ? hash_seed(seed, px, py, d) : hash_seed(seed, d));
+    }
+
+    virtual double sample_1d(int d) = 0;
+    virtual void sample_2d(int d, double& u1, double& u2) = 0;
+};
+
+class independent_sampler : public sampler {
+public:
+    independent_sampler(uint64_t seed) : sampler(seed) {}
+
+protected:
+    // Same draws as random_double(), taken straight from the generator so this header only needs rng.h
+    double sample_1d(int d) override { return thread_rng().uniform(); }
+    void sample_2d(int d, double& u1, double& u2) override {
+        u1 = thread_rng().uniform();
+        u2 = thread_rng().uniform();
+    }
+};
+
+class stratified_sampler : public sampler {
+    /*
+    One stratum per expected sample in 1D and a square grid of them in 2D, visited in an
+    order shuffled per pixel and dimension so dimensions aren't correlated. Samples past
+    the expected count start a fresh shuffle of the same strata.
+    */
+public:
+    stratified_sampler(uint64_t seed, int samples_per_pixel) :
+        sampler(seed), strata(static_cast<uint32_t>(std::max(samples_per_pixel, 1))),
+        grid(static_cast<uint32_t>(std::max(1.0, std::ceil(std::sqrt(double(strata)))))) {}
+
+protected:
+    uint32_t strata;
+    uint32_t grid;
+
+    double sample_1d(int d) override {
+        uint32_t hash = dimension_hash(d) ^ static_cast<uint32_t>(mix_bits(index / strata));
+        uint32_t stratum = permutation_element(index % strata, strata, hash);
+        return (stratum + jitter(hash, 0)) / strata;
+    }
+
+    void sample_2d(int d, double& u1, double& u2) override {
+        uint32_t cells = grid * grid;
+        uint32_t hash = dimension_hash(d) ^ static_cast<uint32_t>(mix_bits(index / cells));
+        uint32_t cell = permutation_element(index % cells, cells, hash);
+        u1 = ((cell % grid) + jitter(hash, 0)) / grid;
+        u2 = ((cell / grid) + jitter(hash, 1)) / grid;
+    }
+
+    double jitter(uint32_t hash, int axis) const {
+        return bits_to_unit(static_cast<uint32_t>(hash_seed(hash, index, axis)));
+    }
+};
+
+class sobol_sampler : public sampler {
+    /*
+    The first two Sobol dimensions (0,2)-sequence, which is well stratified over any power
+    of two run of samples. Each dimension pair gets its own Owen scramble of the points and
+    its own nested scramble of the sample index, which pads the 2D sequence out to as many
+    dimensions as a path needs without the correlation between them Sobol's higher
+    dimensions would bring.
+    */
+public:
+    sobol_sampler(uint64_t seed) : sampler(seed) {}
+
+protected:
+    static uint32_t sobol_1(uint32_t i) {
+        // Second Sobol dimension, direction numbers v_k = v_(k-1) ^ (v_(k-1) >> 1) from v_0 = 2^31
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1) {
+            if (i & 1) result ^= v;
+        }
+        return result;
+    }
+
+    double sample_1d(int d) override {
+        uint32_t hash = dimension_hash(d);
+        uint32_t shuffled = nested_uniform_scramble(index, hash);
+        return bits_to_unit(nested_uniform_scramble(reverse_bits(shuffled), static_cast<uint32_t>(mix_bits(hash))));
+    }
+
+    void sample_2d(int d, double& u1, double& u2) override {
+        uint32_t hash = dimension_hash(d);
+        uint32_t shuffled = nested_uniform_scramble(index, hash);
+        uint64_t scramble = mix_bits(hash);
+        u1 = bits_to_unit(nested_uniform_scramble(reverse_bits(shuffled), static_cast<uint32_t>(scramble)));
+        u2 = bits_to_unit(nested_uniform_scramble(sobol_1(shuffled), static_cast<uint32_t>(scramble >> 32)));
+    }
+};
+
+class rank1_sampler : public sampler {
+    /*
+    Roberts' R2 sequence, frac(n * (1/g, 1/g^2)) with g the plastic number, and in 1D the
+    golden ratio sequence. Every pixel walks the same lattice from a different offset.
+    The offset is a random rotation per dimension plus the R2 sequence evaluated over pixel
+    coordinates, a dither mask whose values differ as much as possible between neighbours.
+    Every dimension steps along the same sequence, so on their own two dimensions would
+    only differ by a constant and a path would integrate along a line through its cube of
+    uniforms, converging to the wrong value. Past the pixel jitter each dimension therefore
+    visits its block of samples_per_pixel sequence points in its own shuffled order, which
+    keeps each dimension's points and breaks the lockstep between them.
+    */
+public:
+    rank1_sampler(uint64_t seed, int samples_per_pixel) :
+        sampler(seed), strata(static_cast<uint32_t>(std::max(samples_per_pixel, 1))) {}
+
+protected:
+    uint32_t strata;
+
+    uint32_t shuffled_index(int d) const {
+        if (d == 0) return index;
+        uint32_t block = index / strata;
+        uint32_t hash = dimension_hash(d) ^ static_cast<uint32_t>(mix_bits(block));
+        return block * strata + permutation_element(index % strata, strata, hash);
+    }
+
+    static constexpr double golden = 0.6180339887498949;  // 1 / phi
+    static constexpr double r2_x = 0.7548776662466927;    // 1 / g
+    static constexpr double r2_y = 0.5698402909980532;    // 1 / g^2
+
+    double dither() const {
+        return px * r2_x + py * r2_y;
+    }
+
+    static double wrap(double x) {
+        return x - std::floor(x);
+    }
+
+    double sample_1d(int d) override {
+        double offset = bits_to_unit(dimension_hash(d, false)) + dither();
+        return wrap(offset + shuffled_index(d) * golden);
+    }
+
+    void sample_2d(int d, double& u1, double& u2) override {
+        double offset = dither();
+        uint32_t n = shuffled_index(d);
+        u1 = wrap(bits_to_unit(dimension_hash(d, false)) + offset + n * r2_x);
+        u2 = wrap(bits_to_unit(dimension_hash(d + 1, false)) + offset + n * r2_y);
+    }
+};
+
+inline std::unique_ptr<sampler> make_sampler(sampler_type type, uint64_t seed, int samples_per_pixel) {
+    switch (type) {
+    case SAMPLER_STRATIFIED:
+        return std::make_unique<stratified_sampler>(seed, samples_per_pixel);
+    case SAMPLER_SOBOL:
+        return std::make_unique<sobol_sampler>(seed);
+    case SAMPLER_RANK1:
+        return std::make_unique<rank1_sampler>(seed, samples_per_pixel);
+    default:
+        return std::make_unique<independent_sampler>(seed);
+    }
+}
+
+#endif
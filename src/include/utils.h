@@ -6,6 +6,25 @@
 #include <limits>
 #include <memory>
 #include <cstdlib>
+#include "sampling/rng.h"
+
+// Scalar type of the core math: vec3h, Bounds3f, ray, squareMatrix and transform are
+// instantiated with it. Double unless the build defines RT_SINGLE_PRECISION, which the
+// RT_PRECISION=FLOAT CMake option does.
+#ifdef RT_SINGLE_PRECISION
+using Float = float;
+#else
+using Float = double;
+#endif
+
+// SIMD paths follow the compiler's target flags. RT_SIMD_SCALAR, set by RT_SIMD=SCALAR,
+// keeps the portable loops on any target.
+#if !defined(RT_SIMD_SCALAR) && defined(__AVX__)
+#define RT_SIMD_AVX 1
+#endif
+#if !defined(RT_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || defined(__AVX__))
+#define RT_SIMD_SSE 1
+#endif
 
 // C++ Std Usings
 
@@ -24,8 +43,8 @@ inline double degrees_to_radians(double degrees) {
 }
 
 inline double random_double() {
-    // Returns a random real in [0,1).
-    return std::rand() / (RAND_MAX + 1.0);
+    // Returns a random real in [0,1) from this thread's generator.
+    return thread_rng().uniform();
 }
 
 inline double random_double(double min, double max) {
@@ -33,6 +52,11 @@ inline double random_double(double min, double max) {
     return min + (max-min)*random_double();
 }
 
+inline void seed_random(uint64_t seed) {
+    // Restarts this thread's generator, the same seed always replays the same numbers
+    thread_rng().set_sequence(seed);
+}
+
 // Common Headers
 #include "color.h"
 #include "ray.h"
@@ -6,119 +6,91 @@
 #include "../include/camera.h"
 #include "../include/acceleration/bvh_aggregate.h"
 #include "../include/obj_loader.h"
+#include "../include/primitive_shapes/instance.h"
 
 
 void pin() {
     hittable_list world;
     auto tex = make_shared<checker_texture>(0.5, color(0.2, 0.2, 0.2), color(0.8, 0.8, 0.8));
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.3, 0.05, 0));
-    auto difflight = make_shared<diffuse_light>(color(4,4,4));
+    auto material_ground = world.materials->add(make_shared<lambertian>(color(0.8, 0.3, 0.05, 0)));
+    auto difflight = world.materials->add(make_shared<diffuse_light>(color(4,4,4)));
 
     //ground
-    world.add(make_shared<sphere>(vec3h(0,-1001,0, 1), 1000, make_shared<lambertian>(tex)));
+    world.add(make_shared<sphere>(vec3h(0,-1001,0, 1), 1000, world.materials->add(make_shared<lambertian>(tex))));
     quadrilateral light(vec3h(-8,10,8,1), vec3h(20,0,0), vec3h(0,0,-20), difflight);
 
     world.add(&light);
     
+    // Every piece is loaded and given a BVH once, placed copies are instances of it
     obj_loader loader;
 
-    triangleMesh knight(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/knight.obj", knight);
+    triangleMesh knight_mesh(material_ground);
+    loader.load_into_triangleMesh("src/resources/chess/knight.obj", knight_mesh);
+    auto knight = make_mesh_bvh(&knight_mesh, world.materials);
     transform rot_x = rotateX(-pi / 2);
     transform rot_y = rotateY(-pi / 2.5);
     transform knight_rot_z = rotateZ(pi / 6);
     transform shift = translate(vec3h(3, -1, -5, 0));
     transform knight_scale = scale(0.6, 0.6, 0.6);
-    knight.apply_total_transform(knight_scale);
-    knight.apply_total_transform(rot_x);
-    knight.apply_total_transform(rot_y);
-    knight.apply_total_transform(knight_rot_z);
-    knight.apply_total_transform(shift);
-    world.add(&knight);
+    transform place = combine_transform(shift, knight_rot_z, rot_y, rot_x);
+    place = combine_transform(place, knight_scale);
+    world.add(make_shared<instance>(knight, place));
+
+    triangleMesh pawn_mesh(material_ground);
+    loader.load_into_triangleMesh("src/resources/chess/pawn.obj", pawn_mesh);
+    auto pawn = make_mesh_bvh(&pawn_mesh, world.materials);
 
-    triangleMesh pawn1(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/pawn.obj", pawn1);
     transform rot_z = rotateZ(pi / 6);
     rot_x = rotateX(pi / 2);
-    rot_y = rotateY(pi / 16);
     shift = translate(vec3h(5.5, 3, -15, 0));
     transform scale_a = scale(0.35, 0.35, 0.35);
-    pawn1.apply_total_transform(scale_a);
-    pawn1.apply_total_transform(rot_x);
-    pawn1.apply_total_transform(rot_z);
-    pawn1.apply_total_transform(shift);
-    world.add(&pawn1);
+    world.add(make_shared<instance>(pawn, combine_transform(shift, rot_z, rot_x, scale_a)));
 
-    triangleMesh pawn2(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/pawn.obj", pawn2);
     rot_z = rotateZ(-pi / 6);
     rot_x = rotateX(-pi / 2);
-    rot_y = rotateY(-pi / 8);
     shift = translate(vec3h(0.5, -1.5, -14, 0));
-    scale_a = scale(0.35, 0.35, 0.35);
-    pawn2.apply_total_transform(scale_a);
-    pawn2.apply_total_transform(rot_x);
-    pawn2.apply_total_transform(rot_z);
-    pawn2.apply_total_transform(shift);
-    world.add(&pawn2);
+    world.add(make_shared<instance>(pawn, combine_transform(shift, rot_z, rot_x, scale_a)));
 
-    triangleMesh pawn3(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/pawn.obj", pawn3);
     rot_z = rotateZ(pi / 4);
     rot_x = rotateX(-pi / 2);
-    rot_y = rotateY(-pi / 6);
     shift = translate(vec3h(-5, 3, -17, 0));
-    scale_a = scale(0.35, 0.35, 0.35);
-    pawn3.apply_total_transform(scale_a);
-    pawn3.apply_total_transform(rot_x);
-    pawn3.apply_total_transform(rot_z);
-    pawn3.apply_total_transform(shift);
-    world.add(&pawn3);
+    world.add(make_shared<instance>(pawn, combine_transform(shift, rot_z, rot_x, scale_a)));
 
-    triangleMesh rook(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/rook.obj", rook);
+    triangleMesh rook_mesh(material_ground);
+    loader.load_into_triangleMesh("src/resources/chess/rook.obj", rook_mesh);
+    auto rook = make_mesh_bvh(&rook_mesh, world.materials);
     rot_z = rotateZ(pi / 4);
     rot_x = rotateX(-pi / 2.3);
-    rot_y = rotateY(-pi / 6);
     shift = translate(vec3h(-2, 1.5, -9, 0));
-    scale_a = scale(0.35, 0.35, 0.35);
-    rook.apply_total_transform(scale_a);
-    rook.apply_total_transform(rot_x);
-    rook.apply_total_transform(rot_z);
-    rook.apply_total_transform(shift);
-    world.add(&rook);
+    world.add(make_shared<instance>(rook, combine_transform(shift, rot_z, rot_x, scale_a)));
 
-    triangleMesh king(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/king.obj", king);
+    triangleMesh king_mesh(material_ground);
+    loader.load_into_triangleMesh("src/resources/chess/king.obj", king_mesh);
+    auto king = make_mesh_bvh(&king_mesh, world.materials);
     rot_z = rotateZ(-pi / 5);
     rot_x = rotateX(-pi / 2);
     rot_y = rotateY(-pi / 8);
     shift = translate(vec3h(-1.5, 0, -1, 0));
-    scale_a = scale(0.35, 0.35, 0.35);
-    king.apply_total_transform(scale_a);
-    king.apply_total_transform(rot_x);
-    king.apply_total_transform(rot_z);
-    king.apply_total_transform(rot_y);
-    king.apply_total_transform(shift);
-    world.add(&king);
+    place = combine_transform(shift, rot_y, rot_z, rot_x);
+    place = combine_transform(place, scale_a);
+    world.add(make_shared<instance>(king, place));
 
-    triangleMesh queen(material_ground);
-    loader.load_into_triangleMesh("src/resources/chess/queen.obj", queen);
+    triangleMesh queen_mesh(material_ground);
+    loader.load_into_triangleMesh("src/resources/chess/queen.obj", queen_mesh);
+    auto queen = make_mesh_bvh(&queen_mesh, world.materials);
     rot_z = rotateZ(-pi / 16);
     rot_x = rotateX(-pi / 1.75);
     rot_y = rotateY(pi / 5);
     shift = translate(vec3h(-0.2, 0, -6, 0));
-    scale_a = scale(0.3, 0.3, 0.3);
-    queen.apply_total_transform(scale_a);
-    queen.apply_total_transform(rot_x);
-    queen.apply_total_transform(rot_z);
-    queen.apply_total_transform(rot_y);
-    queen.apply_total_transform(shift);
-    world.add(&queen);
+    transform queen_scale = scale(0.3, 0.3, 0.3);
+    place = combine_transform(shift, rot_y, rot_z, rot_x);
+    place = combine_transform(place, queen_scale);
+    world.add(make_shared<instance>(queen, place));
 
 
-    Bounds3f meshbounds = knight.bounds();
-    BVHAggregate bvh(world.objects, 4);
+    BVHAggregate bvh(world, 4);
+    std::clog << "BVH build: " << bvh.get_build_seconds() << "s\n";
+    bvh.print_memory_report(std::clog);
     camera cam;
 
     cam.aspect_ratio      = 16.0 / 9.0;
@@ -130,5 +102,8 @@ void pin() {
     cam.lookat   = vec3h(0,0,0);
     cam.tilt_angle = 13.0;
     cam.focus_dist    = 10.0;
-    cam.render(world, bvh.get_head());
+    cam.adaptive_threshold = 0.01;  // Same sample budget, spent where the image is noisy
+    cam.output_path = "chess.png";
+    cam.checkpoint_path = "chess_checkpoint.bin";  // Rerun to resume a killed render
+    cam.render(world, bvh);
 }
\ No newline at end of file
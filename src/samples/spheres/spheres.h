@@ -0,0 +1,68 @@
+#ifndef SPHERES_H
+#define SPHERES_H
+/*
+The random sphere field the raytracer renders by default, shared with the bench scenes.
+*/
+
+#include "../include/utils.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/primitive_shapes/sphere.h"
+
+void add_sphere_scene(hittable_list& world) {
+    // Fixed seed so the random sphere layout is the same every run
+    seed_random(1);
+
+    auto material_ground = world.materials->add(make_shared<lambertian>(color(0.8, 0.8, 0.0, 0)));
+    auto material_center = world.materials->add(make_shared<lambertian>(color(0.1, 0.2, 0.5, 0)));
+    auto material_left   = world.materials->add(make_shared<refractive>(color(0.94, 1, 1, 0), 1.50));
+    auto material_bubble = world.materials->add(make_shared<refractive>(color(1, 1, 0.98, 0), 1.00 / 1.50));
+    auto material_right  = world.materials->add(make_shared<reflective>(color(0.8, 0.6, 0.2, 0)));
+
+    world.add(sphere(vec3h( 0.0, -100.5, -1.0, 1), 100.0, material_ground));
+    world.add(sphere(vec3h( 0.0,    0.0, -1.2, 1),   0.5, material_center));
+    world.add(sphere(vec3h(-1.0,    0.0, -1.0, 1),   0.5, material_left));
+    world.add(sphere(vec3h(-1.0,    0.0, -1.0, 1),   0.4, material_bubble));
+    world.add(sphere(vec3h( 1.0,    0.0, -1.0, 1),   0.5, material_right));
+
+    auto ground_material = world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)));
+    world.add(sphere(vec3h(0,-1000,0, 1), 1000, ground_material));
+
+    for (int a = -5; a < 5; a++) {
+        for (int b = -5; b < 5; b++) {
+            auto choose_mat = random_double();
+            vec3h center(a + 0.9*random_double(), 0.2, b + 0.9*random_double(), 1);
+
+            if ((center - vec3h(4, 0.2, 0, 1)).magnitude() > 0.9) {
+                uint32_t sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = random_unit_vector();
+                    sphere_material = world.materials->add(make_shared<lambertian>(albedo));
+                    world.add(sphere(center, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = random_unit_vector();
+                    sphere_material = world.materials->add(make_shared<reflective>(albedo));
+                    world.add(sphere(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    auto albedo = color(random_double(0.97, 1), random_double(0.97, 1), random_double(0.97, 1), 1);
+                    sphere_material = world.materials->add(make_shared<refractive>(albedo, 1.5));
+                    world.add(sphere(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = world.materials->add(make_shared<refractive>(color(0.98, 0.98, 1, 0), 1.5));
+    world.add(sphere(vec3h(0, 1, 0, 1), 1.0, material1));
+
+    auto material2 = world.materials->add(make_shared<lambertian>(color(0.4, 0.2, 0.1, 0)));
+    world.add(sphere(vec3h(-4, 1, 0, 1), 1.0, material2));
+
+    auto material3 = world.materials->add(make_shared<reflective>(color(0.7, 0.6, 0.5, 0)));
+    world.add(sphere(vec3h(4, 1, 0, 1), 1.0, material3));
+}
+
+#endif
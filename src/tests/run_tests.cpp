@@ -7,6 +7,12 @@
 #include "test_math.h"
 #include "test_triangle.h"
 #include "test_bvh.h"
+#include "test_thread_pool.h"
+#include "test_rng.h"
+#include "test_instance.h"
+#include "test_film.h"
+#include "test_camera.h"
+#include "test_materials.h"
 
 
 int main() {
@@ -15,4 +21,10 @@ int main() {
     run_test_math();
     run_test_bvh();
     run_test_triangle();
+    run_test_thread_pool();
+    run_test_rng();
+    run_test_instance();
+    run_test_film();
+    run_test_camera();
+    run_test_materials();
 }
\ No newline at end of file
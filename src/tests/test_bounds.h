@@ -129,6 +129,45 @@ void test_sphere_bounds() {
     std::cout << "test_bounds_overlaps passed!\n";
 }
 
+void test_ray_intersect() {
+    Bounds3f b(vec3h(0, 0, 0, 1), vec3h(1, 1, 1, 1));
+    interval ray_t(0.001, infinity);
+
+    assert(b.intersect(ray(vec3h(0.5, 0.5, -2, 1), vec3h(0, 0, 1, 0)), ray_t));
+    assert(!b.intersect(ray(vec3h(0.5, 0.5, -2, 1), vec3h(0, 0, -1, 0)), ray_t));
+    assert(!b.intersect(ray(vec3h(0.5, 0.5, -2, 1), vec3h(0, 0, 1, 0)), interval(0.001, 1.5)));
+    // Overlaps in x and y but the z slab is passed before the others are entered
+    assert(!b.intersect(ray(vec3h(-1, -1, 0.5, 1), vec3h(1, 1, 4, 0)), ray_t));
+    std::cout << "test_ray_intersect passed!\n";
+}
+
+void test_compact_bounds_conservative() {
+    /* Float boxes are rounded outward and never miss a ray the double box test hits, even at corners */
+    pcg32 r(5);
+    int hits = 0;
+    for (int i = 0; i < 2000; i++) {
+        vec3h a(r.uniform() * 20 - 10, r.uniform() * 20 - 10, r.uniform() * 20 - 10, 1);
+        vec3h b = a + vec3h(r.uniform() * 0.1, r.uniform() * 3, r.uniform() * 3, 0);
+        Bounds3f exact(a, b);
+        CompactBounds compact(exact);
+        assert(compact.pmin.x <= exact.pmin.x && compact.pmax.x >= exact.pmax.x);
+        assert(compact.pmin.y <= exact.pmin.y && compact.pmax.y >= exact.pmax.y);
+        assert(compact.pmin.z <= exact.pmin.z && compact.pmax.z >= exact.pmax.z);
+
+        // Aim at a corner, the grazing case where rounding could lose a hit, and end the ray there
+        vec3h corner = exact.lerp_point(vec3h(r.uniform() < 0.5, r.uniform() < 0.5, r.uniform() < 0.5, 0));
+        vec3h origin(r.uniform() * 60 - 30, r.uniform() * 60 - 30, r.uniform() * 60 - 30, 1);
+        ray towards(origin, corner - origin);
+        interval ray_t(0.001, 1.0);
+        if (exact.intersect(towards, ray_t)) {
+            assert(compact.intersect(ray_float(towards), round_down(ray_t.min), round_up(ray_t.max)));
+            hits++;
+        }
+    }
+    assert(hits > 200);
+    std::cout << "test_compact_bounds_conservative passed!\n";
+}
+
 int run_test_bounds() {
     std::cout << "\n Starting tests for /geometry/bounds\n\n";
 
@@ -144,6 +183,8 @@ int run_test_bounds() {
     test_bounds_intersection();
     test_bounds_overlaps();
     test_sphere_bounds();
+    test_ray_intersect();
+    test_compact_bounds_conservative();
     return 0;
 }
 
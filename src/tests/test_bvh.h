@@ -2,30 +2,30 @@
 #define TEST_BVH_H
 
 #include <cassert>
+#include <cmath>
 #include <vector>
 #include <iostream>
 #include "../include/acceleration/bvh_aggregate.h" // Include your BVH header
 #include "../include/primitive_shapes/hittable_list.h"
 #include "../include/primitive_shapes/sphere.h"
+#include "../include/primitive_shapes/triangle.h"
 
 void test_empty_primitives() {
-    /* A BVH system with no primitives should have a null head pointer*/
+    /* A BVH system with no primitives should have no nodes*/
     hittable_list world;
     BVHAggregate bvh(world.objects, 1);
 
-    auto node = bvh.get_head();
-    assert(node == nullptr);
+    assert(bvh.get_nodes().empty());
     std::cout << "test_empty_primitives passed!\n";
 }
 
 void test_non_empty_primitives() {
-    /* A BVH system with no primitives should have a null head pointer*/
+    /* A BVH system with primitives should have a root node*/
     hittable_list world;
     world.add(make_shared<sphere>(vec3h(5.0, 0, 0.0, 1), 1.0));
     BVHAggregate bvh(world.objects, 1);
 
-    auto node = bvh.get_head();
-    assert(node != nullptr);
+    assert(!bvh.get_nodes().empty());
     std::cout << "test_non_empty_primitives passed!\n";
 }
 
@@ -36,19 +36,19 @@ void test_leaf_node_creation() {
     world.add(make_shared<sphere>(vec3h(0.0, 0, 0.0, 1), 1.0));
 
     BVHAggregate bvh(world.objects, 1);
-    auto node = bvh.get_head();
+    const auto& nodes = bvh.get_nodes();
 
-    // Check if the returned node is a leaf
-    assert(node != nullptr && "Node should not be nullptr for valid primitives");
-    assert(node->left.get()->isLeaf() && node->right.get()->isLeaf() && "Child nodes should be a leaf without children");
-    assert(node->left.get()->prims.size() == 1  && "Children node should store one primitives");
+    // Check the root splits into two leaves
+    assert(nodes.size() == 3 && !nodes[0].isLeaf() && "Root should be an interior node for valid primitives");
+    assert(nodes[1].isLeaf() && nodes[nodes[0].second_child_offset].isLeaf() && "Child nodes should be a leaf without children");
+    assert(nodes[1].n_prims == 1 && "Children node should store one primitives");
 
     BVHAggregate bvh2(world.objects, 2);
-    node = bvh2.get_head();
+    const auto& nodes2 = bvh2.get_nodes();
 
-    // Check if the returned node is a leaf
-    assert(node != nullptr && "Node should not be nullptr for valid primitives");
-    assert(node->isLeaf() && "Node should be a leaf without children");
+    // Check the root is a leaf
+    assert(nodes2.size() == 1 && "Root should be the only node");
+    assert(nodes2[0].isLeaf() && "Node should be a leaf without children");
 
     std::cout << "test_leaf_node_creation passed!" << std::endl;
 }
@@ -62,16 +62,312 @@ void test_multi_leaf_node_creation() {
     world.add(make_shared<sphere>(vec3h(-1.0, 0, 0.0, 1), 0.4));
 
     BVHAggregate bvh(world.objects, 1);
-    auto node = bvh.get_head();
-    assert(node->left.get()->left == nullptr && "Left nodes left should be a non null node");
+    assert(bvh.get_nodes()[1].isLeaf() && "Left node should be a leaf");
 
     // Same procedure, increase max prims per node
     BVHAggregate bvh2(world.objects, 2);
-    node = bvh2.get_head();
-    assert((node->left.get()->isLeaf()) && node->right.get()->isLeaf() && "Both child nodes should be leafs");
+    const auto& nodes2 = bvh2.get_nodes();
+    assert(nodes2[1].isLeaf() && nodes2[nodes2[0].second_child_offset].isLeaf() && "Both child nodes should be leafs");
     std::cout << "test_multi_leaf_node_creation passed!" << std::endl;
 }
 
+std::vector<shared_ptr<hittable>> random_spheres(int count, uint64_t seed) {
+    // Scattered spheres of mixed size for structural and traversal tests
+    pcg32 r(seed);
+    std::vector<shared_ptr<hittable>> objects;
+    for (int i = 0; i < count; i++) {
+        vec3h center(r.uniform() * 20 - 10, r.uniform() * 20 - 10, r.uniform() * 20 - 10, 1);
+        objects.push_back(make_shared<sphere>(center, 0.1 + r.uniform()));
+    }
+    return objects;
+}
+
+int count_reachable_nodes(const std::vector<LinearBVHNode>& nodes, int index) {
+    // Nodes reached from index through the child links, every flattened node should be reached once
+    if (nodes[index].isLeaf()) return 1;
+    return 1 + count_reachable_nodes(nodes, index + 1) + count_reachable_nodes(nodes, nodes[index].second_child_offset);
+}
+
+void test_flatten_layout() {
+    /* Flattened nodes should be laid out depth first and cover every primitive once */
+    auto objects = random_spheres(200, 1);
+    BVHAggregate bvh(objects, 3);
+    const auto& nodes = bvh.get_nodes();
+    assert((int)nodes.size() == count_reachable_nodes(nodes, 0));
+    assert(bvh.get_primitives().size() == objects.size());
+
+    std::vector<int> covered(objects.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].isLeaf()) {
+            for (int p = 0; p < nodes[i].n_prims; p++) {
+                covered[bvh.get_leaves()[nodes[i].leaf].primitives_offset + p] += 1;
+            }
+        } else {
+            const CompactBounds& first = nodes[i + 1].bounds;
+            const CompactBounds& second = nodes[nodes[i].second_child_offset].bounds;
+            assert(nodes[i].second_child_offset > (int)i + 1);
+            assert(nodes[i].bounds.contains(first.pmin) && nodes[i].bounds.contains(first.pmax));
+            assert(nodes[i].bounds.contains(second.pmin) && nodes[i].bounds.contains(second.pmax));
+        }
+    }
+    for (int c : covered) {
+        assert(c == 1);
+    }
+    std::cout << "test_flatten_layout passed!" << std::endl;
+}
+
+void check_traversal_matches_brute_force(BVHWidth width) {
+    /* Closest hits through the BVH should match testing every primitive */
+    auto objects = random_spheres(300, 2);
+    BVHAggregate bvh(objects, 4, 0, width);
+    hittable_list world;
+    pcg32 r(3);
+    int hits = 0;
+    for (int i = 0; i < 500; i++) {
+        ray test_ray(vec3h(r.uniform() * 30 - 15, r.uniform() * 30 - 15, -30, 1),
+                     vec3h(r.uniform() - 0.5, r.uniform() - 0.5, 1, 0));
+        hit_record bvh_rec, brute_rec, temp;
+        bool bvh_hit = world.intersect(bvh, test_ray, interval(0.001, infinity), bvh_rec);
+        hit_record tree_rec;
+        bool tree_hit = world.intersect_tree(bvh, test_ray, interval(0.001, infinity), tree_rec);
+
+        bool brute_hit = false;
+        double closest = infinity;
+        for (const auto& obj : objects) {
+            if (obj->intersect(test_ray, interval(0.001, closest), temp)) {
+                brute_hit = true;
+                closest = temp.t;
+                brute_rec = temp;
+            }
+        }
+        assert(bvh_hit == brute_hit && tree_hit == brute_hit);
+        if (bvh_hit) {
+            assert(bvh_rec.t == brute_rec.t && tree_rec.t == brute_rec.t);
+            hits++;
+        }
+    }
+    assert(hits > 0);
+}
+
+void test_linear_traversal_matches_brute_force() {
+    check_traversal_matches_brute_force(BVH2);
+    std::cout << "test_linear_traversal_matches_brute_force passed!" << std::endl;
+}
+
+void test_wide_traversal_matches_brute_force() {
+    check_traversal_matches_brute_force(BVH4);
+    check_traversal_matches_brute_force(BVH8);
+    std::cout << "test_wide_traversal_matches_brute_force passed!" << std::endl;
+}
+
+void test_occluded_matches_intersect() {
+    /* A shadow ray is occluded exactly when a closest hit exists before t_max */
+    auto objects = random_spheres(300, 6);
+    for (BVHWidth width : {BVH2, BVH4, BVH8}) {
+        BVHAggregate bvh(objects, 4, 0, width);
+        pcg32 r(7);
+        int blocked = 0;
+        for (int i = 0; i < 500; i++) {
+            ray test_ray(vec3h(r.uniform() * 30 - 15, r.uniform() * 30 - 15, -30, 1),
+                         vec3h(r.uniform() - 0.5, r.uniform() - 0.5, 1, 0));
+            double t_max = r.uniform() * 60;
+            hit_record rec;
+            traversal_stats stats;
+            bool hit = bvh.intersect(test_ray, interval(0.001, t_max), rec, stats);
+            assert(bvh.occluded(test_ray, t_max) == hit);
+            blocked += hit;
+        }
+        assert(blocked > 0);
+    }
+    std::cout << "test_occluded_matches_intersect passed!" << std::endl;
+}
+
+void test_traversal_stats() {
+    /* A ray missing the scene tests only the root, one that hits tests primitives in entered leaves */
+    auto objects = random_spheres(300, 6);
+    for (BVHWidth width : {BVH2, BVH4, BVH8}) {
+        BVHAggregate bvh(objects, 4, 0, width);
+        hit_record rec;
+        traversal_stats miss;
+        assert(!bvh.intersect(ray(vec3h(0, 0, -30, 1), vec3h(0, 1, 0, 0)), interval(0.001, infinity), rec, miss));
+        assert(miss.nodes == 1 && miss.box_hits == 0 && miss.primitives == 0 && miss.hits == 0);
+        assert(miss.box_tests == (width == BVH2 ? 1 : width));
+
+        pcg32 r(11);
+        traversal_stats total;
+        int hits = 0;
+        for (int i = 0; i < 200; i++) {
+            ray test_ray(vec3h(r.uniform() * 30 - 15, r.uniform() * 30 - 15, -30, 1), vec3h(0, 0, 1, 0));
+            traversal_stats stats;
+            if (bvh.intersect(test_ray, interval(0.001, infinity), rec, stats)) {
+                hits++;
+                assert(stats.primitives > 0 && stats.box_hits > 0 && stats.hits > 0);
+            }
+            assert(stats.nodes > 0);
+            total += stats;
+        }
+        assert(hits > 0);
+        assert(total.box_hits <= total.box_tests && total.hits <= total.primitives);
+        assert(total.count(COUNT_COST) == total.nodes + total.primitives);
+    }
+    std::cout << "test_traversal_stats passed!" << std::endl;
+}
+
+template <int W>
+void count_wide_leaves(const std::vector<WideBVHNode<W>>& wide_nodes, const std::vector<BVHLeaf>& leaves, int index,
+                       std::vector<int>& covered, int& visited) {
+    visited++;
+    for (int k = 0; k < W; k++) {
+        if (wide_nodes[index].count[k] > 0) {
+            int offset = leaves[wide_nodes[index].child[k]].primitives_offset;
+            for (int p = 0; p < wide_nodes[index].count[k]; p++) covered[offset + p]++;
+        } else if (wide_nodes[index].child[k] >= 0) {
+            count_wide_leaves<W>(wide_nodes, leaves, wide_nodes[index].child[k], covered, visited);
+        }
+    }
+}
+
+void test_wide_collapse() {
+    /* Collapsed nodes should reach every primitive once and use fewer nodes than the binary tree */
+    auto objects = random_spheres(500, 5);
+    BVHAggregate bvh4(objects, 2, 0, BVH4);
+    BVHAggregate bvh8(objects, 2, 0, BVH8);
+
+    std::vector<int> covered(objects.size(), 0);
+    int visited = 0;
+    count_wide_leaves<4>(bvh4.get_bvh4_nodes(), bvh4.get_leaves(), 0, covered, visited);
+    assert(visited == (int)bvh4.get_bvh4_nodes().size());
+    assert(bvh4.get_bvh4_nodes().size() < bvh4.get_nodes().size() / 2);
+    for (int c : covered) assert(c == 1);
+
+    std::fill(covered.begin(), covered.end(), 0);
+    visited = 0;
+    count_wide_leaves<8>(bvh8.get_bvh8_nodes(), bvh8.get_leaves(), 0, covered, visited);
+    assert(visited == (int)bvh8.get_bvh8_nodes().size());
+    assert(bvh8.get_bvh8_nodes().size() < bvh4.get_bvh4_nodes().size());
+    for (int c : covered) assert(c == 1);
+    std::cout << "test_wide_collapse passed!" << std::endl;
+}
+
+void test_parallel_build_matches_reference() {
+    /*
+    Building on several threads should give exactly the single threaded tree, and traversal
+    of it should find the same closest hits as testing every primitive
+    */
+    auto objects = random_spheres(20000, 4);
+    BVHAggregate bvh(objects, 4, 4);
+    BVHAggregate serial(objects, 4, 1);
+    const auto& nodes = bvh.get_nodes();
+    const auto& serial_nodes = serial.get_nodes();
+    assert(nodes.size() == serial_nodes.size() && bvh.get_primitives() == serial.get_primitives());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const LinearBVHNode& a = nodes[i];
+        const LinearBVHNode& b = serial_nodes[i];
+        assert(a.n_prims == b.n_prims && a.axis == b.axis && a.second_child_offset == b.second_child_offset);
+        assert(a.bounds.pmin.x == b.bounds.pmin.x && a.bounds.pmin.y == b.bounds.pmin.y && a.bounds.pmin.z == b.bounds.pmin.z);
+        assert(a.bounds.pmax.x == b.bounds.pmax.x && a.bounds.pmax.y == b.bounds.pmax.y && a.bounds.pmax.z == b.bounds.pmax.z);
+    }
+    assert(bvh.get_build_seconds() > 0);
+
+    pcg32 r(4);
+    for (int i = 0; i < 200; i++) {
+        ray test_ray(vec3h(r.uniform() * 30 - 15, r.uniform() * 30 - 15, -30, 1), vec3h(r.uniform() - 0.5, r.uniform() - 0.5, 1, 0));
+        hit_record bvh_rec, temp;
+        traversal_stats stats;
+        bool bvh_hit = bvh.intersect(test_ray, interval(0.001, infinity), bvh_rec, stats);
+        bool brute_hit = false;
+        double closest = infinity;
+        for (const auto& obj : objects) {
+            if (obj->intersect(test_ray, interval(0.001, closest), temp)) {
+                brute_hit = true;
+                closest = temp.t;
+            }
+        }
+        assert(bvh_hit == brute_hit && (!bvh_hit || std::fabs(bvh_rec.t - closest) < 1e-9));
+    }
+    std::cout << "test_parallel_build_matches_reference passed!" << std::endl;
+}
+
+void test_indexed_primitives_match_objects() {
+    /* Leaves of triangle and sphere refs should find the same hits as one heap object per primitive */
+    pcg32 r(9);
+    std::vector<vec3h> vertices;
+    std::vector<int> indices;
+    for (int i = 0; i < 300; i++) {
+        vec3h corner(r.uniform() * 20 - 10, r.uniform() * 20 - 10, r.uniform() * 20 - 10, 1);
+        for (int k = 0; k < 3; k++) {
+            indices.push_back(static_cast<int>(vertices.size()));
+            vertices.push_back(corner + vec3h(r.uniform() * 2, r.uniform() * 2, r.uniform() * 2, 0));
+        }
+    }
+    triangleMesh mesh(vertices, indices, 300);
+
+    hittable_list world;
+    std::vector<shared_ptr<hittable>> objects;
+    world.add(&mesh);
+    for (int i = 0; i < mesh.num_triangles; i++) {
+        objects.push_back(make_shared<triangle>(&mesh, i, mesh.material));
+    }
+    for (const auto& s : random_spheres(100, 10)) {
+        world.add(*std::static_pointer_cast<sphere>(s));
+        objects.push_back(s);
+    }
+    world.add(make_shared<sphere>(vec3h(0, 0, 0, 1), 2.0));
+    objects.push_back(world.objects.back());
+
+    assert(world.size() == objects.size());
+    assert(ref_kind(world.ref(0)) == PRIM_OBJECT);
+    assert(ref_kind(world.ref(1)) == PRIM_TRIANGLE && ref_index(world.ref(1)) == 0);
+    assert(ref_kind(world.ref(world.size() - 1)) == PRIM_SPHERE && ref_index(world.ref(world.size() - 1)) == 99);
+
+    BVHAggregate indexed(world, 4);
+    BVHAggregate pointers(objects, 4);
+    assert(indexed.get_primitives().size() == objects.size());
+    int hits = 0;
+    for (int i = 0; i < 500; i++) {
+        ray test_ray(vec3h(r.uniform() * 30 - 15, r.uniform() * 30 - 15, -30, 1),
+                     vec3h(r.uniform() - 0.5, r.uniform() - 0.5, 1, 0));
+        hit_record indexed_rec, pointer_rec;
+        traversal_stats stats;
+        bool indexed_hit = indexed.intersect(test_ray, interval(0.001, infinity), indexed_rec, stats);
+        bool pointer_hit = pointers.intersect(test_ray, interval(0.001, infinity), pointer_rec, stats);
+        assert(indexed_hit == pointer_hit);
+        assert(indexed.occluded(test_ray, infinity) == indexed_hit);
+        if (indexed_hit) {
+            assert(indexed_rec.t == pointer_rec.t && indexed_rec.material == pointer_rec.material);
+            hits++;
+        }
+    }
+    assert(hits > 0);
+    std::cout << "test_indexed_primitives_match_objects passed!" << std::endl;
+}
+
+void test_depth_fits_traversal_stack() {
+    /* Small spheres spaced geometrically along x build a lopsided SAH tree, it must stay within the traversal stack */
+    std::vector<shared_ptr<hittable>> objects;
+    double x = 1;
+    for (int i = 0; i < 2000; i++, x *= 1.03) {
+        objects.push_back(make_shared<sphere>(vec3h(x, 0, 0, 1), 0.01));
+    }
+    for (BVHWidth width : {BVH2, BVH4, BVH8}) {
+        BVHAggregate bvh(objects, 1, 1, width);
+        assert(bvh.get_depth() > 32 && bvh.get_depth() <= 64);
+        hittable_list world;
+        x = 1;
+        // Only the spheres near the origin, far out a 0.01 radius is below single precision
+        for (size_t i = 0; i < 300; i++, x *= 1.03) {
+            if (i % 10) continue;
+            ray test_ray(vec3h(x, 0, -1, 1), vec3h(0, 0, 1, 0));
+            hit_record rec, brute_rec;
+            assert(world.intersect(bvh, test_ray, interval(0.001, infinity), rec));
+            assert(objects[i]->intersect(test_ray, interval(0.001, infinity), brute_rec));
+            assert(rec.t == brute_rec.t);
+            assert(bvh.occluded(test_ray, infinity));
+        }
+    }
+    std::cout << "test_depth_fits_traversal_stack passed!" << std::endl;
+}
+
 int run_test_bvh() {
     std::cout << "\n Starting tests for /acceleration/bvh_aggregate\n\n";
 
@@ -79,6 +375,15 @@ int run_test_bvh() {
     test_non_empty_primitives();
     test_leaf_node_creation();
     test_multi_leaf_node_creation();
+    test_flatten_layout();
+    test_linear_traversal_matches_brute_force();
+    test_wide_traversal_matches_brute_force();
+    test_wide_collapse();
+    test_occluded_matches_intersect();
+    test_traversal_stats();
+    test_depth_fits_traversal_stack();
+    test_parallel_build_matches_reference();
+    test_indexed_primitives_match_objects();
     std::cout << "All tests passed!" << std::endl;
     return 0;
 }
@@ -0,0 +1,256 @@
+#ifndef TEST_CAMERA_H
+#define TEST_CAMERA_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/primitive_shapes/sphere.h"
+#include "../include/primitive_shapes/instance.h"
+#include "../include/acceleration/bvh_aggregate.h"
+#include "../include/camera.h"
+
+camera make_test_camera(int width, int samples, int bounces) {
+    // Small square render on two threads, tests set whatever else they vary
+    camera cam;
+    cam.image_width = width;
+    cam.aspect_ratio = 1;
+    cam.aa_samples_per_px = samples;
+    cam.ray_bounces = bounces;
+    cam.num_threads = 2;
+    return cam;
+}
+
+void test_adaptive_sampling_skips_converged_pixels() {
+    /*
+    Away from the horizon every sample sees either the constant sky or ground lit almost
+    only by that sky, so those pixels should stop at the minimum and the saved samples go
+    to the horizon and the glass sphere sitting on it
+    */
+    hittable_list world;
+    world.add(sphere(vec3h(0, -1000, 0, 1), 1000, world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)))));
+    world.add(sphere(vec3h(0, 0.5, -3, 1), 0.5, world.materials->add(make_shared<refractive>(color(1, 1, 1, 0), 1.5))));
+    BVHAggregate bvh(world, 1);
+    std::string checkpoint = "test_adaptive_checkpoint.bin";
+
+    auto counts_after_render = [&](double threshold) {
+        camera cam = make_test_camera(24, 24, 4);
+        cam.center = vec3h(0, 1, 0, 1);
+        cam.lookat = vec3h(0, 1, -1, 1);
+        cam.background = color(0.7, 0.8, 1.0, 0);
+        cam.adaptive_threshold = threshold;
+        cam.adaptive_min_samples = 8;
+        cam.checkpoint_path = checkpoint;
+        std::remove(checkpoint.c_str());
+        cam.render_image(world, bvh);
+        sample_buffer samples;
+        assert(samples.load(checkpoint));
+        std::remove(checkpoint.c_str());
+        return samples;
+    };
+
+    sample_buffer uniform = counts_after_render(0);
+    for (uint32_t c : uniform.count) assert(c == 24);
+
+    sample_buffer adaptive = counts_after_render(0.01);
+    assert(adaptive.total_samples() <= uniform.total_samples());
+    assert(adaptive.samples(12, 0) == 8 && adaptive.samples(0, 23) == 8);
+    uint32_t most = 0;
+    for (uint32_t c : adaptive.count) most = std::max(most, c);
+    assert(most > 24);
+    std::cout << "test_adaptive_sampling_skips_converged_pixels passed!\n";
+}
+
+void test_adaptive_sampling_beats_uniform_at_equal_cost() {
+    /*
+    A diffuse ground and sphere under a spherical light, with a glass sphere: most of the
+    image is lit smoothly and the noise sits in the glass and the caustic under it. Spending
+    the same total samples adaptively should end closer to a converged reference, averaged
+    over a few seeds since single renders' errors are noisy themselves.
+    */
+    hittable_list world;
+    world.add(sphere(vec3h(0, -1000, 0, 1), 1000, world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)))));
+    world.add(sphere(vec3h(-0.6, 0.4, -2, 1), 0.4, world.materials->add(make_shared<lambertian>(color(0.7, 0.3, 0.2, 0)))));
+    world.add(sphere(vec3h(0.5, 0.4, -2, 1), 0.4, world.materials->add(make_shared<refractive>(color(1, 1, 1, 0), 1.5))));
+    world.add(sphere(vec3h(0, 3, -1.5, 1), 1, world.materials->add(make_shared<diffuse_light>(color(3, 3, 3, 0)))));
+    BVHAggregate bvh(world, 1);
+
+    auto render = [&](int samples, double threshold, uint64_t seed) {
+        camera cam = make_test_camera(24, samples, 5);
+        cam.center = vec3h(0, 0.8, 0, 1);
+        cam.lookat = vec3h(0, 0.4, -2, 1);
+        cam.background = color(0.1, 0.1, 0.15, 0);
+        cam.seed = seed;
+        cam.adaptive_threshold = threshold;
+        cam.adaptive_min_samples = 8;
+        return cam.render_image(world, bvh);
+    };
+    film reference = render(2048, 0, 0);
+    double uniform = 0, adaptive = 0;
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        uniform += rmse(render(32, 0, seed), reference);
+        adaptive += rmse(render(32, 0.02, seed), reference);
+    }
+    assert(adaptive < 0.9 * uniform);
+    std::cout << "test_adaptive_sampling_beats_uniform_at_equal_cost passed!\n";
+}
+
+void test_russian_roulette_is_unbiased() {
+    /*
+    Inside a closed sphere of albedo a every path scatters until the bounce limit N and then
+    sees the background, so each pixel's expected value is a^N times the background. Without
+    roulette every path gives exactly that, with it only the mean over many paths does.
+    */
+    hittable_list world;
+    world.add(sphere(vec3h(0, 0, 0, 1), 10, world.materials->add(make_shared<lambertian>(color(0.9, 0.9, 0.9, 0)))));
+    BVHAggregate bvh(world, 1);
+    double expected = std::pow(0.9, 6);
+
+    auto render = [&](int roulette_depth) {
+        camera cam = make_test_camera(16, 64, 6);
+        cam.roulette_depth = roulette_depth;
+        cam.background = color(1, 1, 1, 0);
+        return cam.render_image(world, bvh);
+    };
+    film exact = render(6);
+    for (float v : exact.rgb) assert(std::fabs(v - expected) < 1e-6);
+
+    film roulette = render(1);
+    double mean = 0;
+    bool varies = false;
+    for (float v : roulette.rgb) {
+        mean += v / roulette.rgb.size();
+        varies = varies || std::fabs(v - expected) > 1e-3;
+    }
+    assert(varies && std::fabs(mean - expected) < 0.03 * expected);
+    std::cout << "test_russian_roulette_is_unbiased passed!\n";
+}
+
+void test_light_sampling_matches_bsdf_sampling() {
+    /*
+    Shadow rays to the light with MIS should converge to the same image as BSDF sampling
+    alone, with much less noise per pixel
+    */
+    hittable_list world;
+    world.add(sphere(vec3h(0, -1000, 0, 1), 1000, world.materials->add(make_shared<lambertian>(color(0.6, 0.6, 0.6, 0)))));
+    world.add(sphere(vec3h(0, 0.5, -1, 1), 0.5, world.materials->add(make_shared<lambertian>(color(0.7, 0.3, 0.2, 0)))));
+    quadrilateral light(vec3h(-1, 2.5, 0, 1), vec3h(2, 0, 0, 0), vec3h(0, 0, -2, 0), world.materials->add(make_shared<diffuse_light>(color(8, 8, 8, 0))));
+    world.add(&light);
+    BVHAggregate bvh(world, 1);
+
+    light_list lights(world);
+    assert(lights.size() == 2 && std::fabs(lights.total_area() - 4) < 1e-9);
+    assert(lights.contains(make_primitive_ref(PRIM_TRIANGLE, 0)) && lights.contains(make_primitive_ref(PRIM_TRIANGLE, 1)));
+    assert(!lights.contains(make_primitive_ref(PRIM_SPHERE, 0)) && !lights.contains(hit_record::no_primitive));
+
+    auto render = [&](bool sample_lights, int samples) {
+        camera cam = make_test_camera(16, samples, 4);
+        cam.center = vec3h(0, 1, 3, 1);
+        cam.lookat = vec3h(0, 0.5, -1, 1);
+        cam.background = color(0, 0, 0, 0);
+        cam.sample_lights = sample_lights;
+        return cam.render_image(world, bvh);
+    };
+    film reference = render(true, 256);
+    film bsdf_only = render(false, 64);
+    film with_lights = render(true, 64);
+    double mean_reference = 0, mean_bsdf = 0, error_bsdf = 0, error_lights = 0;
+    for (size_t k = 0; k < reference.rgb.size(); k++) {
+        mean_reference += reference.rgb[k] / reference.rgb.size();
+        mean_bsdf += bsdf_only.rgb[k] / reference.rgb.size();
+        error_bsdf += std::pow(bsdf_only.rgb[k] - reference.rgb[k], 2);
+        error_lights += std::pow(with_lights.rgb[k] - reference.rgb[k], 2);
+    }
+    assert(std::fabs(mean_bsdf - mean_reference) < 0.03 * mean_reference);
+    assert(error_lights < 0.35 * error_bsdf);
+    std::cout << "test_light_sampling_matches_bsdf_sampling passed!\n";
+}
+
+void test_instanced_emitter_is_not_mis_weighted() {
+    /*
+    An emitter inside an instance is never picked by light sampling, so its hits must keep
+    their full weight even when it shares its material with a light that is sampled. Weighting
+    them by the listed light's pdf would leave the floor under the instance nearly black.
+    */
+    hittable_list world;
+    uint32_t glow = world.materials->add(make_shared<diffuse_light>(color(4, 4, 4, 0)));
+    world.add(sphere(vec3h(0, -1000, 0, 1), 1000, world.materials->add(make_shared<lambertian>(color(0.6, 0.6, 0.6, 0)))));
+    world.add(sphere(vec3h(3, 3, -4, 1), 0.05, glow));
+    triangleMesh panel(std::vector<vec3h>{vec3h(-1, 0, -1, 1), vec3h(1, 0, -1, 1), vec3h(-1, 0, 1, 1), vec3h(1, 0, 1, 1)},
+                       std::vector<int>{0, 1, 2, 1, 3, 2}, 2, glow);
+    world.add(make_shared<instance>(make_mesh_bvh(&panel, world.materials), translate(vec3h(0, 2, -1, 0))));
+    BVHAggregate bvh(world, 1);
+
+    light_list lights(world);
+    assert(lights.size() == 1);
+    hit_record rec;
+    assert(world.intersect(bvh, ray(vec3h(0, 1, -1, 1), vec3h(0, 1, 0, 0)), interval(0.001, infinity), rec));
+    assert(rec.material == glow && ref_kind(rec.primitive) == PRIM_OBJECT && !lights.contains(rec.primitive));
+    assert(world.intersect(bvh, ray(vec3h(3, 1, -4, 1), vec3h(0, 1, 0, 0)), interval(0.001, infinity), rec));
+    assert(rec.material == glow && lights.contains(rec.primitive));
+
+    auto render = [&](bool sample_lights) {
+        camera cam = make_test_camera(16, 64, 3);
+        cam.center = vec3h(0, 1, 3, 1);
+        cam.lookat = vec3h(0, 0, -1, 1);
+        cam.background = color(0, 0, 0, 0);
+        cam.sample_lights = sample_lights;
+        return cam.render_image(world, bvh);
+    };
+    film bsdf_only = render(false);
+    film with_lights = render(true);
+    double mean_bsdf = 0, mean_lights = 0;
+    for (size_t k = 0; k < bsdf_only.rgb.size(); k++) {
+        mean_bsdf += bsdf_only.rgb[k] / bsdf_only.rgb.size();
+        mean_lights += with_lights.rgb[k] / bsdf_only.rgb.size();
+    }
+    assert(mean_bsdf > 0 && std::fabs(mean_lights - mean_bsdf) < 0.05 * mean_bsdf);
+    std::cout << "test_instanced_emitter_is_not_mis_weighted passed!\n";
+}
+
+void test_traversal_heatmap() {
+    /*
+    Every camera ray should be counted once in its own pixel, and pixels whose rays reach
+    the sphere's primitives should come out warmer than the sky around it
+    */
+    hittable_list world;
+    world.add(sphere(vec3h(0, 0, -3, 1), 1, world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)))));
+    world.add(sphere(vec3h(0, 0, -6, 1), 1, world.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5, 0)))));
+    BVHAggregate bvh(world, 1);
+
+    camera cam = make_test_camera(16, 4, 1);
+    cam.center = vec3h(0, 0, 0, 1);
+    cam.lookat = vec3h(0, 0, -1, 1);
+    cam.mode = RENDER_HEATMAP;
+    film heat = cam.render_image(world, bvh);
+
+    traversal_stats total;
+    for (const traversal_stats& pixel : cam.pixel_stats) {
+        assert(pixel.rays == 4);
+        total += pixel;
+    }
+    assert(total.hits > 0 && total.hits <= total.primitives && total.box_hits <= total.box_tests);
+
+    const traversal_stats& middle = cam.pixel_stats[8 * 16 + 8];
+    const traversal_stats& corner = cam.pixel_stats[0];
+    assert(middle.count(COUNT_COST) > corner.count(COUNT_COST));
+    color hot = heat.get_pixel(8, 8), cold = heat.get_pixel(0, 0);
+    assert(hot.x > hot.z && cold.z > cold.x);
+    std::cout << "test_traversal_heatmap passed!\n";
+}
+
+int run_test_camera() {
+    std::cout << "\n Starting tests for /camera\n\n";
+
+    test_adaptive_sampling_skips_converged_pixels();
+    test_adaptive_sampling_beats_uniform_at_equal_cost();
+    test_russian_roulette_is_unbiased();
+    test_light_sampling_matches_bsdf_sampling();
+    test_instanced_emitter_is_not_mis_weighted();
+    test_traversal_heatmap();
+    return 0;
+}
+
+#endif
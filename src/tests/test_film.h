@@ -0,0 +1,316 @@
+#ifndef TEST_FILM_H
+#define TEST_FILM_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <vector>
+#include "../include/film/film.h"
+#include "../include/film/sample_buffer.h"
+#include "../include/sampling/rng.h"
+
+film gradient_film(int width, int height) {
+    /* Smooth ramps with a little noise, roughly what a render looks like to the encoders */
+    film image(width, height);
+    pcg32 r(3);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            double u = double(i) / width, v = double(j) / height;
+            image.set_pixel(i, j, color(u, v * v, 0.5 + 0.02 * r.uniform(), 0));
+        }
+    }
+    return image;
+}
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+std::vector<uint8_t> inflate_fixed_block(const uint8_t* data, size_t size) {
+    /* Decoder for the single fixed Huffman block zlib_compress emits */
+    size_t bit = 0;
+    auto get_bits = [&](int count) {
+        uint32_t v = 0;
+        for (int k = 0; k < count; k++, bit++) {
+            assert(bit / 8 < size);
+            v |= ((data[bit / 8] >> (bit % 8)) & 1u) << k;
+        }
+        return v;
+    };
+    auto get_code_bit = [&]() { return get_bits(1); };
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                         3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                          257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                          8193, 12289, 16385, 24577};
+    static const int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    assert(get_bits(1) == 1 && get_bits(2) == 1);
+    std::vector<uint8_t> out;
+    while (true) {
+        uint32_t code = 0;
+        for (int k = 0; k < 7; k++) code = (code << 1) | get_code_bit();
+        int symbol;
+        if (code <= 0x17) {
+            symbol = 256 + code;
+        } else {
+            code = (code << 1) | get_code_bit();
+            if (code >= 0x30 && code <= 0xbf) symbol = code - 0x30;
+            else if (code >= 0xc0 && code <= 0xc7) symbol = 280 + code - 0xc0;
+            else symbol = 144 + ((code << 1) | get_code_bit()) - 0x190;
+        }
+        if (symbol < 256) {
+            out.push_back(static_cast<uint8_t>(symbol));
+        } else if (symbol == 256) {
+            return out;
+        } else {
+            int length = length_base[symbol - 257] + get_bits(length_extra[symbol - 257]);
+            uint32_t d = 0;
+            for (int k = 0; k < 5; k++) d = (d << 1) | get_code_bit();
+            int distance = distance_base[d] + get_bits(distance_extra[d]);
+            assert(distance <= int(out.size()));
+            for (int k = 0; k < length; k++) out.push_back(out[out.size() - distance]);
+        }
+    }
+}
+
+void test_to_bytes_matches_reference() {
+    /* The vector pass and the scalar tail should both give the bytes of the old per pixel writer */
+    std::vector<float> values = {0.0f, 1e-6f, 0.25f, 0.5f, 0.998f, 0.999f, 1.0f, 7.5f, -0.3f,
+                                 std::numeric_limits<float>::quiet_NaN(), 0.0625f};
+    pcg32 r(7);
+    for (int k = 0; k < 400; k++) values.push_back(static_cast<float>(1.2 * r.uniform()));
+    while (values.size() % 3 != 0 || values.size() % 4 == 0) values.push_back(0.3f);
+
+    film image(int(values.size() / 3), 1);
+    image.rgb = values;
+    for (tonemap_operator op : {TONEMAP_CLAMP, TONEMAP_REINHARD}) {
+        image.tonemap = op;
+        std::vector<uint8_t> bytes = image.to_bytes();
+        for (size_t k = 0; k < values.size(); k++) {
+            double v = values[k] > 0 ? values[k] : 0;
+            if (op == TONEMAP_REINHARD) v = v / (1 + v);
+            int expected = int(256 * clamp(std::sqrt(v), 0.000, 0.999));
+            // Float rounding may land a value right on a level boundary on either side
+            assert(std::abs(int(bytes[k]) - expected) <= 1);
+        }
+    }
+    image.tonemap = TONEMAP_CLAMP;
+    std::vector<uint8_t> bytes = image.to_bytes();
+    assert(bytes[0] == 0 && bytes[2] == 128 && bytes[6] == 255 && bytes[7] == 255);
+    assert(bytes[8] == 0 && bytes[9] == 0 && bytes[10] == 64);
+    std::cout << "test_to_bytes_matches_reference passed!\n";
+}
+
+void test_ppm_layout() {
+    film image = gradient_film(5, 3);
+    std::vector<uint8_t> bytes = image.to_bytes();
+    std::vector<uint8_t> ppm = encode_ppm(image.width, image.height, bytes.data());
+    std::string header = "P6\n5 3\n255\n";
+    assert(ppm.size() == header.size() + 45);
+    assert(std::memcmp(ppm.data(), header.data(), header.size()) == 0);
+    assert(std::memcmp(ppm.data() + header.size(), bytes.data(), 45) == 0);
+    std::cout << "test_ppm_layout passed!\n";
+}
+
+void test_png_round_trip() {
+    /* Walk the chunks, check their CRCs, then inflate and unfilter IDAT back to the pixels */
+    film image = gradient_film(67, 41);
+    std::vector<uint8_t> bytes = image.to_bytes();
+    std::vector<uint8_t> png = encode_png(image.width, image.height, bytes.data());
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    assert(std::memcmp(png.data(), signature, 8) == 0);
+
+    std::vector<uint8_t> idat;
+    size_t at = 8;
+    std::string last;
+    while (at < png.size()) {
+        uint32_t length = read_be32(&png[at]);
+        std::string type(reinterpret_cast<const char*>(&png[at + 4]), 4);
+        assert(read_be32(&png[at + 8 + length]) == crc32_update(0, &png[at + 4], length + 4));
+        if (type == "IHDR") {
+            assert(read_be32(&png[at + 8]) == 67 && read_be32(&png[at + 12]) == 41);
+            assert(png[at + 16] == 8 && png[at + 17] == 2);
+        }
+        if (type == "IDAT") idat.assign(&png[at + 8], &png[at + 8] + length);
+        last = type;
+        at += 12 + length;
+    }
+    assert(at == png.size() && last == "IEND");
+
+    assert(idat[0] == 0x78 && ((idat[0] << 8) | idat[1]) % 31 == 0);
+    std::vector<uint8_t> filtered = inflate_fixed_block(&idat[2], idat.size() - 6);
+    assert(read_be32(&idat[idat.size() - 4]) == adler32(filtered.data(), filtered.size()));
+    size_t stride = 3 * 67;
+    assert(filtered.size() == (stride + 1) * 41);
+    // Smaller than the raw pixels, the encoder shouldn't just be storing them
+    assert(idat.size() < bytes.size());
+
+    std::vector<uint8_t> pixels(bytes.size());
+    for (int j = 0; j < 41; j++) {
+        uint8_t type = filtered[j * (stride + 1)];
+        const uint8_t* src = &filtered[j * (stride + 1) + 1];
+        uint8_t* row = &pixels[j * stride];
+        for (size_t x = 0; x < stride; x++) {
+            int a = x >= 3 ? row[x - 3] : 0;
+            int b = j > 0 ? row[x - stride] : 0;
+            int c = (x >= 3 && j > 0) ? row[x - stride - 3] : 0;
+            int predicted = 0;
+            switch (type) {
+            case 1: predicted = a; break;
+            case 2: predicted = b; break;
+            case 3: predicted = (a + b) / 2; break;
+            case 4: predicted = paeth_predictor(a, b, c); break;
+            }
+            row[x] = static_cast<uint8_t>(src[x] + predicted);
+        }
+    }
+    assert(pixels == bytes);
+    std::cout << "test_png_round_trip passed!\n";
+}
+
+void test_pfm_layout() {
+    /* PFM stores rows bottom to top with the linear floats untouched */
+    film image = gradient_film(4, 3);
+    std::vector<uint8_t> pfm = encode_pfm(image.width, image.height, image.rgb.data());
+    std::string header = "PF\n4 3\n-1.0\n";
+    assert(std::memcmp(pfm.data(), header.data(), header.size()) == 0);
+    assert(pfm.size() == header.size() + 4 * 3 * 3 * sizeof(float));
+    const uint8_t* first_row = pfm.data() + header.size();
+    assert(std::memcmp(first_row, &image.rgb[3 * 4 * 2], 3 * 4 * sizeof(float)) == 0);
+    std::cout << "test_pfm_layout passed!\n";
+}
+
+void test_pfm_round_trip() {
+    /* A written PFM reads back bit exact, from either byte order, and truncated files are refused */
+    film image = gradient_film(5, 3);
+    std::string path = "test_film_round_trip.pfm";
+    assert(image.write(path));
+    film loaded;
+    assert(loaded.read(path));
+    std::remove(path.c_str());
+    assert(loaded.width == 5 && loaded.height == 3 && loaded.rgb == image.rgb && rmse(loaded, image) == 0);
+
+    std::vector<uint8_t> pfm = encode_pfm(image.width, image.height, image.rgb.data());
+    std::string little = "PF\n5 3\n-1.0\n", big = "PF\n5 3\n1.0\n";
+    bool little_endian = std::memcmp(pfm.data(), little.data(), little.size()) == 0;
+    std::vector<uint8_t> swapped(big.begin(), big.end());
+    if (!little_endian) swapped.assign(little.begin(), little.end());
+    for (size_t k = (little_endian ? little : big).size(); k < pfm.size(); k += 4) {
+        swapped.insert(swapped.end(), {pfm[k + 3], pfm[k + 2], pfm[k + 1], pfm[k]});
+    }
+    int width, height;
+    std::vector<float> rgb;
+    assert(decode_pfm(swapped, width, height, rgb) && rgb == image.rgb);
+    pfm.pop_back();
+    assert(!decode_pfm(pfm, width, height, rgb));
+    std::cout << "test_pfm_round_trip passed!\n";
+}
+
+void test_write_by_extension() {
+    film image = gradient_film(6, 4);
+    std::string path = "test_film_output.ppm";
+    assert(image.write(path));
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(path.c_str());
+    std::vector<uint8_t> bytes = image.to_bytes();
+    assert(written == encode_ppm(image.width, image.height, bytes.data()));
+    assert(!image.write("test_film_output.bmp"));
+    std::cout << "test_write_by_extension passed!\n";
+}
+
+void test_sample_buffer_round_trip() {
+    sample_buffer samples(5, 4, 99);
+    pcg32 r(2);
+    for (int k = 0; k < 60; k++) {
+        samples.add(k % 5, (k / 5) % 4, color(r.uniform(), r.uniform() * 3, -r.uniform(), 0));
+    }
+    std::string path = "test_sample_buffer.bin";
+    assert(samples.save(path));
+    sample_buffer loaded;
+    assert(loaded.load(path));
+    assert(loaded.width == 5 && loaded.height == 4 && loaded.seed == 99);
+    assert(loaded.count == samples.count && loaded.sum == samples.sum);
+    assert(loaded.min_samples() == 3);
+
+    film a(5, 4), b(5, 4);
+    samples.resolve(a);
+    loaded.resolve(b);
+    assert(a.rgb == b.rgb);
+
+    samples.scene_hash = 1234;
+    assert(samples.save(path) && loaded.load(path) && loaded.scene_hash == 1234);
+
+    // A header whose size disagrees with the file length is rejected, longer or shorter
+    std::ifstream saved_file(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(saved_file)), std::istreambuf_iterator<char>());
+    saved_file.close();
+    for (std::string corrupt : {bytes + "x", bytes.substr(0, bytes.size() - 1)}) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << corrupt;
+        file.close();
+        assert(!loaded.load(path));
+    }
+    std::string huge = bytes;
+    const int32_t huge_size[2] = {1 << 30, 1 << 30};
+    std::memcpy(&huge[8], huge_size, sizeof(huge_size));
+    std::ofstream huge_file(path, std::ios::binary | std::ios::trunc);
+    huge_file << huge;
+    huge_file.close();
+    assert(!loaded.load(path));
+
+    std::ofstream truncated(path, std::ios::binary | std::ios::trunc);
+    truncated << "RTCK";
+    truncated.close();
+    assert(!loaded.load(path));
+    assert(loaded.count == samples.count);
+    std::remove(path.c_str());
+    std::cout << "test_sample_buffer_round_trip passed!\n";
+}
+
+void test_welford_matches_two_pass_variance() {
+    sample_buffer samples(2, 1, 0);
+    pcg32 r(4);
+    std::vector<double> values;
+    for (int k = 0; k < 50; k++) {
+        color c(r.uniform(), 2 * r.uniform(), r.uniform(), 0);
+        samples.add(0, 0, c);
+        samples.add(1, 0, color(0.3, 0.3, 0.3, 0));
+        values.push_back(luminance(c));
+    }
+    double mean = 0, squares = 0;
+    for (double v : values) mean += v / values.size();
+    for (double v : values) squares += (v - mean) * (v - mean);
+    assert(std::fabs(samples.m2[0] - squares) < 1e-9 * squares);
+    double expected = std::sqrt(squares / 49 / 50) / (2 * std::sqrt(mean));
+    assert(std::fabs(samples.display_error(0, 0) - expected) < 1e-9);
+    // A pixel that always sees the same radiance has converged
+    assert(samples.display_error(1, 0) < 1e-12);
+    std::cout << "test_welford_matches_two_pass_variance passed!\n";
+}
+
+int run_test_film() {
+    std::cout << "\n Starting tests for /film\n\n";
+
+    test_to_bytes_matches_reference();
+    test_ppm_layout();
+    test_png_round_trip();
+    test_pfm_layout();
+    test_pfm_round_trip();
+    test_write_by_extension();
+    test_sample_buffer_round_trip();
+    test_welford_matches_two_pass_variance();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TEST_INSTANCE_H
+#define TEST_INSTANCE_H
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "../include/primitive_shapes/instance.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/geometry/transform.h"
+
+triangleMesh bumpy_grid(int n) {
+    /* n by n grid of quads over [0, 1]^2 with a height bump, two triangles per quad */
+    std::vector<vec3h> vertices;
+    std::vector<int> indices;
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            double x = double(i) / n, y = double(j) / n;
+            vertices.push_back(vec3h(x, y, 0.2 * std::sin(6 * x) * std::cos(5 * y), 1));
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int v = j * (n + 1) + i;
+            indices.insert(indices.end(), {v, v + 1, v + n + 1, v + 1, v + n + 2, v + n + 1});
+        }
+    }
+    return triangleMesh(vertices, indices, 2 * n * n);
+}
+
+void test_instance_matches_baked_mesh() {
+    /* Hitting an instance should give the same t, point and normal as a mesh with the transform baked in */
+    triangleMesh mesh = bumpy_grid(12);
+    transform shift = translate(vec3h(1, -2, 3, 0));
+    transform rot = rotateAxis(vec3h(1, 2, 3, 0), 0.7);
+    transform stretch = scale(2, 0.5, 1.5);
+    transform object_to_world = combine_transform(shift, rot, stretch);
+
+    triangleMesh baked = mesh;
+    baked.apply_total_transform(object_to_world);
+    hittable_list baked_world;
+    baked_world.add(&baked);
+    BVHAggregate baked_bvh(baked_world, 4);
+
+    instance copy(make_mesh_bvh(&mesh, baked_world.materials), object_to_world);
+    Bounds3f baked_bounds = baked_bvh.bounds();
+    assert(copy.bounds().contains(baked_bounds.pmin) && copy.bounds().contains(baked_bounds.pmax));
+
+    vec3h center = (baked_bounds.pmin + baked_bounds.pmax) / 2;
+    pcg32 r(11);
+    int hits = 0;
+    for (int i = 0; i < 500; i++) {
+        vec3h origin = center + vec3h(r.uniform() * 8 - 4, r.uniform() * 8 - 4, -6, 0);
+        vec3h target = center + vec3h(r.uniform() * 3 - 1.5, r.uniform() * 3 - 1.5, r.uniform() - 0.5, 0);
+        ray test_ray(origin, target - origin);
+        hit_record baked_rec, instance_rec;
+        traversal_stats stats;
+        bool baked_hit = baked_bvh.intersect(test_ray, interval(0.001, infinity), baked_rec, stats);
+        traversal_stats instance_stats;
+        bool instance_hit = copy.intersect(test_ray, interval(0.001, infinity), instance_rec, instance_stats);
+        assert(baked_hit == instance_hit);
+        // The instance counts the work done in its BLAS
+        assert(instance_stats.nodes > 0 && (instance_stats.hits > 0) == instance_hit);
+        assert(copy.occluded(test_ray, interval(0.001, infinity)) == baked_hit);
+        if (baked_hit) {
+            // Baked vertices are rounded to float after the transform, so agreement is to float precision
+            const double tolerance = (sizeof(Float) < sizeof(double)) ? 1e-4 : 1e-5;
+            assert(std::fabs(baked_rec.t - instance_rec.t) < tolerance);
+            assert((baked_rec.p - instance_rec.p).magnitude() < tolerance);
+            assert(std::fabs(std::fabs(dot(baked_rec.normal, instance_rec.normal)) - 1) < tolerance);
+            hits++;
+        }
+    }
+    assert(hits > 0);
+    std::cout << "test_instance_matches_baked_mesh passed!" << std::endl;
+}
+
+void test_instances_share_blas() {
+    /* Copies of one mesh in a top level BVH each get hit where they were placed */
+    triangleMesh mesh = bumpy_grid(4);
+    hittable_list world;
+    auto blas = make_mesh_bvh(&mesh, world.materials);
+    std::vector<std::shared_ptr<hittable>> objects;
+    for (int k = 0; k < 5; k++) {
+        objects.push_back(std::make_shared<instance>(blas, translate(vec3h(3 * k, 0, 0, 0))));
+    }
+    BVHAggregate tlas(objects, 1);
+    for (int k = 0; k < 5; k++) {
+        ray down(vec3h(3 * k + 0.5, 0.5, 5, 1), vec3h(0, 0, -1, 0));
+        hit_record rec;
+        assert(world.intersect(tlas, down, interval(0.001, infinity), rec));
+        assert(std::fabs(rec.p.x - (3 * k + 0.5)) < 1e-9);
+        assert(tlas.occluded(down, infinity));
+    }
+    ray between(vec3h(2, 0.5, 5, 1), vec3h(0, 0, -1, 0));
+    assert(!tlas.occluded(between, infinity));
+    std::cout << "test_instances_share_blas passed!" << std::endl;
+}
+
+void test_instance_stats_count_blas_only() {
+    /*
+    Through a top level BVH holding one untransformed instance, a ray's primitive tests and
+    hits are exactly its BLAS's: triangle tests and triangle hits, nothing for the instance
+    */
+    triangleMesh mesh = bumpy_grid(8);
+    hittable_list world;
+    auto blas = make_mesh_bvh(&mesh, world.materials);
+    world.add(std::make_shared<instance>(blas, translate(vec3h(0, 0, 0, 0))));
+    BVHAggregate tlas(world, 1);
+    pcg32 r(5);
+    int hits = 0;
+    for (int i = 0; i < 200; i++) {
+        ray test_ray(vec3h(r.uniform() * 1.4 - 0.2, r.uniform() * 1.4 - 0.2, 3, 1), vec3h(0.1 * r.uniform(), 0.1 * r.uniform(), -1, 0));
+        hit_record rec;
+        traversal_stats through_tlas, blas_only;
+        bool hit = tlas.intersect(test_ray, interval(0.001, infinity), rec, through_tlas);
+        assert(blas->intersect(test_ray, interval(0.001, infinity), rec, blas_only) == hit);
+        assert(through_tlas.primitives == blas_only.primitives && through_tlas.hits == blas_only.hits);
+        assert(!hit || through_tlas.nodes > blas_only.nodes);
+
+        traversal_stats occluded_tlas, occluded_blas;
+        assert(tlas.occluded(test_ray, interval(0.001, infinity), occluded_tlas) == hit);
+        blas->occluded(test_ray, interval(0.001, infinity), occluded_blas);
+        assert(occluded_tlas.primitives == occluded_blas.primitives && occluded_tlas.hits == occluded_blas.hits);
+        hits += hit;
+    }
+    assert(hits > 0);
+    std::cout << "test_instance_stats_count_blas_only passed!" << std::endl;
+}
+
+int run_test_instance() {
+    std::cout << "\n Starting tests for /primitive_shapes/instance\n\n";
+
+    test_instance_matches_baked_mesh();
+    test_instances_share_blas();
+    test_instance_stats_count_blas_only();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef TEST_MATERIALS_H
+#define TEST_MATERIALS_H
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include "../include/sampling/rng.h"
+#include "../include/materials/diffuseBXDF.h"
+#include "../include/materials/refractiveBXDF.h"
+#include "../include/primitive_shapes/sphere.h"
+#include "../include/primitive_shapes/hittable_list.h"
+
+void test_diffuse_sample_matches_pdf() {
+    /*
+    Cosine sampling should report the same density pdf() gives, stay in the normal's
+    hemisphere, carry a weight of exactly the albedo and average cos(theta) = 2/3
+    */
+    lambertian mat(color(0.5, 0.25, 0.125, 0));
+    hit_record rec;
+    rec.p = vec3h(0, 0, 0, 1);
+    rec.normal = vec3h(0.6, 0, 0.8, 0);
+    rec.front_face = true;
+    ray r_in(vec3h(0, 0, 1, 1), vec3h(0, 0, -1, 0));
+    pcg32 rng(9);
+    double mean_cos = 0;
+    const int n = 20000;
+    for (int k = 0; k < n; k++) {
+        bxdf_sample s;
+        assert(mat.sample(r_in, rec, rng.uniform(), rng.uniform(), rng.uniform(), s));
+        double cos_theta = dot(s.direction, rec.normal);
+        assert(cos_theta > 0 && std::fabs(s.direction.magnitude() - 1) < 1e-6);
+        assert(std::fabs(s.pdf - mat.pdf(r_in, rec, s.direction)) < 1e-6);
+        color w = s.weight(rec.normal);
+        assert(std::fabs(w.x - 0.5) < 1e-6 && std::fabs(w.y - 0.25) < 1e-6 && std::fabs(w.z - 0.125) < 1e-6);
+        mean_cos += cos_theta / n;
+    }
+    assert(std::fabs(mean_cos - 2.0 / 3.0) < 0.01);
+    std::cout << "test_diffuse_sample_matches_pdf passed!\n";
+}
+
+void test_dielectric_reflects_by_fresnel() {
+    /* Head on at glass, eta 1.5, the reflected fraction should be ((1.5 - 1) / (1.5 + 1))^2 */
+    refractive mat(color(0.9, 0.9, 0.9, 0), 1.5);
+    hit_record rec;
+    rec.p = vec3h(0, 0, 0, 1);
+    ray r_in(vec3h(0, 0, 1, 1), vec3h(0, 0, -1, 0));
+    rec.set_face_normal(r_in, vec3h(0, 0, 1, 0));
+    pcg32 rng(4);
+    int reflected = 0;
+    const int n = 20000;
+    for (int k = 0; k < n; k++) {
+        bxdf_sample s;
+        assert(mat.sample(r_in, rec, rng.uniform(), rng.uniform(), rng.uniform(), s) && s.specular);
+        reflected += s.direction.z > 0;
+        assert(std::fabs(s.weight(rec.normal).x - 0.9) < 1e-6);
+    }
+    assert(std::fabs(double(reflected) / n - 0.04) < 0.005);
+
+    // Leaving the glass past the critical angle everything reflects
+    ray inside(vec3h(0, 0, 0, 1), vec3h(0.9, 0, 0.3, 0));
+    rec.set_face_normal(inside, vec3h(0, 0, 1, 0));
+    assert(!rec.front_face && fresnel_dielectric(0.3 / inside.direction().magnitude(), 1.5) == 1.0);
+    bxdf_sample s;
+    assert(mat.sample(inside, rec, 0.99, 0.5, 0.5, s) && s.direction.z < 0);
+    std::cout << "test_dielectric_reflects_by_fresnel passed!\n";
+}
+
+void test_material_table_indices() {
+    /* Adding a material again gives back its index, and hits report the primitive's index */
+    hittable_list world;
+    auto red = make_shared<lambertian>(color(0.8, 0.1, 0.1, 0));
+    auto glass = make_shared<refractive>(color(1, 1, 1, 0), 1.5);
+    uint32_t red_id = world.materials->add(red);
+    uint32_t glass_id = world.materials->add(glass);
+    assert(world.materials->add(red) == red_id && glass_id != red_id);
+    assert(&(*world.materials)[red_id] == red.get());
+
+    sphere ball(vec3h(0, 0, -2, 1), 0.5, glass_id);
+    hit_record rec;
+    assert(ball.intersect(ray(vec3h(0, 0, 0, 1), vec3h(0, 0, -1, 0)), interval(0.001, infinity), rec));
+    assert(rec.material == glass_id && sphere(vec3h(0, 0, 0, 1), 1).material == material_table::default_material);
+
+    // Null is refused, not stored
+    size_t before = world.materials->size();
+    assert(world.materials->add(nullptr) == material_table::default_material && world.materials->size() == before);
+    std::cout << "test_material_table_indices passed!\n";
+}
+
+void test_material_tables_per_scene() {
+    /* Each scene has its own table, and clearing a scene drops its materials */
+    hittable_list first, second;
+    first.materials->add(make_shared<lambertian>(color(0.8, 0.1, 0.1, 0)));
+    first.materials->add(make_shared<refractive>(color(1, 1, 1, 0), 1.5));
+    uint32_t light_id = second.materials->add(make_shared<diffuse_light>(color(4, 4, 4, 0)));
+    assert(first.materials->size() == 3 && second.materials->size() == 2);
+    assert(light_id == 1 && (*second.materials)[light_id].emits() && !(*first.materials)[1].emits());
+    assert(!(*first.materials)[material_table::default_material].emits());
+
+    first.clear();
+    assert(first.materials->size() == 1 && second.materials->size() == 2);
+    std::cout << "test_material_tables_per_scene passed!\n";
+}
+
+int run_test_materials() {
+    std::cout << "\n Starting tests for /materials\n\n";
+
+    test_diffuse_sample_matches_pdf();
+    test_dielectric_reflects_by_fresnel();
+    test_material_table_indices();
+    test_material_tables_per_scene();
+    return 0;
+}
+
+#endif
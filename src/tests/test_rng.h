@@ -0,0 +1,249 @@
+#ifndef TEST_RNG_H
+#define TEST_RNG_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "../include/sampling/rng.h"
+#include "../include/sampling/sampler.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/primitive_shapes/sphere.h"
+#include "../include/acceleration/bvh_aggregate.h"
+#include "../include/camera.h"
+
+void test_rng_same_seed_same_sequence() {
+    pcg32 a(7), b(7);
+    for (int i = 0; i < 100; i++) {
+        assert(a.next_uint() == b.next_uint());
+    }
+    std::cout << "test_rng_same_seed_same_sequence passed!\n";
+}
+
+void test_rng_sequences_differ() {
+    pcg32 a(7), b(8);
+    int same = 0;
+    for (int i = 0; i < 100; i++) {
+        same += (a.next_uint() == b.next_uint());
+    }
+    assert(same < 5);
+
+    // The first outputs of neighbouring stream ids, as pixel seeds use them, shouldn't correlate
+    const int streams = 20000;
+    double sx = 0, sy = 0, sxy = 0, sxx = 0, syy = 0;
+    for (int k = 0; k < streams; k++) {
+        double x = pcg32(k).uniform(), y = pcg32(k + 1).uniform();
+        sx += x; sy += y; sxy += x * y; sxx += x * x; syy += y * y;
+    }
+    double cov = sxy / streams - (sx / streams) * (sy / streams);
+    double var_x = sxx / streams - (sx / streams) * (sx / streams);
+    double var_y = syy / streams - (sy / streams) * (sy / streams);
+    assert(std::fabs(cov / std::sqrt(var_x * var_y)) < 0.03);
+    std::cout << "test_rng_sequences_differ passed!\n";
+}
+
+void test_rng_uniform_range() {
+    pcg32 r(3);
+    double sum = 0;
+    for (int i = 0; i < 10000; i++) {
+        double u = r.uniform();
+        assert(u >= 0.0 && u < 1.0);
+        sum += u;
+    }
+    assert(std::fabs(sum / 10000 - 0.5) < 0.02);
+    std::cout << "test_rng_uniform_range passed!\n";
+}
+
+void test_render_reproducible_across_threads() {
+    /* The same seed should give a bit identical image for any number of threads */
+    hittable_list world;
+    world.add(make_shared<sphere>(vec3h(0, 0, -1, 1), 0.5, world.materials->add(make_shared<lambertian>(color(0.5, 0.2, 0.1, 0)))));
+    world.add(make_shared<sphere>(vec3h(0, -100.5, -1, 1), 100, world.materials->add(make_shared<refractive>(color(1, 1, 1, 0), 1.5))));
+    BVHAggregate bvh(world.objects, 1);
+
+    film images[2];
+    int threads[2] = {1, 3};
+    for (int k = 0; k < 2; k++) {
+        camera cam;
+        cam.image_width = 24;
+        cam.aspect_ratio = 1.5;
+        cam.aa_samples_per_px = 4;
+        cam.ray_bounces = 4;
+        cam.background = color(0.7, 0.8, 1.0, 0);
+        cam.tile_size = 5;
+        cam.num_threads = threads[k];
+        cam.seed = 11;
+        images[k] = cam.render_image(world, bvh);
+    }
+    assert(images[0].rgb == images[1].rgb);
+    std::cout << "test_render_reproducible_across_threads passed!\n";
+}
+
+void test_resume_matches_uninterrupted() {
+    /* Stopping at a checkpoint and resuming should draw the same samples as one long render */
+    hittable_list world;
+    world.add(make_shared<sphere>(vec3h(0, 0, -1, 1), 0.5, world.materials->add(make_shared<lambertian>(color(0.5, 0.2, 0.1, 0)))));
+    world.add(make_shared<sphere>(vec3h(0, -100.5, -1, 1), 100, world.materials->add(make_shared<reflective>(color(0.8, 0.8, 0.8, 0)))));
+    BVHAggregate bvh(world, 1);
+    std::string checkpoint = "test_resume_checkpoint.bin";
+    std::remove(checkpoint.c_str());
+
+    auto make_camera = [](int samples) {
+        camera cam;
+        cam.image_width = 20;
+        cam.aspect_ratio = 2;
+        cam.aa_samples_per_px = samples;
+        cam.ray_bounces = 4;
+        cam.background = color(0.7, 0.8, 1.0, 0);
+        cam.tile_size = 7;
+        cam.num_threads = 2;
+        cam.seed = 5;
+        return cam;
+    };
+    camera whole = make_camera(7);
+    film uninterrupted = whole.render_image(world, bvh);
+
+    camera first = make_camera(3);
+    first.samples_per_pass = 2;
+    first.checkpoint_path = checkpoint;
+    first.render_image(world, bvh);
+    sample_buffer saved;
+    assert(saved.load(checkpoint) && saved.min_samples() == 3 && saved.seed == 5);
+
+    camera second = make_camera(7);
+    second.samples_per_pass = 3;
+    second.checkpoint_path = checkpoint;
+    film resumed = second.render_image(world, bvh);
+    assert(saved.load(checkpoint) && saved.min_samples() == 7);
+    assert(resumed.rgb == uninterrupted.rgb);
+
+    // A checkpoint for another seed is ignored rather than mixed in
+    camera other = make_camera(7);
+    other.seed = 6;
+    other.checkpoint_path = checkpoint;
+    film fresh = other.render_image(world, bvh);
+    camera reference = make_camera(7);
+    reference.seed = 6;
+    assert(fresh.rgb == reference.render_image(world, bvh).rgb);
+
+    // So is one for the same seed but other settings or another scene
+    std::remove(checkpoint.c_str());
+    first.render_image(world, bvh);
+    camera dusk = make_camera(7);
+    dusk.background = color(0.9, 0.5, 0.3, 0);
+    dusk.checkpoint_path = checkpoint;
+    camera dusk_reference = make_camera(7);
+    dusk_reference.background = dusk.background;
+    assert(dusk.render_image(world, bvh).rgb == dusk_reference.render_image(world, bvh).rgb);
+    hittable_list moved;
+    moved.add(make_shared<sphere>(vec3h(0.2, 0, -1, 1), 0.5, moved.materials->add(make_shared<lambertian>(color(0.5, 0.2, 0.1, 0)))));
+    moved.add(make_shared<sphere>(vec3h(0, -100.5, -1, 1), 100, moved.materials->add(make_shared<reflective>(color(0.8, 0.8, 0.8, 0)))));
+    BVHAggregate moved_bvh(moved, 1);
+    std::remove(checkpoint.c_str());
+    first.render_image(world, bvh);
+    camera other_scene = make_camera(7);
+    other_scene.checkpoint_path = checkpoint;
+    film moved_image = other_scene.render_image(moved, moved_bvh);
+    assert(moved_image.rgb == make_camera(7).render_image(moved, moved_bvh).rgb);
+
+    // Rank-1 samples depend on the sample budget, so a checkpoint for a smaller one is ignored
+    std::remove(checkpoint.c_str());
+    first.sample_pattern = SAMPLER_RANK1;
+    first.render_image(world, bvh);
+    camera rank1 = make_camera(7);
+    rank1.sample_pattern = SAMPLER_RANK1;
+    rank1.checkpoint_path = checkpoint;
+    camera rank1_reference = make_camera(7);
+    rank1_reference.sample_pattern = SAMPLER_RANK1;
+    assert(rank1.render_image(world, bvh).rgb == rank1_reference.render_image(world, bvh).rgb);
+    std::remove(checkpoint.c_str());
+    std::cout << "test_resume_matches_uninterrupted passed!\n";
+}
+
+void test_samplers_stratify() {
+    /*
+    Every sampler stays in [0,1) and repeats itself for the same pixel sample. Sobol's first
+    16 points of any dimension pair fill each cell of a 4x4 grid once, and 16 stratified
+    samples fill each sixteenth of a 1D dimension once.
+    */
+    for (sampler_type type : {SAMPLER_INDEPENDENT, SAMPLER_STRATIFIED, SAMPLER_SOBOL, SAMPLER_RANK1}) {
+        std::unique_ptr<sampler> a = make_sampler(type, 3, 16), b = make_sampler(type, 3, 16);
+        for (uint32_t s = 0; s < 64; s++) {
+            seed_random(s);
+            a->start_pixel_sample(5, 9, s);
+            double u1, u2, u3 = a->get_1d();
+            a->get_2d(u1, u2);
+            assert(u1 >= 0 && u1 < 1 && u2 >= 0 && u2 < 1 && u3 >= 0 && u3 < 1);
+            seed_random(s);
+            b->start_pixel_sample(5, 9, s);
+            double v1, v2, v3 = b->get_1d();
+            b->get_2d(v1, v2);
+            assert(u1 == v1 && u2 == v2 && u3 == v3);
+        }
+    }
+
+    std::unique_ptr<sampler> sobol = make_sampler(SAMPLER_SOBOL, 3, 16);
+    std::unique_ptr<sampler> stratified = make_sampler(SAMPLER_STRATIFIED, 3, 16);
+    for (int dimension : {0, 4, 11}) {
+        std::vector<int> cells(16, 0), strata(16, 0);
+        for (uint32_t s = 0; s < 16; s++) {
+            double u1, u2;
+            sobol->start_pixel_sample(2, 7, s);
+            sobol->set_dimension(dimension);
+            sobol->get_2d(u1, u2);
+            cells[int(u1 * 4) + 4 * int(u2 * 4)]++;
+            stratified->start_pixel_sample(2, 7, s);
+            stratified->set_dimension(dimension);
+            strata[int(stratified->get_1d() * 16)]++;
+        }
+        for (int k = 0; k < 16; k++) assert(cells[k] == 1 && strata[k] == 1);
+    }
+    std::cout << "test_samplers_stratify passed!\n";
+}
+
+void test_sampler_dimensions_independent() {
+    /*
+    Two dimensions of a path should look independent of each other: 256 samples of a 1D
+    draw against a later one, or against a 2D draw, spread over every cell of a 4x4 grid
+    rather than lining up along a diagonal
+    */
+    for (sampler_type type : {SAMPLER_INDEPENDENT, SAMPLER_STRATIFIED, SAMPLER_SOBOL, SAMPLER_RANK1}) {
+        std::unique_ptr<sampler> smp = make_sampler(type, 3, 16);
+        std::vector<int> cells_1d(16, 0), cells_2d(16, 0);
+        for (uint32_t s = 0; s < 256; s++) {
+            seed_random(s);
+            smp->start_pixel_sample(4, 6, s);
+            smp->set_dimension(3);
+            double a = smp->get_1d();
+            smp->set_dimension(9);
+            double b = smp->get_1d();
+            double u1, u2;
+            smp->get_2d(u1, u2);
+            cells_1d[int(a * 4) + 4 * int(b * 4)]++;
+            cells_2d[int(a * 4) + 4 * int(u2 * 4)]++;
+        }
+        for (int k = 0; k < 16; k++) {
+            assert(cells_1d[k] >= 4 && cells_1d[k] <= 36);
+            assert(cells_2d[k] >= 4 && cells_2d[k] <= 36);
+        }
+    }
+    std::cout << "test_sampler_dimensions_independent passed!\n";
+}
+
+int run_test_rng() {
+    std::cout << "\n Starting tests for /sampling/rng\n\n";
+
+    test_rng_same_seed_same_sequence();
+    test_rng_sequences_differ();
+    test_rng_uniform_range();
+    test_render_reproducible_across_threads();
+    test_resume_matches_uninterrupted();
+    test_samplers_stratify();
+    test_sampler_dimensions_independent();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
+
+#endif
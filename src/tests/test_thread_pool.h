@@ -0,0 +1,55 @@
+#ifndef TEST_THREAD_POOL_H
+#define TEST_THREAD_POOL_H
+
+#include <atomic>
+#include <cassert>
+#include <vector>
+#include <iostream>
+#include "../include/parallel/thread_pool.h"
+
+void test_parallel_for_covers_range() {
+    /* Every index should be run exactly once */
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallel_for(1000, [&](int i) { hits[i].fetch_add(1); });
+    for (auto& h : hits) {
+        assert(h.load() == 1);
+    }
+    std::cout << "test_parallel_for_covers_range passed!\n";
+}
+
+void test_single_thread_pool() {
+    /* A pool of one thread runs everything on the caller */
+    thread_pool pool(1);
+    int sum = 0;
+    pool.parallel_for(10, [&](int i) { sum += i; });
+    assert(sum == 45);
+    std::cout << "test_single_thread_pool passed!\n";
+}
+
+void test_nested_tasks() {
+    /* Tasks that spawn and wait on their own tasks should not deadlock */
+    thread_pool pool(3);
+    std::atomic<int> count{0};
+    pool.parallel_for(8, [&](int) {
+        task_group inner;
+        for (int k = 0; k < 8; ++k) {
+            pool.submit([&count] { count.fetch_add(1); }, inner);
+        }
+        pool.wait(inner);
+    });
+    assert(count.load() == 64);
+    std::cout << "test_nested_tasks passed!\n";
+}
+
+int run_test_thread_pool() {
+    std::cout << "\n Starting tests for /parallel/thread_pool\n\n";
+
+    test_parallel_for_covers_range();
+    test_single_thread_pool();
+    test_nested_tasks();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
+
+#endif
@@ -16,25 +16,25 @@ bool matricesAreEqual(const squareMatrix<4>& m1, const squareMatrix<4>& m2, doub
 }
 
 void test_matrix_multiplication() {
-    const double A_data[4][4] = {
+    const Float A_data[4][4] = {
         {1, 2, 3, 4},
         {0, 1, 4, 2},
         {5, 6, 0, 1},
         {3, 2, 1, 0}
     };
 
-    const double B_data[4][4] = {
+    const Float B_data[4][4] = {
         {1, 0, 2, 1},
         {0, 1, 3, 0},
         {1, 0, 0, 4},
         {0, 2, 1, 3}
     };
 
-    const double expected_result[4][4] = {
-        {6, 10, 13, 29},
-        {4, 10, 7, 18},
-        {11, 12, 28, 7},
-        {5, 4, 9, 10}
+    const Float expected_result[4][4] = {
+        {4, 10, 12, 25},
+        {4, 5, 5, 22},
+        {5, 8, 29, 8},
+        {4, 2, 12, 7}
     };
 
     squareMatrix<4> A(A_data);
@@ -56,7 +56,7 @@ void test_matrix_multiplication() {
 void test_translation() {
     vec3h delta(1, 2, 3, 1);
     transform result = translate(delta);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {1, 0, 0, 1},
         {0, 1, 0, 2},
         {0, 0, 1, 3},
@@ -68,7 +68,7 @@ void test_translation() {
 
 void test_scaling() {
     transform result = scale(2, 3, 4);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {2, 0, 0, 0},
         {0, 3, 0, 0},
         {0, 0, 4, 0},
@@ -81,7 +81,7 @@ void test_scaling() {
 void test_rotate_x() {
     double theta = pi / 2; // 90 degrees
     transform result = rotateX(theta);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {1, 0, 0, 0},
         {0, 0, -1, 0},
         {0, 1, 0, 0},
@@ -94,7 +94,7 @@ void test_rotate_x() {
 void test_rotate_y() {
     double theta = pi / 2; // 90 degrees
     transform result = rotateY(theta);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {0, 0, 1, 0},
         {0, 1, 0, 0},
         {-1, 0, 0, 0},
@@ -107,7 +107,7 @@ void test_rotate_y() {
 void test_rotate_z() {
     double theta = pi / 2; // 90 degrees
     transform result = rotateZ(theta);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {0, -1, 0, 0},
         {1, 0, 0, 0},
         {0, 0, 1, 0},
@@ -121,7 +121,7 @@ void test_rotate_axis() {
     vec3h axis(0, 1, 0, 0); // Y-axis
     double theta = pi / 2; // 90 degrees
     transform result = rotateAxis(axis, theta);
-    const double expected[4][4] = {
+    const Float expected[4][4] = {
         {0, 0, 1, 0},
         {0, 1, 0, 0},
         {-1, 0, 0, 0},
@@ -132,12 +132,12 @@ void test_rotate_axis() {
 }
 
 void test_perspective() {
-    double fov = pi / 4; // 45 degrees
-    double znear = 1.0;
-    double zfar = 10.0;
+    Float fov = pi / 4; // 45 degrees
+    Float znear = 1.0;
+    Float zfar = 10.0;
     transform result = perspective(fov, znear, zfar);
-    double tan_half_fov = std::tan(fov / 2.0);
-    const double expected[4][4] = {
+    Float tan_half_fov = std::tan(fov / 2.0);
+    const Float expected[4][4] = {
         {1 / tan_half_fov, 0, 0, 0},
         {0, 1 / tan_half_fov, 0, 0},
         {0, 0, -(zfar + znear) / (zfar - znear), -2 * zfar * znear / (zfar - znear)},
@@ -179,9 +179,28 @@ void test_apply_transform_dir() {
     std::cout << "test_apply_transform_dir passed!\n";
 }
 
+void test_inverse() {
+    transform shift = translate(vec3h(1, -2, 3, 0));
+    transform rot = rotateAxis(vec3h(1, 2, 3, 0), 0.7);
+    transform stretch = scale(2, 0.5, 1.5);
+    transform t = combine_transform(shift, rot, stretch);
+    const Float identity[4][4] = {
+        {1, 0, 0, 0},
+        {0, 1, 0, 0},
+        {0, 0, 1, 0},
+        {0, 0, 0, 1}
+    };
+    const squareMatrix<4> m = t.m;
+    const squareMatrix<4> inv = inverse(t).m;
+    assert(matricesAreEqual(m * inv, squareMatrix<4>(identity)));
+    assert(matricesAreEqual(inv * m, squareMatrix<4>(identity)));
+    std::cout << "test_inverse passed!\n";
+}
+
 int run_test_transform() {
     std::cout << "\n Starting tests for /geometry/transform\n\n";
 
+    test_matrix_multiplication();
     test_translation();
     test_scaling();
     test_rotate_x();
@@ -191,6 +210,7 @@ int run_test_transform() {
     test_perspective();
     test_apply_transform_point();
     test_apply_transform_dir();
+    test_inverse();
 
     return 0;
 }
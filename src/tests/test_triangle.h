@@ -1,6 +1,9 @@
 #include "../include/geometry/vec3.h"
 #include "../include/materials/diffuseBXDF.h"
 #include "../include/primitive_shapes/triangle.h"
+#include "../include/primitive_shapes/triangle_block.h"
+#include "../include/primitive_shapes/hittable_list.h"
+#include "../include/acceleration/bvh_aggregate.h"
 #include <cassert>
 #include <vector>
 
@@ -71,6 +74,104 @@ void test_dist() {
 
 }
 
+void test_dist_unnormalized_direction() {
+    /* t is in units of the ray parameter, so a longer direction gives a smaller t */
+    vec3h p0(3, 0, -1, 1);
+    vec3h p1(3, 1, 0, 1);
+    vec3h p2(3, 0, 1, 1);
+    std::vector<vec3h> tri_vertices = {p0, p1, p2};
+    std::vector<int> indices = {0,1,2};
+    triangleMesh mesh = triangleMesh(tri_vertices, indices, 1);
+    triangle tri(&mesh, 0);
+
+    ray r(vec3h(-1, 0.5, 0, 1), vec3h(2, 0, 0, 0));
+    interval ray_t(0.001, 100.0);
+    hit_record rec;
+    assert(tri.intersect(r, ray_t, rec));
+    assert(rec.t == 2.0);
+    assert(rec.p.x == 3.0 && rec.p.y == 0.5 && rec.p.z == 0.0);
+    std::cout << "test_dist_unnormalized_direction passed!\n";
+}
+
+void test_occluded() {
+    vec3h p0(0, 0, 0, 1);
+    vec3h p1(1, 0, 0, 1);
+    vec3h p2(0, 1, 0, 1);
+    std::vector<vec3h> tri_vertices = {p0, p1, p2};
+    std::vector<int> indices = {0,1,2};
+    triangleMesh mesh = triangleMesh(tri_vertices, indices, 1);
+    triangle tri(&mesh, 0);
+
+    ray r(vec3h(0.25, 0.25, -1, 1), vec3h(0, 0, 1, 0));
+    assert(tri.occluded(r, interval(0.001, 2.0)));
+    assert(!tri.occluded(r, interval(0.001, 0.5)));
+    std::cout << "test_occluded passed!\n";
+}
+
+void test_negative_axis_direction() {
+    /* A ray along -z has no positive component, the permutation must still pick z */
+    vec3h p0(0, 0, 0, 1);
+    vec3h p1(1, 0, 0, 1);
+    vec3h p2(0, 1, 0, 1);
+    std::vector<vec3h> tri_vertices = {p0, p1, p2};
+    std::vector<int> indices = {0,1,2};
+    triangleMesh mesh = triangleMesh(tri_vertices, indices, 1);
+    triangle tri(&mesh, 0);
+
+    ray r(vec3h(0.25, 0.25, 1, 1), vec3h(0, 0, -1, 0));
+    hit_record rec;
+    assert(tri.intersect(r, interval(0.001, 100.0), rec));
+    assert(std::abs(rec.t - 1.0) < 1e-9);
+    std::cout << "test_negative_axis_direction passed!\n";
+}
+
+void test_block_matches_scalar() {
+    /* A block of triangles should report the hits and distances of the scalar watertight test */
+    pcg32 r(5);
+    std::vector<vec3h> vertices;
+    std::vector<int> indices;
+    for (int i = 0; i < 7; i++) {
+        vec3h corner(r.uniform() * 2 - 1, r.uniform() * 2 - 1, r.uniform() * 2 - 1, 1);
+        for (int k = 0; k < 3; k++) {
+            indices.push_back(static_cast<int>(vertices.size()));
+            vertices.push_back(corner + vec3h(r.uniform() * 2 - 1, r.uniform() * 2 - 1, r.uniform() * 2 - 1, 0));
+        }
+    }
+    // A degenerate triangle, all three corners on one line
+    vertices[18] = vec3h(0, 0, 0, 1);
+    vertices[19] = vec3h(1, 1, 1, 1);
+    vertices[20] = vec3h(2, 2, 2, 1);
+    triangleMesh mesh(vertices, indices, 7);
+
+    // Two blocks, the second only partly filled
+    triangle_block blocks[2];
+    for (int i = 0; i < 7; i++) blocks[i / 4].add(mesh, i, i);
+
+    int hits = 0;
+    for (int n = 0; n < 2000; n++) {
+        ray test_ray(vec3h(r.uniform() * 6 - 3, r.uniform() * 6 - 3, r.uniform() * 6 - 3, 1),
+                     vec3h(r.uniform() * 2 - 1, r.uniform() * 2 - 1, r.uniform() * 2 - 1, 0));
+        interval ray_t(0.001, r.uniform() * 6);
+        triangle_ray tr(test_ray);
+        for (int b = 0; b < 2; b++) {
+            double t_hit[triangle_block_width];
+            int mask = intersect_triangle_block(blocks[b], tr, ray_t.min, ray_t.max, t_hit);
+            for (int k = 0; k < triangle_block_width; k++) {
+                int i = 4 * b + k;
+                hit_record rec;
+                bool scalar_hit = i < 7 && triangle::intersect(mesh, i, test_ray, ray_t, rec);
+                assert(bool(mask & (1 << k)) == scalar_hit);
+                if (scalar_hit) {
+                    assert(t_hit[k] == rec.t);
+                    hits++;
+                }
+            }
+        }
+    }
+    assert(hits > 0);
+    std::cout << "test_block_matches_scalar passed!\n";
+}
+
 void test_permutation() {
     // Create a triangle and direction vectors
     vec3h p0(3, 0, -1, 1);
@@ -82,8 +183,8 @@ void test_permutation() {
     triangle tri(&mesh, 0);
 
     // Test case where direction is along the x-axis
-    vec3h direction1(1.0, 0.0, 0.0, 0.0);
-    vec3h dirt1, p0t1(1.0, 2.0, 3.0, 1.0), p1t1(4.0, 5.0, 6.0, 1.0), p2t1(7.0, 8.0, 9.0, 1.0);
+    vec3d direction1(1.0, 0.0, 0.0, 0.0);
+    vec3d dirt1, p0t1(1.0, 2.0, 3.0, 1.0), p1t1(4.0, 5.0, 6.0, 1.0), p2t1(7.0, 8.0, 9.0, 1.0);
     tri.permutation(direction1, dirt1, p0t1, p1t1, p2t1);
 
     // After permutation, x and z should swap
@@ -93,8 +194,8 @@ void test_permutation() {
     assert(dirt1.x == 0.0 && dirt1.y == 0.0 && dirt1.z == 1.0);  // Dirt should be (0, 0, 1)
 
     // Test case where direction is along the y-axis
-    vec3h direction2(0.0, 1.0, 0.0, 0.0);
-    vec3h dirt2, p0t2(1.0, 2.0, 3.0, 1.0), p1t2(4.0, 5.0, 6.0, 1.0), p2t2(7.0, 8.0, 9.0, 1.0);
+    vec3d direction2(0.0, 1.0, 0.0, 0.0);
+    vec3d dirt2, p0t2(1.0, 2.0, 3.0, 1.0), p1t2(4.0, 5.0, 6.0, 1.0), p2t2(7.0, 8.0, 9.0, 1.0);
     tri.permutation(direction2, dirt2, p0t2, p1t2, p2t2);
 
     // After permutation, y and z should swap
@@ -104,8 +205,8 @@ void test_permutation() {
     assert(dirt2.x == 0.0 && dirt2.y == 0.0 && dirt2.z == 1.0);  // Dirt should be (0, 0, 1)
 
     // Test case where direction is along the z-axis
-    vec3h direction3(0.0, 0.0, 1.0, 1.0);
-    vec3h dirt3, p0t3(1.0, 2.0, 3.0, 1.0), p1t3(4.0, 5.0, 6.0, 1.0), p2t3(7.0, 8.0, 9.0, 1.0);
+    vec3d direction3(0.0, 0.0, 1.0, 1.0);
+    vec3d dirt3, p0t3(1.0, 2.0, 3.0, 1.0), p1t3(4.0, 5.0, 6.0, 1.0), p2t3(7.0, 8.0, 9.0, 1.0);
     tri.permutation(direction3, dirt3, p0t3, p1t3, p2t3);
 
     // No permutation, dirt should be the same as direction
@@ -129,8 +230,8 @@ void test_shear() {
     
 
     // Test case where dirt = (1.0, 2.0, 3.0)
-    vec3h dirt1(1.0, 2.0, 3.0, 0);
-    vec3h p0t1(1.0, 1.0, 1.0, 1), p1t1(2.0, 2.0, 2.0, 1), p2t1(3.0, 3.0, 3.0, 1);
+    vec3d dirt1(1.0, 2.0, 3.0, 0);
+    vec3d p0t1(1.0, 1.0, 1.0, 1), p1t1(2.0, 2.0, 2.0, 1), p2t1(3.0, 3.0, 3.0, 1);
     tri.shear(dirt1, p0t1, p1t1, p2t1);
 
     // After shear, x and y coordinates should be adjusted based on the shear factors.
@@ -152,7 +253,7 @@ void test_shear() {
 
 
 void test_apply_total_transform() {
-    const double A_data[4][4] = {
+    const Float A_data[4][4] = {
         {2, 3, 4, 0},
         {6, 1, 0, 0},
         {0, 2, 3, 0},
@@ -167,21 +268,60 @@ void test_apply_total_transform() {
     triangleMesh mesh(vertices, indices, 2);
     transform t1 = transform(A_data);
     mesh.apply_total_transform(t1);
-    assert(mesh.vertices[0] == vec3h(2,6,0,1));
-    assert(mesh.vertices[1] == vec3h(23,33,9,1));
-    assert(mesh.vertices[2] == vec3h(37,43,17,1));
+    assert(vec3h(mesh.vertices[0]) == vec3h(2,6,0,1));
+    assert(vec3h(mesh.vertices[1]) == vec3h(23,33,9,1));
+    assert(vec3h(mesh.vertices[2]) == vec3h(37,43,17,1));
 
     std::cout << "test_apply_total_transform passed!\n";
     
 }
 
+void test_triangle_cache() {
+    /*
+    Normals and areas come from the mesh's cache, which has to follow the vertices
+    through apply_total_transform. Degenerate triangles are flagged and left out of BVHs.
+    */
+    std::vector<vec3h> vertices = {
+        vec3h(0, 0, 0, 1), vec3h(2, 0, 0, 1), vec3h(0, 2, 0, 1), vec3h(4, 0, 0, 1)
+    };
+    std::vector<int> indices = {0, 1, 2, 0, 1, 3};
+    triangleMesh mesh(vertices, indices, 2);
+    assert(mesh.data(0).normal() == vec3h(0, 0, 1, 0) && mesh.data(0).area == 2 && !mesh.data(0).degenerate);
+    assert(mesh.data(1).degenerate && mesh.data(1).area == 0);
+    assert(mesh.bounds().pmax.x == 4 && mesh.bounds().pmax.y == 2);
+
+    transform shift = translate(vec3h(0, 0, 5, 0));
+    transform rot = rotateX(pi / 2);
+    transform t = combine_transform(shift, rot);
+    mesh.apply_total_transform(t);
+    assert(std::fabs(mesh.data(0).normal().y + 1) < 1e-6 && std::fabs(triangle::bounds(mesh, 0).pmin.z - 5) < 1e-6);
+    assert(std::fabs(mesh.data(0).area - 2) < 1e-6);
+    triangleMesh copy = mesh;
+    assert(copy.data(0).normal() == mesh.data(0).normal() && sizeof(triangle_data) <= 20);
+
+    hittable_list world;
+    world.add(&mesh);
+    BVHAggregate bvh(world, 4);
+    assert(bvh.get_primitives().size() == 1);
+    hit_record rec;
+    traversal_stats stats;
+    assert(bvh.intersect(ray(vec3h(0.5, 5, 5.5, 1), vec3h(0, -1, 0, 0)), interval(0.001, infinity), rec, stats));
+    assert(std::fabs(rec.t - 5) < 1e-6 && std::fabs(rec.normal.y - 1) < 1e-6 && rec.front_face == false);
+    std::cout << "test_triangle_cache passed!\n";
+}
+
 int run_test_triangle() {
     std::cout << "\n Starting tests for /primative_shapes/triangle\n\n";
     test_area();
     test_intersection();
     test_no_intersection();
     test_dist();
+    test_dist_unnormalized_direction();
+    test_occluded();
+    test_negative_axis_direction();
+    test_block_matches_scalar();
     test_apply_total_transform();
+    test_triangle_cache();
     std::cout << "All tests passed!" << std::endl;
     return 0;
 }